@@ -0,0 +1,156 @@
+/**
+ * \file   canvas_bench.cc
+ * \brief  Measure the terminal output of the ANSI canvas against ncurses, per frame.
+ */
+
+#include <clocale>
+#include <cstdio>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "fighttrack/ansi_canvas.h"
+#include "fighttrack/camera.h"
+#include "fighttrack/canvas.h"
+#include "fighttrack/entity_store.h"
+#include "fighttrack/map.h"
+#include "fighttrack/map_file.h"
+#include "fighttrack/player.h"
+#include "fighttrack/player_states.h"
+#include "fighttrack/renderer.h"
+
+/**************************************************************************************/
+
+using namespace fighttrack;
+using Clock = std::chrono::steady_clock;
+
+//! Frames rendered in every scene
+constexpr int kFrames = 1000;
+//! Screen size, border included
+constexpr int kScreenWidth = 80;
+constexpr int kScreenHeight = 24;
+//! Keys pressed by the fighters, in turns
+constexpr int kKeys[] = { KEY_LEFT, KEY_RIGHT, KEY_UP, KEY_RIGHT, KEY_LEFT, 'x' };
+
+/**
+ * Scene rendered by both canvases
+ */
+struct Scene {
+    const char* name;  //!< Name printed
+    int fighters;      //!< Number of fighters
+    bool scrolling;    //!< Flag to run along a long map, the camera following
+};
+
+/* Compile a map much wider than the screen, with platforms all along */
+static int LoadLongMap(Map& map)
+{
+    constexpr int kWidth = 2000;
+    constexpr int kHeight = 20;
+    std::vector<std::string> rows(kHeight);
+    for (int y = 0; y < kHeight; ++y) {
+        for (int x = 0; x < kWidth; ++x) {
+            const bool platform = (x % 24 < 10) && (y == ((x % 48 < 24) ? 15 : 17));
+            rows[y] += (y == kHeight - 1 || platform) ? "▓" : " ";
+        }
+    }
+    std::string image;
+    if (CompileMap(rows, &image) != 0) {
+        return -1;
+    }
+    return map.LoadImage(std::move(image));
+}
+
+/* Play a scene on a canvas, returning the time taken */
+static Clock::duration Play(const Scene& scene, Canvas& canvas)
+{
+    Map map;
+    if ((scene.scrolling ? LoadLongMap(map) : map.LoadDefault()) != 0) {
+        fprintf(stderr, "Failed to load the map of scene %s\n", scene.name);
+        return Clock::duration::zero();
+    }
+    EntityStore fighters;
+    for (int i = 0; i < scene.fighters; ++i) {
+        Player fighter = fighters.Get(fighters.Find(fighters.Create(std::to_string(i))));
+        fighter.SetSprite(PlayerStateSprites()[0]);
+        fighter.SetPosX(4 + 4 * i).SetPosY(0);
+    }
+
+    Camera camera;
+    Renderer renderer;
+    const auto start = Clock::now();
+    for (int f = 0; f < kFrames; ++f) {
+        for (int i = 0; i < scene.fighters; ++i) {
+            if ((f + i * 7) % 15 == 0) {
+                fighters.Get(i).HandleInput(kKeys[(f / 15 + i) % 6]);
+            }
+        }
+        fighters.Update(map);
+        Player me = fighters.Get(0);
+        if (scene.scrolling) {
+            me.SetPosX(100 + f / 2);
+        }
+        camera.SetScreen({ 1, 1, canvas.GetWidth() - 2, canvas.GetHeight() - 2 });
+        camera.Follow(me.GetPosX(), me.GetPosY(), map.GetWidth(), map.GetHeight());
+        map.Stream(camera.View().Grow(map.GetFile().GetChunkSize()));
+        renderer.Render(canvas, camera, map, fighters);
+    }
+    return Clock::now() - start;
+}
+
+/* Print the output of a scene on a canvas */
+static void Report(const Scene& scene, const char* canvas, long bytes,
+                   Clock::duration elapsed)
+{
+    const double us = std::chrono::duration<double, std::micro>(elapsed).count();
+    printf("%-10s %-8s %8.1f bytes/frame %8.1f us/frame\n", scene.name, canvas,
+           (double) bytes / kFrames, us / kFrames);
+}
+
+/**************************************************************************************/
+
+int main()
+{
+    setlocale(LC_ALL, "C.UTF-8");
+
+    /* Both canvases write to files instead of the terminal, and the bytes are counted */
+    FILE* ncurses_out = tmpfile();
+    FILE* ncurses_in = fopen("/dev/null", "r");
+    FILE* ansi_out = tmpfile();
+    if (ncurses_out == nullptr || ncurses_in == nullptr || ansi_out == nullptr) {
+        perror("Failed to open the output files");
+        return 1;
+    }
+    SCREEN* screen = newterm("xterm-256color", ncurses_out, ncurses_in);
+    if (screen == nullptr) {
+        fprintf(stderr, "Failed to initialize ncurses\n");
+        return 1;
+    }
+    WINDOW* win = newwin(kScreenHeight, kScreenWidth, 0, 0);
+    const int ansi_fd = fileno(ansi_out);
+
+    const Scene scenes[] = {
+        { "idle", 1, false },     { "duel", 2, false },     { "brawl-8", 8, false },
+        { "brawl-16", 16, false }, { "scrolling", 2, true },
+    };
+    for (const Scene& scene : scenes) {
+        /* Both start from a terminal to redraw entirely */
+        werase(win);
+        clearok(win, TRUE);
+        fflush(ncurses_out);
+        long before = ftell(ncurses_out);
+        WindowCanvas window_canvas{ win };
+        Clock::duration elapsed = Play(scene, window_canvas);
+        fflush(ncurses_out);
+        Report(scene, "ncurses", ftell(ncurses_out) - before, elapsed);
+
+        before = (long) lseek(ansi_fd, 0, SEEK_CUR);
+        AnsiCanvas ansi_canvas{ ansi_fd, { 0, 0, kScreenWidth, kScreenHeight } };
+        elapsed = Play(scene, ansi_canvas);
+        Report(scene, "ansi", (long) lseek(ansi_fd, 0, SEEK_CUR) - before, elapsed);
+    }
+
+    endwin();
+    delscreen(screen);
+    return 0;
+}
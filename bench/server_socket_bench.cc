@@ -0,0 +1,177 @@
+/**
+ * \file   server_socket_bench.cc
+ * \brief  Measure the cost of a received message as the number of connections grows.
+ */
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <vector>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <gsl/gsl>
+
+#include "fighttrack/server_socket.h"
+
+/**************************************************************************************/
+
+using namespace fighttrack;
+using Clock = std::chrono::steady_clock;
+
+//! Messages measured for every number of connections
+constexpr size_t kMessages = 1 << 16;
+//! Messages sent before waiting for the server to get them, on distinct connections
+constexpr size_t kBatch = 16;
+//! Size of a message
+constexpr size_t kMessageSize = 8;
+//! Time to wait for the server before giving up
+constexpr auto kTimeout = std::chrono::seconds(10);
+
+/* Connect a client to the server on the loopback interface */
+static int Connect(uint16_t port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("Failed to create socket");
+        return -1;
+    }
+    int enable = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+        perror("Failed to connect");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Handle the server messages until a number of connections and data bytes came in */
+static int Drain(ServerSocket& server, size_t connections, size_t bytes)
+{
+    const auto deadline = Clock::now() + kTimeout;
+    while (connections > 0 || bytes > 0) {
+        server.GetMessages([&](const ServerSocket::RxMessage& msg) {
+            if (msg.status == ServerSocket::RxStatus::CONNECTED) {
+                connections--;
+            }
+            else if (msg.status == ServerSocket::RxStatus::NEW_DATA) {
+                bytes -= msg.size;
+            }
+            return 0;
+        });
+        if (Clock::now() > deadline) {
+            fprintf(stderr, "Timed out, %zu connections and %zu bytes missing\n",
+                    connections, bytes);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Send messages round-robin over all the connections, and time their reception */
+static int Measure(FILE* results, uint16_t port, ServerSocket::Backend backend,
+                   size_t connections)
+{
+    ServerSocket server;
+    ServerSocket::Options options;
+    options.max_clients = connections;
+    options.backend = backend;
+    if (server.Initialize(port, options) != 0) {
+        return -1;
+    }
+
+    std::vector<int> clients;
+    auto _close_clients = gsl::finally([&] {
+        for (int fd : clients) {
+            close(fd);
+        }
+    });
+    for (size_t i = 0; i < connections; ++i) {
+        const int fd = Connect(port);
+        if (fd < 0) {
+            return -1;
+        }
+        clients.push_back(fd);
+    }
+    if (Drain(server, connections, 0) != 0) {
+        return -1;
+    }
+
+    const char message[kMessageSize] = "message";
+    size_t next = 0;
+    const auto start = Clock::now();
+    for (size_t sent = 0; sent < kMessages; sent += kBatch) {
+        for (size_t i = 0; i < kBatch; ++i) {
+            if (write(clients[next], message, sizeof(message)) != sizeof(message)) {
+                perror("Failed to send message");
+                return -1;
+            }
+            next = (next + 1) % connections;
+        }
+        if (Drain(server, 0, kBatch * sizeof(message)) != 0) {
+            return -1;
+        }
+    }
+    const auto elapsed = Clock::now() - start;
+
+    const double ns = std::chrono::duration<double, std::nano>(elapsed).count();
+    const auto stats = server.GetRxStats();
+    fprintf(results,
+            "%6zu connections: %8.0f ns/message, %llu messages, %llu overflows\n",
+            connections, ns / kMessages, (unsigned long long) stats.messages,
+            (unsigned long long) stats.overflows);
+    return 0;
+}
+
+/**************************************************************************************/
+
+int main(int argc, char* argv[])
+{
+    /* Below the ephemeral ports, which the clients of a run may still hold */
+    const uint16_t port = (argc >= 2) ? (uint16_t) std::atoi(argv[1]) : 27000;
+    auto backend = ServerSocket::Backend::EPOLL;
+    if (argc >= 3) {
+        if (strcmp(argv[2], "io_uring") == 0) {
+            backend = ServerSocket::Backend::IO_URING;
+        }
+        else if (strcmp(argv[2], "epoll") != 0) {
+            fprintf(stderr, "Arguments: [port] [epoll|io_uring]\n");
+            return 1;
+        }
+    }
+
+    /* The server logs every message on stdout, which would be measured too */
+    FILE* results = fdopen(dup(STDOUT_FILENO), "w");
+    if (results == nullptr || freopen("/dev/null", "w", stdout) == nullptr) {
+        perror("Failed to redirect stdout");
+        return 1;
+    }
+
+    /* Both ends of every connection are open here */
+    struct rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+
+    for (size_t connections = 16; connections <= 4096; connections *= 4) {
+        if (2 * connections + 64 > limit.rlim_cur) {
+            fprintf(results, "%6zu connections: skipped, too few file descriptors\n",
+                    connections);
+            continue;
+        }
+        if (Measure(results, port, backend, connections) != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,88 @@
+/**
+ * \file   spatial_hash_bench.cc
+ * \brief  Measure the broadphase of entity contacts, spatial hash against all pairs.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "fighttrack/entity_store.h"
+#include "fighttrack/player.h"
+#include "fighttrack/player_states.h"
+#include "fighttrack/spatial_hash.h"
+
+/**************************************************************************************/
+
+using namespace fighttrack;
+using Clock = std::chrono::steady_clock;
+
+//! Ticks measured with the spatial hash
+constexpr int kTicks = 100;
+
+/* Time the contacts of entities scattered over a square area, both ways */
+static int Measure(size_t entities, int world_size)
+{
+    EntityStore store(entities);
+    std::mt19937 rng(1);
+    for (size_t i = 0; i < entities; ++i) {
+        Player player = store.Get(store.Find(store.Create("player")));
+        player.SetSprite(PlayerStateSprites()[0]);
+        player.SetPosX((int) (rng() % world_size)).SetPosY((int) (rng() % world_size));
+    }
+
+    /* Every tick, the hash is rebuilt and every entity looks up its contacts */
+    SpatialHash hash;
+    size_t hash_contacts = 0;
+    const auto hash_start = Clock::now();
+    for (int t = 0; t < kTicks; ++t) {
+        store.BuildSpatialHash(hash);
+        hash_contacts = 0;
+        for (size_t i = 0; i < store.Size(); ++i) {
+            store.QueryContacts(hash, i, [&](size_t) { hash_contacts++; });
+        }
+    }
+    const auto hash_elapsed = (Clock::now() - hash_start) / kTicks;
+
+    /* Once, every entity checked against every other */
+    std::vector<Rect> bounds;
+    for (size_t i = 0; i < store.Size(); ++i) {
+        bounds.push_back(store.Get(i).GetBounds());
+    }
+    size_t pair_contacts = 0;
+    const auto pairs_start = Clock::now();
+    for (size_t i = 0; i < bounds.size(); ++i) {
+        for (size_t j = 0; j < bounds.size(); ++j) {
+            pair_contacts += (i != j && bounds[i].Intersects(bounds[j]));
+        }
+    }
+    const auto pairs_elapsed = Clock::now() - pairs_start;
+
+    using Ms = std::chrono::duration<double, std::milli>;
+    printf("%zu entities over %dx%d: spatial hash %.3f ms/tick, all pairs %.3f ms/tick, "
+           "%zu contacts\n",
+           entities, world_size, world_size, Ms(hash_elapsed).count(),
+           Ms(pairs_elapsed).count(), hash_contacts);
+    if (hash_contacts != pair_contacts) {
+        fprintf(stderr, "Spatial hash found %zu contacts, all pairs %zu\n", hash_contacts,
+                pair_contacts);
+        return -1;
+    }
+    return 0;
+}
+
+/**************************************************************************************/
+
+int main(int argc, char* argv[])
+{
+    if (argc >= 3) {
+        return (Measure(std::atoi(argv[1]), std::atoi(argv[2])) == 0) ? 0 : 1;
+    }
+    /* Spread out, then crowded */
+    if (Measure(10000, 1000) != 0 || Measure(10000, 300) != 0) {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,101 @@
+/**
+ * \file ansi_canvas.h
+ * \brief Canvas written to the terminal with ANSI escape sequences, without ncurses.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "fighttrack/canvas.h"
+#include "fighttrack/geometry.h"
+
+/**************************************************************************************/
+
+namespace fighttrack {
+
+/**
+ * Canvas on a rectangle of a UTF-8 terminal, output by hand with ANSI sequences.
+ *
+ * Frames are drawn on a back buffer. Present() compares it with the front buffer,
+ * what the terminal shows, and sends only the cells that differ, in order. The cursor
+ * goes over unchanged cells the cheapest way: a cursor position sequence, a cursor
+ * forward sequence, or writing the cells again. A frame goes out in a single write(),
+ * and a frame without changes writes nothing.
+ *
+ * The terminal mode (no echo, hidden cursor) is left to the caller, ncurses may
+ * still own it and the input.
+ */
+class AnsiCanvas : public Canvas {
+   public:
+    /**
+     * \brief Construct a new Ansi Canvas object, rewriting every cell the first frame.
+     * \param fd   Terminal file descriptor, not owned.
+     * \param area Rectangle of the terminal drawn on, 0-based.
+     */
+    AnsiCanvas(int fd, const Rect& area);
+
+    int GetWidth() const override { return area_.width; }
+    int GetHeight() const override { return area_.height; }
+
+    void Put(int pos_x, int pos_y, const cchar_t* cells, const uint8_t* widths,
+             size_t count) override;
+    void Clear(const Rect& area) override;
+    void Border() override;
+    void Present() override;
+
+    /**
+     * \brief Forget what the terminal shows, so the next frame rewrites every cell.
+     */
+    void Invalidate();
+
+    /**
+     * \brief Number of frames written, and of bytes, since construction.
+     */
+    uint64_t GetFramesWritten() const { return frames_written_; }
+    uint64_t GetBytesWritten() const { return bytes_written_; }
+
+   private:
+    /**
+     * Character cell
+     */
+    struct Cell {
+        //! Character and the ones combining with it, 0-terminated if fewer
+        wchar_t text[CCHARW_MAX + 1];
+        //! Columns covered: 1 or 2, 0 on the right half of a wide cell, -1 unknown
+        int8_t width;
+
+        bool operator==(const Cell& other) const;
+        bool operator!=(const Cell& other) const { return !(*this == other); }
+    };
+
+    /**
+     * \brief Set a cell of the back buffer, not leaving half of a wide cell behind.
+     */
+    void Set(int pos_x, int pos_y, const Cell& cell);
+
+    /**
+     * \brief Append the sequence moving the cursor to a cell, if not there already.
+     */
+    void MoveCursor(int pos_x, int pos_y);
+
+    /**
+     * \brief Append a cell as UTF-8.
+     */
+    void AppendCell(const Cell& cell);
+
+    int fd_;                   //!< Terminal file descriptor
+    Rect area_;                //!< Rectangle of the terminal drawn on
+    std::vector<Cell> back_;   //!< Frame being drawn; index: y * width + x
+    std::vector<Cell> front_;  //!< Frame on the terminal; index: y * width + x
+    std::string out_;          //!< Output of the frame being presented
+    int cursor_x_;             //!< Column of the terminal cursor, -1 if unknown
+    int cursor_y_;             //!< Row of the terminal cursor
+    uint64_t frames_written_;  //!< Frames written
+    uint64_t bytes_written_;   //!< Bytes written
+};
+
+} /* namespace fighttrack */
@@ -5,14 +5,26 @@
 
 #pragma once
 
+#include <cstdint>
 #include <vector>
 #include <string>
 #include <ncurses.h>
 
+#include "fighttrack/canvas.h"
+#include "fighttrack/geometry.h"
+
 /**************************************************************************************/
 
 namespace fighttrack {
 
+/**
+ * Art made of rows of UTF-8 text, where spaces are transparent.
+ *
+ * The text is decoded once, at construction, into ncurses wide-character cells, each
+ * with its display width, and split into runs of cells between spaces. Drawing
+ * copies the runs to the window with the bulk cell API, without decoding again.
+ * Zero-width characters combine with the character before them.
+ */
 class AsciiArt {
    public:
     /**
@@ -26,24 +38,67 @@ class AsciiArt {
     ~AsciiArt() = default;
 
     /**
-     * \brief  Draw the art to the window.
+     * \brief  Draw the art to the canvas.
      * \param pos_y  Y position.
      * \param pos_x  X position.
-     * \param win  Ncurses Window.
+     * \param canvas Canvas.
      */
-    void Draw(int pos_x, int pos_y, WINDOW* win);
+    void Draw(int pos_x, int pos_y, Canvas& canvas) const;
+
+    /**
+     * \brief  Draw the part of the art inside a rectangle of the canvas.
+     * \param pos_x  X position.
+     * \param pos_y  Y position.
+     * \param canvas Canvas.
+     * \param clip   Rectangle drawn into, in canvas coordinates.
+     */
+    void Draw(int pos_x, int pos_y, Canvas& canvas, const Rect& clip) const;
 
     /**
      * \brief Retrive the charecter at given position
-     * \param pos_x  X position relative to the art's origin.
-     * \param pos_y  Y position relative to the art's origin.
-     * \return return '\0' if position is not valid.
+     * \param pos_x  Column relative to the art's origin.
+     * \param pos_y  Row relative to the art's origin.
+     * \return Character covering the column, ' ' if transparent, '\0' if the position
+     *         is not valid.
      */
-    char GetChar(int pos_x, int pos_y);
+    wchar_t GetChar(int pos_x, int pos_y) const;
+
+    /**
+     * \brief Get the size of the art, its bounding box, in columns and rows.
+     */
+    int GetWidth() const { return max_x_; }
+    int GetHeight() const { return max_y_; }
 
    private:
-    int max_x_, max_y_;                //!< Maximum length of the art
-    std::vector<std::string> matrix_;  //!< Art char matrix
+    /**
+     * Run of characters that are not spaces, drawn with a single call
+     */
+    struct Span {
+        int x;            //!< Column of the first cell
+        int width;        //!< Number of columns
+        uint32_t offset;  //!< Offset of the first cell in cells_
+        uint32_t length;  //!< Number of cells
+    };
+
+    int max_x_, max_y_;             //!< Maximum length of the art, in columns
+    std::vector<cchar_t> cells_;    //!< Cells of all runs, in order
+    std::vector<uint8_t> widths_;   //!< Display width of every cell; index: cell
+    std::vector<Span> spans_;       //!< Runs of every row, in order
+    //! First run of every row in spans_, and the end; size: rows + 1
+    std::vector<uint32_t> row_spans_;
 };
 
+/**
+ * \brief Draw text on a line of the canvas, only the part inside a rectangle.
+ *        Decoded as in AsciiArt.
+ * \param canvas Canvas.
+ * \param pos_x  X position.
+ * \param pos_y  Y position.
+ * \param text   UTF-8 text.
+ * \param length Number of bytes.
+ * \param clip   Rectangle drawn into, in canvas coordinates.
+ */
+void DrawClipped(Canvas& canvas, int pos_x, int pos_y, const char* text, size_t length,
+                 const Rect& clip);
+
 } /* namespace fighttrack */
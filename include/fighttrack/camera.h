@@ -0,0 +1,90 @@
+/**
+ * \file camera.h
+ * \brief Camera mapping the world onto the terminal.
+ */
+
+#pragma once
+
+#include "fighttrack/geometry.h"
+
+/**************************************************************************************/
+
+namespace fighttrack {
+
+/**
+ * View of a part of the world, shown in a rectangle of the screen.
+ *
+ * World coordinates are map cells. The camera picks the world rectangle shown, of the
+ * screen rectangle's size, and converts positions between the two.
+ */
+class Camera {
+   public:
+    /**
+     * \brief Construct a new Camera object, showing nothing.
+     */
+    Camera() : screen_{ 0, 0, 0, 0 }, view_{ 0, 0, 0, 0 } {}
+
+    /**
+     * \brief Set where the view is shown.
+     * \param screen Rectangle of the screen, in window coordinates.
+     */
+    void SetScreen(const Rect& screen)
+    {
+        screen_ = screen;
+        view_.width = screen.width;
+        view_.height = screen.height;
+    }
+
+    /**
+     * \brief Center the view on a position, without showing past the world edges.
+     * \param x            World column.
+     * \param y            World row.
+     * \param world_width  World width.
+     * \param world_height World height.
+     */
+    void Follow(int x, int y, int world_width, int world_height)
+    {
+        view_.x = Clamp(x - view_.width / 2, world_width - view_.width);
+        view_.y = Clamp(y - view_.height / 2, world_height - view_.height);
+    }
+
+    /**
+     * \brief World rectangle shown.
+     */
+    const Rect& View() const { return view_; }
+
+    /**
+     * \brief Screen rectangle the view is shown in.
+     */
+    const Rect& Screen() const { return screen_; }
+
+    /**
+     * \brief  Camera showing part of this camera's screen, the same world under it.
+     * \param  screen Rectangle of the screen, in window coordinates.
+     * \return Camera with the screen clipped to this one's.
+     */
+    Camera Crop(const Rect& screen) const
+    {
+        Camera camera;
+        camera.screen_ = screen.Intersection(screen_);
+        camera.view_ = { view_.x + camera.screen_.x - screen_.x,
+                         view_.y + camera.screen_.y - screen_.y, camera.screen_.width,
+                         camera.screen_.height };
+        return camera;
+    }
+
+    /**
+     * \brief Convert a world position to window coordinates.
+     */
+    int ToScreenX(int x) const { return x - view_.x + screen_.x; }
+    int ToScreenY(int y) const { return y - view_.y + screen_.y; }
+
+   private:
+    /* Keep a view start in [0, max], or 0 if the world is smaller than the view */
+    static int Clamp(int value, int max) { return std::max(0, std::min(value, max)); }
+
+    Rect screen_;  //!< Screen rectangle, in window coordinates
+    Rect view_;    //!< World rectangle shown
+};
+
+} /* namespace fighttrack */
@@ -0,0 +1,102 @@
+/**
+ * \file canvas.h
+ * \brief Canvas the frames are drawn on, common to all terminal output backends.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ncurses.h>
+
+#include "fighttrack/geometry.h"
+
+/**************************************************************************************/
+
+namespace fighttrack {
+
+/**
+ * Grid of character cells a frame is drawn on, then presented on the terminal.
+ *
+ * Cells are ncurses wide-character cells, as decoded by AsciiArt, passed along with
+ * their display width; a wide cell covers the column after it too. Drawing is cut
+ * off at the edges of the canvas.
+ *
+ * Subclasses implement the output with a particular backend.
+ */
+class Canvas {
+   public:
+    /**
+     * \brief Destroy the Canvas object.
+     */
+    virtual ~Canvas() = default;
+
+    /**
+     * \brief Get the size of the canvas, in columns and rows.
+     */
+    virtual int GetWidth() const = 0;
+    virtual int GetHeight() const = 0;
+
+    /**
+     * \brief Write a run of cells on a row.
+     * \param pos_x  Column of the first cell.
+     * \param pos_y  Row.
+     * \param cells  Cells.
+     * \param widths Display width of every cell, 1 or 2.
+     * \param count  Number of cells.
+     */
+    virtual void Put(int pos_x, int pos_y, const cchar_t* cells, const uint8_t* widths,
+                     size_t count) = 0;
+
+    /**
+     * \brief Fill a rectangle with spaces.
+     */
+    virtual void Clear(const Rect& area) = 0;
+
+    /**
+     * \brief Draw a line border on the edges of the canvas.
+     */
+    virtual void Border() = 0;
+
+    /**
+     * \brief Show the cells changed since the last call on the terminal.
+     */
+    virtual void Present() = 0;
+};
+
+/**
+ * Canvas on an ncurses window, where ncurses works out and sends the changes.
+ */
+class WindowCanvas : public Canvas {
+   public:
+    /**
+     * \brief Construct a new Window Canvas object.
+     * \param win Ncurses Window, not owned.
+     */
+    explicit WindowCanvas(WINDOW* win) : win_{ win } {}
+
+    int GetWidth() const override { return getmaxx(win_); }
+    int GetHeight() const override { return getmaxy(win_); }
+
+    void Put(int pos_x, int pos_y, const cchar_t* cells, const uint8_t* /*widths*/,
+             size_t count) override
+    {
+        mvwadd_wchnstr(win_, pos_y, pos_x, cells, count);
+    }
+
+    void Clear(const Rect& area) override
+    {
+        for (int y = area.y; y < area.Bottom(); ++y) {
+            mvwhline(win_, y, area.x, ' ', area.width);
+        }
+    }
+
+    void Border() override { box(win_, 0, 0); }
+
+    void Present() override { wrefresh(win_); }
+
+   private:
+    WINDOW* win_;  //!< Ncurses Window
+};
+
+} /* namespace fighttrack */
@@ -0,0 +1,85 @@
+/**
+ * \file collision_grid.h
+ * \brief Bit-packed occupancy grid of map cells.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**************************************************************************************/
+
+namespace fighttrack {
+
+/**
+ * One bit per cell telling whether it is solid, packed in 64-bit words per row.
+ *
+ * Box queries mask the words covering the box columns and OR them down the rows, two
+ * rows at a time with SSE2 when available. Cells outside the grid are not solid.
+ */
+class CollisionGrid {
+   public:
+    /**
+     * \brief Construct a new empty Collision Grid object.
+     */
+    CollisionGrid();
+
+    /**
+     * \brief Construct a Collision Grid object from text art.
+     * \param rows UTF-8 rows, one cell per character. Cells other than ' ' are solid.
+     */
+    explicit CollisionGrid(const std::vector<std::string>& rows);
+
+    /**
+     * \brief Resize the grid, with no solid cell.
+     * \param width  Number of columns.
+     * \param height Number of rows.
+     */
+    void Reset(int width, int height);
+
+    /**
+     * \brief Set whether a cell is solid. Cells outside the grid are ignored.
+     */
+    void Set(int x, int y, bool solid);
+
+    /**
+     * \brief  Check if a cell is solid.
+     * \param  x Column.
+     * \param  y Row.
+     */
+    bool IsSolid(int x, int y) const;
+
+    /**
+     * \brief  Check if any cell of a range of a row is solid.
+     * \param  x     First column.
+     * \param  y     Row.
+     * \param  width Number of columns.
+     */
+    bool AnySolid(int x, int y, int width) const;
+
+    /**
+     * \brief  Check if any cell of a box is solid, such as a sprite's footprint.
+     * \param  x      First column.
+     * \param  y      First row.
+     * \param  width  Number of columns.
+     * \param  height Number of rows.
+     */
+    bool AnySolid(int x, int y, int width, int height) const;
+
+    /**
+     * \brief Get the size of the grid.
+     */
+    int GetWidth() const { return width_; }
+    int GetHeight() const { return height_; }
+
+   private:
+    int width_;                   //!< Number of columns
+    int height_;                  //!< Number of rows
+    size_t stride_;               //!< Words per row
+    std::vector<uint64_t> bits_;  //!< Cells; bit x%64 of word y*stride_ + x/64
+};
+
+} /* namespace fighttrack */
@@ -0,0 +1,175 @@
+/**
+ * \file entity_store.h
+ * \brief Entity Store, the fighters of the game simulation.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <ncurses.h>
+
+#include "fighttrack/camera.h"
+#include "fighttrack/canvas.h"
+#include "fighttrack/map.h"
+#include "fighttrack/player_states.h"
+#include "fighttrack/slot_map.h"
+#include "fighttrack/spatial_hash.h"
+#include "fighttrack/sprite_registry.h"
+
+/**************************************************************************************/
+
+namespace fighttrack {
+
+class Player;
+
+/**
+ * Fighters stored as a structure of arrays.
+ *
+ * What every tick reads and writes (position, velocity, state, jump, health and
+ * sprite) is kept in one packed array per component, so the update runs as linear
+ * loops over contiguous data. Positions and velocities are fixed-point, see
+ * physics.h. What only matters for rendering and networking (name, owner) is kept
+ * apart in a SlotMap, which also gives the entity handles. Both sides are packed in
+ * the same order: erasing moves the last entity into the hole.
+ *
+ * Entities are addressed by handle, stable for their whole life, or by position in
+ * the packed arrays, valid until the next Create() or Destroy().
+ */
+class EntityStore {
+   public:
+    /**
+     * \brief Construct a new empty Entity Store object.
+     * \param capacity Maximum number of entities.
+     */
+    explicit EntityStore(size_t capacity = SlotHandle::kMaxIndex + 1);
+
+    /**
+     * \brief Remove all entities, and forget their handles.
+     * \param capacity Maximum number of entities.
+     */
+    void Reset(size_t capacity);
+
+    /**
+     * \brief Allocate memory for a number of entities.
+     */
+    void Reserve(size_t count);
+
+    /**
+     * \brief  Add an entity, standing with full health at position 0x0.
+     * \param  name  Entity name.
+     * \param  owner Client ID controlling the entity, -1 if none.
+     * \return Handle to the entity, SlotHandle::kInvalid if the store is full.
+     */
+    uint32_t Create(std::string name, int owner = -1);
+
+    /**
+     * \brief  Remove an entity.
+     * \param  handle Handle to the entity.
+     * \return true if removed, false if the handle is stale.
+     */
+    bool Destroy(uint32_t handle);
+
+    /**
+     * \brief  Get the position of an entity in the packed arrays.
+     * \param  handle Handle to the entity.
+     * \return Position, -1 if the handle is stale.
+     */
+    int Find(uint32_t handle) const { return cold_.Position(handle); }
+
+    /**
+     * \brief Handle to the entity at a position.
+     */
+    uint32_t HandleAt(size_t position) const { return cold_.HandleAt(position); }
+
+    /**
+     * \brief  Access the entity at a position.
+     * \param  position Position in the packed arrays.
+     * \return View of the entity, valid until the next Create() or Destroy().
+     */
+    Player Get(size_t position);
+
+    /**
+     * \brief Number of entities.
+     */
+    size_t Size() const { return pos_x_.size(); }
+    bool Empty() const { return pos_x_.empty(); }
+
+    /**
+     * \brief Advance all entities by one tick, moving them through the map.
+     * \param map  Map to collide with.
+     * \param area World area to move entities in, nullptr for the whole world. Entities
+     *             not entirely inside stay put, so the map is only queried around it,
+     *             e.g. in the chunks streamed in.
+     */
+    void Update(const Map& map, const Rect* area = nullptr);
+
+    /**
+     * \brief Rebuild a spatial hash of the entity sprites.
+     * \param hash Spatial hash, filled with entity positions as IDs.
+     */
+    void BuildSpatialHash(SpatialHash& hash) const;
+
+    /**
+     * \brief Visit the other entities whose sprite overlaps the sprite of an entity,
+     *        e.g. the candidates of a hit.
+     * \param hash     Spatial hash of the entities, up to date.
+     * \param position Position of the entity.
+     * \param fn       Called as fn(size_t position) for every entity in contact.
+     */
+    template<typename Fn>
+    void QueryContacts(const SpatialHash& hash, size_t position, Fn fn) const
+    {
+        hash.Query(GetBounds(position), [&](uint32_t other, const Rect&) {
+            if (other != position) {
+                fn(static_cast<size_t>(other));
+            }
+        });
+    }
+
+    /**
+     * \brief Draw the entities in view.
+     * \param canvas Canvas.
+     * \param camera Camera.
+     */
+    void Draw(Canvas& canvas, const Camera& camera);
+
+    /**
+     * \brief  Check if any entity has been modified since the last call.
+     */
+    bool TakeDirty();
+
+   private:
+    friend class Player;
+
+    /**
+     * \brief Box covered by the sprite of the entity at a position.
+     */
+    Rect GetBounds(size_t position) const;
+
+    /**
+     * Data not touched by the simulation
+     */
+    struct ColdData {
+        std::string name;  //!< Entity name
+        int owner;         //!< Client ID controlling the entity, -1 if none
+    };
+
+    /* Hot components; index: position */
+    std::vector<int32_t> pos_x_;      //!< Column, fixed-point
+    std::vector<int32_t> pos_y_;      //!< Row, fixed-point
+    std::vector<int32_t> vel_x_;      //!< Columns moved per tick, fixed-point
+    std::vector<int32_t> vel_y_;      //!< Rows moved per tick, fixed-point
+    std::vector<PlayerState> state_;  //!< Current state
+    std::vector<uint8_t> jump_;       //!< Jump asked, taken on the ground next tick
+    std::vector<uint8_t> on_ground_;  //!< Flag of standing on the ground
+    std::vector<int> health_;         //!< Life value (range 0~100)
+    std::vector<SpriteId> sprite_;    //!< Current graphics
+    std::vector<uint8_t> dirty_;      //!< Flag indicating modification
+
+    //! Cold data, and the handles of entities
+    SlotMap<ColdData> cold_;
+};
+
+} /* namespace fighttrack */
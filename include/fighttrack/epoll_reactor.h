@@ -0,0 +1,64 @@
+/**
+ * \file epoll_reactor.h
+ * \brief Server Socket event loop based on epoll.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "fighttrack/server_reactor.h"
+
+/**************************************************************************************/
+
+namespace fighttrack {
+
+/**
+ * Reactor waiting for socket readiness with epoll, then reading with recv() and
+ * writing with sendmsg(). Available on every Linux kernel.
+ */
+class EpollReactor : public ServerReactor {
+   public:
+    /**
+     * \brief Construct a new Epoll Reactor object.
+     * \param options Server socket options.
+     * \param index   Reactor index.
+     * \param count   Number of reactors.
+     */
+    EpollReactor(const Options& options, int index, int count);
+
+    /**
+     * \brief Destroy the Epoll Reactor object.
+     */
+    ~EpollReactor() override;
+
+   protected:
+    int Setup() override;
+    void Teardown() override;
+    void EventLoop() override;
+    void RemoveClient(int slot) override;
+    void FlushClientOutput(int slot) override;
+
+   private:
+    /**
+     * \brief Accept a connection from listener socket and add it to the client list.
+     * \return 0 on success, positive if failure, negative if fatal error.
+     */
+    int AddNewClient();
+
+    /**
+     * \brief  Handle client socket input. Try to read data and queue it.
+     * \param  client_sock  Client socket.
+     * \return 0 on success, positive if failure, negative if fatal error.
+     */
+    int HandleClientInput(int client_sock);
+
+    //! Event poll file descriptor
+    int epoll_fd_;
+    //! Table of client slots; index: client socket; element: client slot or -1.
+    std::vector<int> sock_to_slot_;
+    //! Pool buffer for the next read, kept when a read finds no data
+    char* rx_buffer_;
+};
+
+} /* namespace fighttrack */
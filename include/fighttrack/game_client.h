@@ -6,12 +6,23 @@
 #pragma once
 
 #include <vector>
+#include <unordered_map>
 #include <cstdint>
 #include <ncurses.h>
 
 #include "fighttrack/client_socket.h"
+#include "fighttrack/udp_socket.h"
+#include "fighttrack/stream_buffer.h"
+#include "fighttrack/protocol.h"
+#include "fighttrack/snapshot.h"
+#include "fighttrack/entity_store.h"
 #include "fighttrack/player.h"
 #include "fighttrack/map.h"
+#include "fighttrack/map_sync.h"
+#include "fighttrack/ansi_canvas.h"
+#include "fighttrack/camera.h"
+#include "fighttrack/canvas.h"
+#include "fighttrack/renderer.h"
 
 namespace fighttrack {
 
@@ -20,8 +31,9 @@ class GameClient {
     /**
      * \brief Construct a new Game Client object
      * \param player_name Main player name.
+     * \param use_udp     Receive snapshots over UDP instead of TCP.
      */
-    GameClient(std::string player_name);
+    GameClient(std::string player_name, bool use_udp = false);
 
     /**
      * \brief Destroy the Game Client object
@@ -44,9 +56,11 @@ class GameClient {
 
     /**
      * \brief Game loop.
+     * \param win    Ncurses Window, for input.
+     * \param canvas Canvas the frames are drawn on.
      * \return 0 on sucess, negative on error.
      */
-    int Loop(WINDOW* win);
+    int Loop(WINDOW* win, Canvas& canvas);
 
     /**
      * \brief Process input from user.
@@ -60,33 +74,97 @@ class GameClient {
     int ProcessNetworkInput();
 
     /**
-     * \brief Process data packets received from server.
-     * \param packet    Data packet / message.
+     * \brief Register with the server over UDP and process received datagrams.
      * \return 0 on sucess, negative on error.
      */
-    int ProcessPacket(const std::string& packet);
+    int ProcessDatagrams();
+
+    /**
+     * \brief Process a message received from server.
+     * \param frame Message frame.
+     * \return 0 on sucess, negative on error.
+     */
+    int ProcessPacket(const protocol::Frame& frame);
+
+    /**
+     * \brief Switch to the map announced by the server, from the cache if there.
+     * \param info MAP_INFO message.
+     */
+    void StartMap(const protocol::MapInfo& info);
+
+    /**
+     * \brief Request the next map chunks to download, and load the map once whole.
+     */
+    void ContinueMapDownload();
+
+    /**
+     * \brief  Load a map from the cache aside, and check it is the one announced.
+     * \param  info MAP_INFO message.
+     * \param  map  Output map.
+     * \return 0 on sucess, negative if missing or not matching.
+     */
+    int LoadCachedMap(const protocol::MapInfo& info, Map* map);
+
+    /**
+     * \brief Put a map in play, in place of the current one.
+     * \param map      Map, left with the previous one.
+     * \param map_hash Content hash of the map.
+     */
+    void PlayMap(Map& map, uint64_t map_hash);
 
     /**
      * \brief Update all objects.
      */
     void Update();
 
+    /**
+     * \brief World area of the map kept streamed in: the view, with a chunk of margin.
+     */
+    Rect StreamArea() const { return camera_.View().Grow(map_.GetFile().GetChunkSize()); }
+
     /**
      * \brief Render all objects.
+     * \param canvas Canvas.
      */
-    void Render(WINDOW* win);
+    void Render(Canvas& canvas);
 
    private:
     //! Game loop running flag
     bool running_;
     //! World map
     Map map_;
-    //! This Player
-    Player player_;
-    //! Remote players
-    std::vector<Player> remote_players_;
+    //! Content hash of the map loaded, 0 if none
+    uint64_t map_hash_;
+    //! On-disk cache of maps and chunks
+    MapCache map_cache_;
+    //! Map being downloaded from the server
+    MapDownload map_download_;
+    //! Part of the world shown, following this player
+    Camera camera_;
+    //! Draws the frames, redrawing only what changed
+    Renderer renderer_;
+    //! All players, this one included
+    EntityStore players_;
+    //! Handle of this player in players_
+    uint32_t player_;
+    //! Entity ID of this player, assigned by the server; -1 until then
+    int player_id_;
+    //! Remote players; key: entity ID; element: handle in players_
+    std::unordered_map<uint32_t, uint32_t> remote_players_;
     //! High-level client socket API
     ClientSocket client_sock_;
+    //! Reassembly buffer of incoming data
+    StreamBuffer rx_stream_;
+    //! Recent world snapshots received, baselines for delta decompression
+    SnapshotHistory snapshots_;
+    //! Flag indicating snapshots are requested over UDP
+    bool use_udp_;
+    //! Flag indicating the server started sending snapshots over UDP
+    bool udp_ready_;
+    //! Token to register over UDP with, received in WELCOME
+    uint32_t udp_token_;
+    //! Datagram socket for unreliable snapshots
+    UdpSocket udp_sock_;
 };
 
 } /* namespace fighttrack */
@@ -6,11 +6,18 @@
 #pragma once
 
 #include <vector>
-#include <map>
+#include <random>
 
 #include "fighttrack/server_socket.h"
+#include "fighttrack/udp_socket.h"
+#include "fighttrack/stream_buffer.h"
+#include "fighttrack/protocol.h"
+#include "fighttrack/snapshot.h"
+#include "fighttrack/slot_map.h"
+#include "fighttrack/entity_store.h"
 #include "fighttrack/player.h"
 #include "fighttrack/map.h"
+#include "fighttrack/spatial_hash.h"
 
 namespace fighttrack {
 
@@ -27,10 +34,14 @@ class GameServer {
 
     /**
      * \brief Run the game loop.
-     * \param port  Server port.
+     * \param port         Server port.
+     * \param max_clients  Maximum number of connected players.
+     * \param num_reactors Number of network threads, 0 for one per CPU core.
+     * \param backend      Socket I/O backend of the network threads.
      * \return 0 on sucess, negative on error.
      */
-    int Run(uint16_t port);
+    int Run(uint16_t port, size_t max_clients, size_t num_reactors = 1,
+            ServerSocket::Backend backend = ServerSocket::Backend::EPOLL);
 
    private:
     /**
@@ -39,6 +50,23 @@ class GameServer {
      */
     int Loop();
 
+    /**
+     * \brief  Load the map, from $FIGHTTRACK_MAP or else the built-in one.
+     * \return 0 on sucess, negative if error.
+     */
+    int LoadMap();
+
+    /**
+     * \brief Load the map again if asked to with SIGHUP, and announce it.
+     */
+    void ReloadMap();
+
+    /**
+     * \brief Place a player at its spawn point, at the top of the map.
+     * \param entity Entity ID of the player.
+     */
+    void Spawn(uint32_t entity);
+
     /**
      * \brief Update all objects.
      */
@@ -51,12 +79,17 @@ class GameServer {
     int ProcessNetworkInput();
 
     /**
-     * \brief Process data packets received from client players.
+     * \brief Process datagrams received in the UDP socket.
+     */
+    void ProcessDatagrams();
+
+    /**
+     * \brief Process a message received from a client player.
      * \param client_id Client ID.
-     * \param packet    Data packet / message.
+     * \param frame     Message frame.
      * \return 0 on sucess, negative on error.
      */
-    int ProcessPacket(int client_id, const std::string& packet);
+    int ProcessPacket(int client_id, const protocol::Frame& frame);
 
     /**
      * \brief  Transmit updates to client players.
@@ -64,15 +97,82 @@ class GameServer {
      */
     int TransmitUpdates();
 
+    /**
+     * \brief Store a new world snapshot if anything changed since the last one.
+     */
+    void TakeSnapshot();
+
+    /**
+     * \brief Encode the map chunks a client asked for.
+     * \param out Output buffer.
+     * \param msg MAP_CHUNK_REQUEST message.
+     */
+    void EncodeMapChunks(std::string& out, const protocol::MapChunkRequest& msg);
+
+    /**
+     * \brief Send a message to all connected players.
+     * \param message Encoded message.
+     */
+    void Broadcast(std::string message);
+
    private:
+    /**
+     * Per-client network state
+     */
+    struct ClientState {
+        int client_id = -1;           //!< Client ID, -1 if not connected
+        uint32_t entity;              //!< Entity ID of the client's player
+        StreamBuffer rx_stream;       //!< Reassembly buffer of incoming data
+        uint32_t last_acked;          //!< Last snapshot acknowledged, 0 if none
+        uint32_t last_sent;           //!< Last snapshot sent, 0 if none
+        uint32_t udp_token;           //!< Token the client registers over UDP with
+        bool udp;                     //!< Flag indicating snapshots go over UDP
+        struct sockaddr_in udp_addr;  //!< Client UDP address, set if udp
+    };
+
+    /**
+     * \brief  Look up a connected client.
+     * \param  client_id Client ID.
+     * \return Client state, nullptr if the client is gone.
+     */
+    ClientState* FindClient(int client_id);
+
+    /**
+     * Snapshot delta shared by the clients acknowledging the same baseline
+     */
+    struct Delta {
+        uint32_t baseline;                //!< Baseline sequence, 0 for a keyframe
+        ServerSocket::Buffer buffer;      //!< Encoded snapshot
+        std::vector<int> tcp_client_ids;  //!< Recipients over TCP
+        std::vector<int> udp_client_ids;  //!< Recipients over UDP
+    };
+
     //! Game loop running flag
     bool running_;
+    //! Connected players; handle: entity ID, owner: client ID
+    EntityStore players_;
+    //! Broadphase of player contacts; ID: position in players_
+    SpatialHash spatial_hash_;
     //! World map
     Map map_;
-    //! Map of connected players; key: client ID; element: Player object
-    std::map<int, Player> players_;
+    //! Content hash of the map
+    uint64_t map_hash_;
+    //! Content hash of every map chunk, 0 for empty chunks; index: chunk index
+    std::vector<uint64_t> chunk_hashes_;
     //! High-level server socket API
     ServerSocket server_sock_;
+    //! Datagram socket for unreliable snapshots
+    UdpSocket udp_sock_;
+    //! Generator of client UDP tokens
+    std::mt19937 token_rng_;
+    //! Network state of clients; index: client ID slot index
+    std::vector<ClientState> clients_;
+    //! Recent world snapshots, baselines for delta compression
+    SnapshotHistory snapshots_;
+    //! Flag indicating players joined or left since the last snapshot
+    bool world_dirty_;
+    //! Deltas encoded in the current tick, reused across ticks
+    std::vector<Delta> deltas_;
 };
 
 } /* namespace fighttrack */
\ No newline at end of file
@@ -0,0 +1,98 @@
+/**
+ * \file geometry.h
+ * \brief Geometry helpers on terminal cells.
+ */
+
+#pragma once
+
+#include <algorithm>
+
+/**************************************************************************************/
+
+namespace fighttrack {
+
+/**
+ * Axis-aligned rectangle of cells, [x, x + width) by [y, y + height).
+ */
+struct Rect {
+    int x;       //!< First column
+    int y;       //!< First row
+    int width;   //!< Number of columns
+    int height;  //!< Number of rows
+
+    /**
+     * \brief Column and row right after the rectangle.
+     */
+    int Right() const { return x + width; }
+    int Bottom() const { return y + height; }
+
+    /**
+     * \brief Check if the rectangle has no cell.
+     */
+    bool Empty() const { return width <= 0 || height <= 0; }
+
+    /**
+     * \brief Check if a cell is inside the rectangle.
+     */
+    bool Contains(int px, int py) const
+    {
+        return px >= x && px < Right() && py >= y && py < Bottom();
+    }
+
+    /**
+     * \brief Check if every cell of another rectangle is inside the rectangle.
+     */
+    bool Contains(const Rect& other) const
+    {
+        return other.x >= x && other.Right() <= Right() && other.y >= y &&
+               other.Bottom() <= Bottom();
+    }
+
+    /**
+     * \brief Check if two rectangles share a cell.
+     */
+    bool Intersects(const Rect& other) const
+    {
+        return x < other.Right() && other.x < Right() && y < other.Bottom() &&
+               other.y < Bottom() && !Empty() && !other.Empty();
+    }
+
+    /**
+     * \brief Cells shared by two rectangles, empty if none.
+     */
+    Rect Intersection(const Rect& other) const
+    {
+        const int left = std::max(x, other.x);
+        const int top = std::max(y, other.y);
+        return { left, top, std::max(0, std::min(Right(), other.Right()) - left),
+                 std::max(0, std::min(Bottom(), other.Bottom()) - top) };
+    }
+
+    /**
+     * \brief Smallest rectangle holding both.
+     */
+    Rect Union(const Rect& other) const
+    {
+        const int left = std::min(x, other.x);
+        const int top = std::min(y, other.y);
+        return { left, top, std::max(Right(), other.Right()) - left,
+                 std::max(Bottom(), other.Bottom()) - top };
+    }
+
+    /**
+     * \brief Rectangle grown by a margin on every side.
+     */
+    Rect Grow(int margin) const
+    {
+        return { x - margin, y - margin, width + 2 * margin, height + 2 * margin };
+    }
+
+    bool operator==(const Rect& other) const
+    {
+        return x == other.x && y == other.y && width == other.width &&
+               height == other.height;
+    }
+    bool operator!=(const Rect& other) const { return !(*this == other); }
+};
+
+} /* namespace fighttrack */
@@ -5,40 +5,140 @@
 
 #pragma once
 
+#include <memory>
+#include <string>
+#include <vector>
+#include <ncurses.h>
+
 #include "fighttrack/ascii_art.h"
+#include "fighttrack/camera.h"
+#include "fighttrack/canvas.h"
+#include "fighttrack/collision_grid.h"
+#include "fighttrack/map_file.h"
 
 /**************************************************************************************/
 
 namespace fighttrack {
 
+/**
+ * World map, loaded from a map file.
+ *
+ * The map is divided in square chunks. A chunk is decoded into graphics and a
+ * collision grid the first time it is drawn or queried, so a large world only costs
+ * memory for the chunks in use. A client moving around calls Stream() so chunks are
+ * decoded before they come into view, and freed once left behind.
+ */
 class Map {
    public:
     /**
-     * \brief Construct a new Map object
-     * \param art Map graphics.
+     * \brief Construct a new empty Map object
      */
-    Map(AsciiArt art);
+    Map();
 
     /**
      * \brief Destroy the Map object
      */
     ~Map() = default;
 
+    /**
+     * \brief  Load a map file, memory-mapped.
+     * \param  path Map file path, see the compile-map command.
+     * \return 0 on sucess, negative if error.
+     */
+    int Load(const std::string& path);
+
+    /**
+     * \brief  Load a map file image held in memory.
+     * \param  image Map file contents.
+     * \return 0 on sucess, negative if error.
+     */
+    int LoadImage(std::string image);
+
+    /**
+     * \brief  Load the built-in map.
+     * \return 0 on sucess, negative if error.
+     */
+    int LoadDefault();
+
+    /**
+     * \brief Exchange the map with another one, e.g. loaded and checked aside.
+     */
+    void Swap(Map& other);
+
+    /**
+     * \brief Draw the part of the map in view.
+     * \param canvas Canvas.
+     * \param camera Camera.
+     */
+    void Draw(Canvas& canvas, const Camera& camera);
+
+    /**
+     * \brief Decode the chunks of an area, and free the ones far from it.
+     * \param area World area about to be shown, usually the view with a margin.
+     */
+    void Stream(const Rect& area);
 
     /**
-     * \brief Draw the Map object.
+     * \brief Number of chunks decoded.
      */
-    void Draw(WINDOW* win);
+    size_t DecodedChunks() const { return decoded_.size(); }
 
     /**
      * \brief  Check if a given position a ground.
-     * \param x  X postion.
-     * \param y  Y position.
+     * \param x  X postion, relative to the map.
+     * \param y  Y position, relative to the map.
+     */
+    bool IsGround(int x, int y) const;
+
+    /**
+     * \brief  Check if there is ground anywhere in a box, such as a sprite's footprint.
+     * \param x      X postion, relative to the map.
+     * \param y      Y position, relative to the map.
+     * \param width  Box width.
+     * \param height Box height.
+     */
+    bool IsGround(int x, int y, int width, int height) const;
+
+    /**
+     * \brief Get the map size.
+     */
+    int GetWidth() const { return file_.GetWidth(); }
+    int GetHeight() const { return file_.GetHeight(); }
+
+    /**
+     * \brief Get the map file loaded.
      */
-    bool IsGround(int x, int y);
+    const MapFile& GetFile() const { return file_; }
 
    private:
-    AsciiArt art_;  //!< Map graphics
+    /**
+     * Decoded chunk
+     */
+    struct Chunk {
+        AsciiArt art;        //!< Graphics
+        CollisionGrid grid;  //!< Ground cells
+    };
+
+    /**
+     * \brief  Get the chunks an area overlaps.
+     * \param  area World area.
+     * \return Rectangle of chunk columns and rows, clipped to the map.
+     */
+    Rect ChunksIn(const Rect& area) const;
+
+    /**
+     * \brief  Get a chunk, decoding it on first use.
+     * \param  cx Chunk column.
+     * \param  cy Chunk row.
+     * \return Chunk, nullptr if empty or out of the map.
+     */
+    const Chunk* GetChunk(int cx, int cy) const;
+
+    MapFile file_;  //!< Map file
+    //! Chunks decoded so far; index: cy * chunks per row + cx
+    mutable std::vector<std::unique_ptr<Chunk>> chunks_;
+    //! Indices of the chunks decoded
+    mutable std::vector<size_t> decoded_;
 };
 
 } /* namespace fighttrack */
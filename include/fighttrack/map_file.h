@@ -0,0 +1,192 @@
+/**
+ * \file map_file.h
+ * \brief Binary tiled map format, compiled from text and memory-mapped.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**************************************************************************************/
+
+namespace fighttrack {
+
+/*
+ * Map file layout, little-endian:
+ *
+ *   MapFileHeader
+ *   MapFileTile[num_tiles]         palette, tile 0 is the empty tile
+ *   uint64_t[chunks_x * chunks_y]  file offset of every chunk, row-major; 0 if empty
+ *   chunks                         chunk_size * chunk_size tile IDs each, row-major
+ *
+ * Chunks are only read when touched, so memory grows with the part of the world used.
+ */
+
+//! Magic bytes starting a map file
+constexpr char kMapFileMagic[4] = { 'F', 'T', 'M', 'P' };
+//! Version of the map file layout
+constexpr uint16_t kMapFileVersion = 1;
+//! Chunk side, in cells, used by CompileMap() by default
+constexpr int kMapDefaultChunkSize = 32;
+//! Tile flag: the tile is ground
+constexpr uint8_t kMapTileSolid = 0x01;
+
+/**
+ * Map file header
+ */
+struct MapFileHeader {
+    char magic[4];        //!< kMapFileMagic
+    uint16_t version;     //!< kMapFileVersion
+    uint16_t chunk_size;  //!< Chunk side, in cells
+    uint32_t width;       //!< Number of columns
+    uint32_t height;      //!< Number of rows
+    uint32_t num_tiles;   //!< Number of palette entries (range 1~256)
+    uint32_t reserved;    //!< Zero
+};
+
+/**
+ * Map file palette entry
+ */
+struct MapFileTile {
+    char glyph[4];        //!< UTF-8 character, zero padded
+    uint8_t flags;        //!< kMapTile* flags
+    uint8_t reserved[3];  //!< Zero
+};
+
+static_assert(sizeof(MapFileHeader) == 24, "Map file header layout changed");
+static_assert(sizeof(MapFileTile) == 8, "Map file tile layout changed");
+
+/**
+ * Read-only view of a map file, memory-mapped or held in memory.
+ */
+class MapFile {
+   public:
+    /**
+     * \brief Construct a new closed Map File object.
+     */
+    MapFile();
+
+    /**
+     * \brief Destroy the Map File object, unmapping the file.
+     */
+    ~MapFile();
+
+    MapFile(const MapFile&) = delete;
+    MapFile& operator=(const MapFile&) = delete;
+
+    /**
+     * \brief  Memory-map and validate a map file.
+     * \param  path File path.
+     * \return 0 on sucess, negative if error.
+     */
+    int Open(const std::string& path);
+
+    /**
+     * \brief  Validate and hold a map file image.
+     * \param  image Map file contents, see CompileMap().
+     * \return 0 on sucess, negative if error.
+     */
+    int OpenImage(std::string image);
+
+    /**
+     * \brief Release the map file.
+     */
+    void Close();
+
+    /**
+     * \brief Exchange the map file with another one.
+     */
+    void Swap(MapFile& other);
+
+    /**
+     * \brief Get the map size, in cells.
+     */
+    int GetWidth() const { return header_ ? (int) header_->width : 0; }
+    int GetHeight() const { return header_ ? (int) header_->height : 0; }
+
+    /**
+     * \brief Get the chunk side, and the number of chunks per row and per column.
+     */
+    int GetChunkSize() const { return header_ ? header_->chunk_size : 0; }
+    int GetChunksX() const { return chunks_x_; }
+    int GetChunksY() const { return chunks_y_; }
+
+    /**
+     * \brief Get the number of palette entries.
+     */
+    int GetNumTiles() const { return header_ ? (int) header_->num_tiles : 0; }
+
+    /**
+     * \brief  Get a palette entry.
+     * \param  id Tile ID.
+     * \return Tile, the empty tile if the ID is out of the palette.
+     */
+    const MapFileTile& GetTile(uint8_t id) const
+    {
+        return tiles_[id < header_->num_tiles ? id : 0];
+    }
+
+    /**
+     * \brief  Get the tile IDs of a chunk.
+     * \param  cx Chunk column.
+     * \param  cy Chunk row.
+     * \return chunk_size * chunk_size tile IDs, row-major; nullptr if the chunk is
+     *         empty or out of the map.
+     */
+    const uint8_t* GetChunk(int cx, int cy) const;
+
+   private:
+    /**
+     * \brief  Validate the layout of data_ and set up the pointers into it.
+     * \return 0 on sucess, negative if error.
+     */
+    int Parse();
+
+    const char* data_;             //!< Map file contents
+    size_t size_;                  //!< Size of the contents
+    bool mapped_;                  //!< Flag indicating data_ is a mapping to unmap
+    std::string image_;            //!< Contents held in memory, if not mapped
+    const MapFileHeader* header_;  //!< Header in data_, nullptr if closed
+    const MapFileTile* tiles_;     //!< Palette in data_
+    const uint64_t* offsets_;      //!< Chunk offsets in data_
+    int chunks_x_, chunks_y_;      //!< Number of chunks per row and per column
+};
+
+/**
+ * \brief Lay out a map file image.
+ * \param width      Number of columns.
+ * \param height     Number of rows.
+ * \param chunk_size Chunk side, in cells.
+ * \param tiles      Palette, tile 0 must be the empty tile (range 1~256 entries).
+ * \param chunks     Tile IDs of every chunk, row-major, chunk_size * chunk_size each;
+ *                   an empty string for empty chunks.
+ * \param image      Output map file contents.
+ */
+void WriteMapImage(int width, int height, int chunk_size,
+                   const std::vector<MapFileTile>& tiles,
+                   const std::vector<std::string>& chunks, std::string* image);
+
+/**
+ * \brief  Compile text art into a map file image.
+ * \param  rows       UTF-8 rows, one cell per character. Cells other than ' ' are ground.
+ * \param  image      Output map file contents.
+ * \param  chunk_size Chunk side, in cells (range 1~4096).
+ * \return 0 on sucess, negative if error.
+ */
+int CompileMap(const std::vector<std::string>& rows, std::string* image,
+               int chunk_size = kMapDefaultChunkSize);
+
+/**
+ * \brief  Compile a text map file into a map file.
+ * \param  input      Path of the text file, UTF-8 art, one row per line.
+ * \param  output     Path of the map file to write.
+ * \param  chunk_size Chunk side, in cells (range 1~4096).
+ * \return 0 on sucess, negative if error.
+ */
+int CompileMapFile(const std::string& input, const std::string& output,
+                   int chunk_size = kMapDefaultChunkSize);
+
+} /* namespace fighttrack */
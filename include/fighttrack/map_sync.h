@@ -0,0 +1,256 @@
+/**
+ * \file map_sync.h
+ * \brief Map transfer from the server, with content-hash caching on the client.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "fighttrack/map_file.h"
+#include "fighttrack/protocol.h"
+
+/**************************************************************************************/
+
+namespace fighttrack {
+
+/*
+ * A map is named by a content hash, mixed from its size and the hash of every chunk.
+ * Chunk hashes cover the glyph and flags of each cell, not the tile IDs, so the same
+ * chunk hashes the same in any map file. That lets a client reuse chunks it cached
+ * from an earlier version of a map.
+ *
+ * Encoded chunk, as sent and cached:
+ *
+ *   | num_tiles (u16) | MapFileTile[num_tiles] | runs ... |
+ *
+ * The palette only holds the tiles the chunk uses. Each run is (length - 1 (u8),
+ * tile (u8)), and the runs cover the chunk row-major.
+ */
+
+//! Largest chunk side a map can be sent with, so any chunk fits in a frame
+constexpr int kMapSyncMaxChunkSize = 128;
+
+/**
+ * Decoded chunk
+ */
+struct MapChunkData {
+    std::vector<MapFileTile> tiles;  //!< Palette
+    std::string cells;               //!< Tile IDs, chunk_size * chunk_size, row-major
+};
+
+/**
+ * \brief  Hash the contents of a chunk.
+ * \param  chunk Chunk.
+ * \return Content hash, never 0.
+ */
+uint64_t HashMapChunk(const MapChunkData& chunk);
+
+/**
+ * \brief  Hash the contents of a map.
+ * \param  file         Map file.
+ * \param  chunk_hashes Output hash of every chunk, row-major; 0 for empty chunks.
+ * \return Content hash of the map.
+ */
+uint64_t HashMap(const MapFile& file, std::vector<uint64_t>* chunk_hashes);
+
+/**
+ * \brief  Encode a chunk of a map file to send.
+ * \param  file  Map file.
+ * \param  index Chunk index, row-major.
+ * \param  out   Output encoded chunk.
+ * \return 0 on sucess, negative if the chunk is empty or too large to send.
+ */
+int EncodeMapChunk(const MapFile& file, uint32_t index, std::string* out);
+
+/**
+ * \brief  Decode a chunk.
+ * \param  data       Encoded chunk.
+ * \param  size       Size of the encoded chunk.
+ * \param  chunk_size Chunk side, in cells.
+ * \param  chunk      Output chunk.
+ * \return 0 on sucess, negative if malformed.
+ */
+int DecodeMapChunk(const char* data, size_t size, int chunk_size, MapChunkData* chunk);
+
+/**
+ * On-disk cache of maps and chunks, named by content hash.
+ *
+ *   <directory>/maps/<map hash>.ftmap  complete map files
+ *   <directory>/chunks/<chunk hash>    encoded chunks
+ *
+ * Every operation fails quietly when the cache is not open, so the game plays on
+ * without one.
+ */
+class MapCache {
+   public:
+    /**
+     * \brief Construct a new closed Map Cache object.
+     */
+    MapCache() : directory_{} {}
+
+    /**
+     * \brief  Get the default cache directory: $FIGHTTRACK_CACHE, else
+     *         $XDG_CACHE_HOME/fighttrack, else $HOME/.cache/fighttrack.
+     * \return Directory path, empty if none applies.
+     */
+    static std::string DefaultDirectory();
+
+    /**
+     * \brief  Open a cache directory, creating it if needed.
+     * \param  directory Cache directory.
+     * \return 0 on sucess, negative if error.
+     */
+    int Open(const std::string& directory);
+
+    /**
+     * \brief Check if the cache is open.
+     */
+    bool IsOpen() const { return !directory_.empty(); }
+
+    /**
+     * \brief Get the path of a cached map file.
+     */
+    std::string MapPath(uint64_t map_hash) const;
+
+    /**
+     * \brief Check if a map is cached.
+     */
+    bool HasMap(uint64_t map_hash) const;
+
+    /**
+     * \brief  Cache a map file.
+     * \param  map_hash Content hash of the map.
+     * \param  image    Map file contents.
+     * \return 0 on sucess, negative if error.
+     */
+    int StoreMap(uint64_t map_hash, const std::string& image);
+
+    /**
+     * \brief  Read a cached chunk.
+     * \param  chunk_hash Content hash of the chunk.
+     * \param  data       Output encoded chunk.
+     * \return 0 on sucess, negative if not cached.
+     */
+    int LoadChunk(uint64_t chunk_hash, std::string* data) const;
+
+    /**
+     * \brief  Cache a chunk.
+     * \param  chunk_hash Content hash of the chunk.
+     * \param  data       Encoded chunk.
+     * \return 0 on sucess, negative if error.
+     */
+    int StoreChunk(uint64_t chunk_hash, const std::string& data);
+
+   private:
+    std::string directory_;  //!< Cache directory, empty if closed
+};
+
+/**
+ * Download of a map from the server.
+ *
+ * Started by MAP_INFO. Once the index arrives, chunks found in the cache are taken
+ * from it, and the rest are requested a window at a time, so the replies never
+ * overflow the server's transmit backlog. The window starts sized for chunks of the
+ * worst size, and grows to fit the size of the chunks actually received.
+ */
+class MapDownload {
+   public:
+    /**
+     * \brief Construct a new idle Map Download object.
+     */
+    MapDownload();
+
+    /**
+     * \brief  Start downloading a map, dropping any download in progress.
+     * \param  info Map announced by the server.
+     * \return 0 on sucess, negative if the map can't be downloaded.
+     */
+    int Start(const protocol::MapInfo& info);
+
+    /**
+     * \brief Drop the download.
+     */
+    void Stop();
+
+    /**
+     * \brief Check if a map is being downloaded.
+     */
+    bool Active() const { return info_.map_hash != 0; }
+
+    /**
+     * \brief Get the map being downloaded.
+     */
+    const protocol::MapInfo& GetInfo() const { return info_; }
+
+    /**
+     * \brief  Add a range of the index, taking the chunks already cached.
+     * \param  msg   MAP_INDEX message.
+     * \param  cache Chunk cache.
+     * \return 0 on sucess, negative if the message is not part of the download.
+     */
+    int AddIndex(const protocol::MapIndex& msg, const MapCache& cache);
+
+    /**
+     * \brief Number of index entries received, the first one to ask for next.
+     */
+    uint32_t GetIndexReceived() const { return (uint32_t) index_received_; }
+
+    /**
+     * \brief Check if the whole index is here.
+     */
+    bool IndexComplete() const { return Active() && index_received_ == hashes_.size(); }
+
+    /**
+     * \brief  Add a chunk, and cache it.
+     * \param  msg   MAP_CHUNK message.
+     * \param  cache Chunk cache.
+     * \return 0 on sucess, negative if the chunk is not part of the download or
+     *         does not match its hash.
+     */
+    int AddChunk(const protocol::MapChunk& msg, MapCache& cache);
+
+    /**
+     * \brief  Pick the next chunks to request, keeping within the window.
+     * \param  indices Output chunk indices.
+     * \param  max     Capacity of indices.
+     * \return Number of chunks picked, 0 if none is to be requested now.
+     */
+    size_t NextRequests(uint32_t* indices, size_t max);
+
+    /**
+     * \brief Check if every chunk is here.
+     */
+    bool Complete() const;
+
+    /**
+     * \brief  Lay out the downloaded map as a map file.
+     * \param  image Output map file contents.
+     * \return 0 on sucess, negative if error.
+     */
+    int BuildImage(std::string* image) const;
+
+    /**
+     * \brief Number of chunks taken from the cache, and downloaded.
+     */
+    size_t GetCachedChunks() const { return cached_; }
+    size_t GetDownloadedChunks() const { return downloaded_; }
+
+   private:
+    protocol::MapInfo info_;           //!< Map being downloaded, hash 0 if none
+    std::vector<uint64_t> hashes_;     //!< Chunk hashes, 0 for empty chunks
+    std::vector<std::string> chunks_;  //!< Encoded chunks here so far
+    std::vector<uint32_t> missing_;    //!< Chunks to request, in index order
+    size_t index_received_;            //!< Number of index entries received
+    size_t next_request_;              //!< Position in missing_ to request next
+    size_t in_flight_;                 //!< Chunks requested and not received yet
+    size_t pending_;                   //!< Non-empty chunks not here yet
+    size_t cached_;                    //!< Chunks taken from the cache
+    size_t downloaded_;                //!< Chunks received from the server
+    size_t downloaded_bytes_;          //!< Size of the chunks received
+};
+
+} /* namespace fighttrack */
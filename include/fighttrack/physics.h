@@ -0,0 +1,82 @@
+/**
+ * \file physics.h
+ * \brief Deterministic fixed-point physics of boxes against the map.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "fighttrack/geometry.h"
+#include "fighttrack/map.h"
+
+/**************************************************************************************/
+
+namespace fighttrack {
+
+/*
+ * Positions and velocities are fixed-point, with kSubcellBits bits of fraction of a
+ * cell, and stepped with integer math only: the client and the server advance the
+ * same state to bit-identical results.
+ *
+ * A body collides as the box of cells it is drawn on, the cells of its position
+ * rounded down. The world is the map ground, walled on the left, right and bottom
+ * edges of the map; the sky above the map is open.
+ */
+
+//! Fraction bits of positions and velocities
+constexpr int kSubcellBits = 8;
+//! One cell, in fixed-point
+constexpr int32_t kSubcells = 1 << kSubcellBits;
+//! Speed gained falling, per tick
+constexpr int32_t kGravity = kSubcells / 8;
+//! Highest falling speed, per tick
+constexpr int32_t kMaxFallSpeed = kSubcells;
+
+/**
+ * \brief Convert a fixed-point coordinate to the cell it is in, rounding down.
+ */
+inline int ToCell(int32_t value)
+{
+    if (value >= 0) {
+        return value >> kSubcellBits;
+    }
+    return -((kSubcells - 1 - value) >> kSubcellBits);
+}
+
+/**
+ * \brief Convert a cell coordinate to fixed-point.
+ */
+inline int32_t ToSubcells(int cell)
+{
+    return cell * kSubcells;
+}
+
+/**
+ * \brief  Check if a box hits the map ground or its walls.
+ * \param  map Map.
+ * \param  box Box of cells.
+ */
+bool IsSolid(const Map& map, const Rect& box);
+
+/**
+ * \brief  Move a body along X, stopping before the first solid column in the way.
+ * \param  map   Map.
+ * \param  box   Cells of the body, box.x being the cell of pos_x.
+ * \param  pos_x Fixed-point position, updated.
+ * \param  vel_x Fixed-point distance to move.
+ * \return true if the body was stopped.
+ */
+bool MoveX(const Map& map, Rect box, int32_t* pos_x, int32_t vel_x);
+
+/**
+ * \brief  Move a body along Y, stopping before the first solid row in the way.
+ * \param  map   Map.
+ * \param  box   Cells of the body, box.y being the cell of pos_y.
+ * \param  pos_y Fixed-point position, updated.
+ * \param  vel_y Fixed-point distance to move.
+ * \return true if the body was stopped.
+ */
+bool MoveY(const Map& map, Rect box, int32_t* pos_y, int32_t vel_y);
+
+} /* namespace fighttrack */
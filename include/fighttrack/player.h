@@ -9,31 +9,29 @@
 #include <ncurses.h>
 #include <gsl/gsl>
 
-#include "fighttrack/ascii_art.h"
+#include "fighttrack/camera.h"
+#include "fighttrack/canvas.h"
+#include "fighttrack/entity_store.h"
+#include "fighttrack/sprite_registry.h"
 
 /**************************************************************************************/
 
 namespace fighttrack {
 
-class PlayerState;
-
+/**
+ * View of a fighter of an Entity Store.
+ *
+ * Cheap to copy, it only refers to the entity's position in the store, so it must not
+ * be kept across the creation or destruction of entities.
+ */
 class Player {
    public:
     /**
      * \brief Construct a new Player object.
+     * \param store    Entity store.
+     * \param position Position of the entity in the store.
      */
-    Player() : Player("") {}
-
-    /**
-     * \brief Construct a new Player object.
-     * \param name Player's name.
-     */
-    Player(std::string name);
-
-    /**
-     * \brief Destroy the Player object.
-     */
-    ~Player();
+    Player(EntityStore& store, size_t position) : store_{ &store }, pos_{ position } {}
 
     /**
      * \brief Set player's name.
@@ -41,14 +39,19 @@ class Player {
      */
     Player& SetName(std::string name)
     {
-        name_ = name;
+        Cold().name = std::move(name);
         return *this;
     }
 
     /**
      * \brief Get player's name.
      */
-    const std::string& GetName() const { return name_; }
+    const std::string& GetName() const { return Cold().name; }
+
+    /**
+     * \brief Get the client ID controlling the player, -1 if none.
+     */
+    int GetOwner() const { return Cold().owner; }
 
     /**
      * \brief  Process input from user.
@@ -57,15 +60,21 @@ class Player {
     void HandleInput(int input);
 
     /**
-     * \brief Update the Player object.
-     * \return 0 if player is alive, -1 if player died.
+     * \brief Draw the Player object, if in view.
+     * \param canvas Canvas.
+     * \param camera Camera.
+     */
+    void Draw(Canvas& canvas, const Camera& camera);
+
+    /**
+     * \brief Get the box covered by the sprite.
      */
-    int Update();
+    Rect GetBounds() const;
 
     /**
-     * \brief Draw the Player object.
+     * \brief Get the box covered when drawn, name included.
      */
-    void Draw(WINDOW* win);
+    Rect GetDrawBounds() const;
 
     /**
      * \brief Damage the player
@@ -75,38 +84,50 @@ class Player {
 
     /**
      * \brief Set the Player Graphics.
-     * \param art ASCII Art.
+     * \param sprite Sprite ID.
      */
-    Player& SetGraphics(AsciiArt art)
+    Player& SetSprite(SpriteId sprite)
     {
-        art_ = art;
+        store_->sprite_[pos_] = sprite;
         return *this;
     }
 
+    /**
+     * \brief Get the Player Graphics.
+     */
+    SpriteId GetSprite() const { return store_->sprite_[pos_]; }
+
     /**
      * \brief Get player position.
      * \return Position.
      */
-    int GetPosX() const { return pos_x_; }
-    int GetPosY() const { return pos_y_; }
+    int GetPosX() const { return ToCell(store_->pos_x_[pos_]); }
+    int GetPosY() const { return ToCell(store_->pos_y_[pos_]); }
 
     /**
-     * \brief Set player position.
+     * \brief Set player position, keeping the fraction of a cell if it stays in it.
      * \param pos Position.
      */
     Player& SetPosX(int pos_x)
     {
-        pos_x_ = pos_x;
-        dirty_ = true;
+        if (pos_x != GetPosX())
+            store_->pos_x_[pos_] = ToSubcells(pos_x);
+        store_->dirty_[pos_] = true;
         return *this;
     }
     Player& SetPosY(int pos_y)
     {
-        pos_y_ = pos_y;
-        dirty_ = true;
+        if (pos_y != GetPosY())
+            store_->pos_y_[pos_] = ToSubcells(pos_y);
+        store_->dirty_[pos_] = true;
         return *this;
     }
 
+    /**
+     * \brief Get player state.
+     */
+    PlayerState GetState() const { return store_->state_[pos_]; }
+
     /**
      * \brief Start jump animation
      */
@@ -117,24 +138,11 @@ class Player {
      */
     bool IsJumping() const;
 
-    /**
-     * \brief  Check if player is has been modified
-     */
-    bool Dirty()
-    {
-        auto ret = dirty_;
-        dirty_ = false;
-        return ret;
-    }
-
    private:
-    std::string name_;    //!< Player name
-    PlayerState* state_;  //!< Player's current state
-    int heart_;           //!< Player's current life value (range 0~100)
-    AsciiArt art_;        //!< Player's current graphics
-    int pos_x_, pos_y_;   //!< Player's current position
-    int jump_ticks_ = 0;  //!< Current number of ticks jumping
-    bool dirty_;          //!< Flag indicating modification
+    EntityStore::ColdData& Cold() const { return store_->cold_.begin()[pos_]; }
+
+    EntityStore* store_;  //!< Store holding the player
+    size_t pos_;          //!< Position of the player in the store
 };
 
-} /* namespace fighttrack */
\ No newline at end of file
+} /* namespace fighttrack */
@@ -5,110 +5,88 @@
 
 #pragma once
 
-#include <ncurses.h>
-#include <gsl/gsl>
+#include <cstdint>
+
+#include "fighttrack/physics.h"
+#include "fighttrack/sprite_registry.h"
 
 /***************************************************************************************/
 
 namespace fighttrack {
 
-class Player;
-
-/**************************************************************************************/
-
-class PlayerState {
-   public:
-    virtual ~PlayerState() = default;
-    virtual PlayerState* HandleInput(Player& player, int input) = 0;
-    virtual void Update(Player& player) = 0;
-
-    /* Pool states to avoid allocation */
-    struct States;
-
-    class Standing;
-    class Walking;
-    class Jumping;
-    class Hit;
-    class Dying;
-    class Dead;
-};
-
-/**************************************************************************************/
-
-class PlayerState::Standing : public PlayerState {
-   public:
-    virtual ~Standing() = default;
-    virtual PlayerState* HandleInput(Player& player, int input) override;
-    virtual void Update(Player& player) override;
+/**
+ * State of a player, stored per entity.
+ * Walking is split by direction so a state needs no extra data.
+ */
+enum class PlayerState : uint8_t {
+    STANDING,
+    WALKING_LEFT,
+    WALKING_RIGHT,
+    JUMPING,
+    HIT,
+    DYING,
+    DEAD,
+    COUNT
 };
 
-/**************************************************************************************/
-
-class PlayerState::Walking : public PlayerState {
-   public:
-    enum Direction {
-        LEFT = -1,
-        RIGHT = 1,
-    };
-
-    Walking(Direction direction) : direction_{ direction }, threshold_{ 0 } {}
-    virtual ~Walking() = default;
-    virtual PlayerState* HandleInput(Player& player, int input) override;
-    virtual void Update(Player& player) override;
-
-   protected:
-    Direction direction_;
-    int threshold_;
+/**
+ * Input of a player, the keys that mean something to the state machine
+ */
+enum class PlayerInput : uint8_t {
+    NONE,
+    JUMP,
+    LEFT,
+    RIGHT,
+    COUNT
 };
 
-/**************************************************************************************/
-
-class PlayerState::Jumping : public PlayerState {
-   public:
-    virtual ~Jumping() = default;
-    virtual PlayerState* HandleInput(Player& player, int input) override;
-    virtual void Update(Player& player) override;
-
-   protected:
-    bool jumped_ = false;
+/**
+ * Effect of an input on a player
+ */
+struct PlayerTransition {
+    PlayerState next;  //!< State entered, may be the same
+    bool jump;         //!< Flag to start a jump
 };
 
-/**************************************************************************************/
-
-class PlayerState::Hit : public PlayerState {
-   public:
-    virtual ~Hit() = default;
-    virtual PlayerState* HandleInput(Player& player, int input) override;
-    virtual void Update(Player& player) override;
+/**
+ * What a state does on every tick
+ */
+struct PlayerStateBehavior {
+    int8_t walk;       //!< Direction walked: -1 left, 1 right, 0 none
+    bool jump;         //!< Flag to start a jump
+    PlayerState next;  //!< State after the tick, may be the same
 };
 
-/**************************************************************************************/
+//! Speed a jump starts upwards with, per tick; about 4 rows high against kGravity
+constexpr int32_t kPlayerJumpSpeed = kSubcells;
+//! Speed walking, per tick: a column every 2 ticks
+constexpr int32_t kPlayerWalkSpeed = kSubcells / 2;
 
-class PlayerState::Dying : public PlayerState {
-   public:
-    virtual ~Dying() = default;
-    virtual PlayerState* HandleInput(Player& player, int input) override;
-    virtual void Update(Player& player) override;
-};
-
-/**************************************************************************************/
+/**
+ * \brief  Map a key to a player input.
+ * \param  key Ncurses key code.
+ * \return Input, PlayerInput::NONE if the key does nothing.
+ */
+PlayerInput PlayerInputFromKey(int key);
 
-class PlayerState::Dead : public PlayerState {
-   public:
-    virtual ~Dead() = default;
-    virtual PlayerState* HandleInput(Player& player, int input) override;
-    virtual void Update(Player& player) override;
-};
+/**
+ * \brief  Look up the effect of an input.
+ * \param  state Current state.
+ * \param  input Input.
+ * \return Transition.
+ */
+PlayerTransition PlayerStateTransition(PlayerState state, PlayerInput input);
 
-/**************************************************************************************/
+/**
+ * \brief  Get the behavior table.
+ * \return Behavior of every state; index: state.
+ */
+const PlayerStateBehavior* PlayerStateBehaviors();
 
-struct PlayerState::States {
-    static PlayerState::Standing standing;
-    static PlayerState::Walking walking;
-    static PlayerState::Jumping jumping;
-    static PlayerState::Hit hit;
-    static PlayerState::Dying dying;
-    static PlayerState::Dead dead;
-};
+/**
+ * \brief  Get the sprite table, registering the sprites on first call.
+ * \return Sprite of every state; index: state.
+ */
+const SpriteId* PlayerStateSprites();
 
-} /* namespace fighttrack */
\ No newline at end of file
+} /* namespace fighttrack */
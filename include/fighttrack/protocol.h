@@ -0,0 +1,475 @@
+/**
+ * \file protocol.h
+ * \brief Binary network protocol.
+ *
+ * Every message travels in a frame with a fixed 4-byte header:
+ *
+ *     | size (u16) | version (u8) | type (u8) | payload ... |
+ *
+ * `size` counts the whole frame, header included. All fields are little-endian.
+ * Entities are identified by numeric IDs; names only travel in PLAYER_NAME and
+ * PLAYER_INFO messages. Decoding never allocates: decoded messages are views into
+ * the frame they were read from.
+ *
+ * The server sends the map on join, and again when it changes. MAP_INFO names the
+ * map by a content hash; a client without that map asks for the MAP_INDEX, the
+ * content hash of every chunk, one frame at a time, then for the chunks it has not
+ * cached yet, a window at a time. Chunks travel run-length encoded, see map_sync.h.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+
+/**************************************************************************************/
+
+namespace fighttrack {
+namespace protocol {
+
+//! Protocol version, bumped on every incompatible change
+constexpr uint8_t kVersion = 4;
+//! Size of the frame header
+constexpr size_t kHeaderSize = 4;
+//! Maximum size of a frame, header included
+constexpr size_t kMaxFrameSize = UINT16_MAX;
+//! Maximum length of a player name
+constexpr size_t kMaxNameLength = 32;
+//! Maximum size of a datagram, kept under the usual path MTU
+constexpr size_t kMaxDatagramSize = 1200;
+//! Maximum number of chunk hashes in a MAP_INDEX frame
+constexpr size_t kMaxMapIndexEntries = 8000;
+//! Maximum number of chunks in a MAP_CHUNK_REQUEST frame
+constexpr size_t kMaxMapChunkRequest = 256;
+
+/**
+ * Message types
+ */
+enum class MessageType : uint8_t {
+    PLAYER_NAME = 1,   //!< Client -> Server: set the player name
+    KEY_PRESS = 2,     //!< Client -> Server: key pressed by the player
+    SNAPSHOT = 3,      //!< Server -> Client: entity states, delta to a baseline
+    PLAYER_LEAVE = 4,  //!< Server -> Client: a player left the game
+    WELCOME = 5,       //!< Server -> Client: entity ID assigned to the client
+    PLAYER_INFO = 6,   //!< Server -> Client: name of an entity
+    SNAPSHOT_ACK = 7,  //!< Client -> Server: snapshot received
+    UDP_HELLO = 8,     //!< Client -> Server (UDP): register the datagram address
+    MAP_INFO = 9,      //!< Server -> Client: map in play
+    MAP_INDEX_REQUEST = 10,  //!< Client -> Server: ask for the chunk hashes
+    MAP_INDEX = 11,          //!< Server -> Client: content hashes of a range of chunks
+    MAP_CHUNK_REQUEST = 12,  //!< Client -> Server: ask for chunks
+    MAP_CHUNK = 13,          //!< Server -> Client: contents of a chunk
+};
+
+/**
+ * View of a received frame
+ */
+struct Frame {
+    MessageType type;     //!< Message type
+    const char* payload;  //!< Payload, points into the receive buffer
+    size_t size;          //!< Payload size
+};
+
+/**************************************************************************************/
+/* MESSAGES */
+/**************************************************************************************/
+
+struct PlayerName {
+    const char* name;  //!< Player name, not null-terminated
+    uint8_t length;    //!< Name length
+};
+
+struct KeyPress {
+    int32_t key;  //!< Key code
+};
+
+struct Welcome {
+    uint32_t entity_id;  //!< Entity ID of the client's player
+    uint32_t token;      //!< Secret the client proves its identity with over UDP
+};
+
+struct PlayerInfo {
+    uint32_t entity_id;  //!< Entity ID
+    const char* name;    //!< Player name, not null-terminated
+    uint8_t length;      //!< Name length
+};
+
+struct PlayerLeave {
+    uint32_t entity_id;  //!< Entity ID
+};
+
+struct UdpHello {
+    uint32_t entity_id;  //!< Entity ID received in WELCOME
+    uint32_t token;      //!< Token received in WELCOME
+};
+
+struct SnapshotAck {
+    uint32_t sequence;  //!< Sequence number of the received snapshot
+};
+
+struct MapInfo {
+    uint64_t map_hash;    //!< Content hash of the map
+    uint32_t width;       //!< Number of columns
+    uint32_t height;      //!< Number of rows
+    uint16_t chunk_size;  //!< Chunk side, in cells
+};
+
+struct MapIndexRequest {
+    uint64_t map_hash;  //!< Content hash of the map
+    uint32_t first;     //!< Index of the first chunk wanted, row-major
+};
+
+struct MapIndex {
+    uint64_t map_hash;   //!< Content hash of the map
+    uint32_t first;      //!< Index of the first chunk, row-major
+    uint16_t count;      //!< Number of chunks
+    const char* hashes;  //!< Chunk hashes, 0 for empty chunks; read with ChunkHash()
+
+    //! Hash of the chunk first + i
+    uint64_t ChunkHash(size_t i) const;
+};
+
+struct MapChunkRequest {
+    uint64_t map_hash;    //!< Content hash of the map
+    uint16_t count;       //!< Number of chunks
+    const char* indices;  //!< Chunk indices, row-major; read with ChunkIndex()
+
+    //! Index of the i-th chunk asked for
+    uint32_t ChunkIndex(size_t i) const;
+};
+
+struct MapChunk {
+    uint64_t map_hash;    //!< Content hash of the map
+    uint32_t index;       //!< Chunk index, row-major
+    uint64_t chunk_hash;  //!< Content hash of the chunk
+    const char* data;     //!< Encoded chunk, see EncodeMapChunk()
+    uint16_t size;        //!< Size of the encoded chunk
+};
+
+/**
+ * Full state of an entity
+ */
+struct EntityState {
+    uint32_t entity_id;  //!< Entity ID
+    int16_t pos_x;       //!< X position
+    int16_t pos_y;       //!< Y position
+};
+
+/**
+ * Fields present in an entity delta
+ */
+enum EntityField : uint8_t {
+    kFieldPosX = 1 << 0,     //!< pos_x changed
+    kFieldPosY = 1 << 1,     //!< pos_y changed
+    kFieldRemoved = 1 << 2,  //!< Entity no longer exists
+};
+
+/**
+ * Changed fields of an entity, relative to the snapshot baseline
+ */
+struct EntityDelta {
+    uint32_t entity_id;  //!< Entity ID
+    uint8_t fields;      //!< Mask of EntityField present
+    int16_t pos_x;       //!< X position, set if kFieldPosX
+    int16_t pos_y;       //!< Y position, set if kFieldPosY
+};
+
+/**
+ * Snapshot header
+ *
+ * A snapshot holds the entity deltas from the baseline snapshot to this one.
+ * A baseline of 0 makes it a keyframe, holding every entity in full.
+ */
+struct SnapshotHeader {
+    uint32_t sequence;  //!< Sequence number of this snapshot, starting at 1
+    uint32_t baseline;  //!< Sequence number of the baseline, 0 for keyframes
+};
+
+/**************************************************************************************/
+/* ENCODING */
+/**************************************************************************************/
+
+/**
+ * Append-only little-endian frame writer.
+ */
+class Writer {
+   public:
+    /**
+     * \brief Construct a new Writer object.
+     * \param out Buffer frames are appended to.
+     */
+    explicit Writer(std::string& out) : out_{ out }, frame_start_{ 0 } {}
+
+    /**
+     * \brief Start a new frame. Must be closed with EndFrame().
+     * \param type Message type.
+     */
+    Writer& BeginFrame(MessageType type)
+    {
+        frame_start_ = out_.size();
+        U16(0).U8(kVersion).U8(static_cast<uint8_t>(type));
+        return *this;
+    }
+
+    /**
+     * \brief Patch the size of the current frame.
+     * \return false if the frame exceeds the maximum frame size.
+     */
+    bool EndFrame()
+    {
+        size_t size = out_.size() - frame_start_;
+        if (size > kMaxFrameSize) {
+            out_.resize(frame_start_);
+            return false;
+        }
+        PatchU16(frame_start_, size);
+        return true;
+    }
+
+    Writer& U8(uint8_t value)
+    {
+        out_.push_back(static_cast<char>(value));
+        return *this;
+    }
+    Writer& U16(uint16_t value)
+    {
+        char bytes[2] = { static_cast<char>(value), static_cast<char>(value >> 8) };
+        out_.append(bytes, sizeof(bytes));
+        return *this;
+    }
+    Writer& U32(uint32_t value)
+    {
+        char bytes[4] = { static_cast<char>(value), static_cast<char>(value >> 8),
+                          static_cast<char>(value >> 16), static_cast<char>(value >> 24) };
+        out_.append(bytes, sizeof(bytes));
+        return *this;
+    }
+    Writer& U64(uint64_t value)
+    {
+        return U32(static_cast<uint32_t>(value)).U32(static_cast<uint32_t>(value >> 32));
+    }
+    Writer& I16(int16_t value) { return U16(static_cast<uint16_t>(value)); }
+    Writer& I32(int32_t value) { return U32(static_cast<uint32_t>(value)); }
+    Writer& Bytes(const char* data, size_t length)
+    {
+        out_.append(data, length);
+        return *this;
+    }
+
+    //! Current write offset in the output buffer
+    size_t Offset() const { return out_.size(); }
+    //! Overwrite a 16-bit field written before
+    void PatchU16(size_t offset, uint16_t value)
+    {
+        out_[offset + 0] = static_cast<char>(value & 0xFF);
+        out_[offset + 1] = static_cast<char>(value >> 8);
+    }
+
+   private:
+    std::string& out_;    //!< Output buffer
+    size_t frame_start_;  //!< Offset of the frame being written
+};
+
+void Encode(std::string& out, const PlayerName& msg);
+void Encode(std::string& out, const KeyPress& msg);
+void Encode(std::string& out, const Welcome& msg);
+void Encode(std::string& out, const PlayerInfo& msg);
+void Encode(std::string& out, const PlayerLeave& msg);
+void Encode(std::string& out, const SnapshotAck& msg);
+void Encode(std::string& out, const UdpHello& msg);
+void Encode(std::string& out, const MapInfo& msg);
+void Encode(std::string& out, const MapIndexRequest& msg);
+void Encode(std::string& out, const MapChunk& msg);
+
+/**
+ * \brief Write a MAP_INDEX frame.
+ * \param out      Output buffer.
+ * \param map_hash Content hash of the map.
+ * \param first    Index of the first chunk.
+ * \param hashes   Chunk hashes.
+ * \param count    Number of chunks, up to kMaxMapIndexEntries.
+ */
+void EncodeMapIndex(std::string& out, uint64_t map_hash, uint32_t first,
+                    const uint64_t* hashes, uint16_t count);
+
+/**
+ * \brief Write a MAP_CHUNK_REQUEST frame.
+ * \param out      Output buffer.
+ * \param map_hash Content hash of the map.
+ * \param indices  Chunk indices.
+ * \param count    Number of chunks, up to kMaxMapChunkRequest.
+ */
+void EncodeMapChunkRequest(std::string& out, uint64_t map_hash, const uint32_t* indices,
+                           uint16_t count);
+
+/**
+ * Writes a snapshot frame, one entity delta at a time.
+ */
+class SnapshotWriter {
+   public:
+    /**
+     * \brief Start a snapshot frame.
+     * \param out    Output buffer.
+     * \param header Snapshot header.
+     */
+    SnapshotWriter(std::string& out, const SnapshotHeader& header);
+
+    /**
+     * \brief Append an entity delta. Only the fields in the mask are written.
+     */
+    void Add(const EntityDelta& delta);
+
+    /**
+     * \brief Finish the frame.
+     * \return false if the frame exceeds the maximum frame size.
+     */
+    bool End();
+
+   private:
+    Writer writer_;        //!< Frame writer
+    size_t count_offset_;  //!< Offset of the entity count field
+    uint16_t count_;       //!< Number of entity deltas written
+};
+
+/**************************************************************************************/
+/* DECODING */
+/**************************************************************************************/
+
+/**
+ * Bounds-checked little-endian reader.
+ * Reads past the end return zero and set the error flag.
+ */
+class Reader {
+   public:
+    Reader(const char* data, size_t size) : data_{ data }, size_{ size }, pos_{ 0 } {}
+
+    uint8_t U8()
+    {
+        if (!Need(1))
+            return 0;
+        return static_cast<uint8_t>(data_[pos_++]);
+    }
+    uint16_t U16()
+    {
+        if (!Need(2))
+            return 0;
+        uint16_t value = Byte(0) | (Byte(1) << 8);
+        pos_ += 2;
+        return value;
+    }
+    uint32_t U32()
+    {
+        if (!Need(4))
+            return 0;
+        uint32_t value = Byte(0) | (Byte(1) << 8) | (Byte(2) << 16) | (Byte(3) << 24);
+        pos_ += 4;
+        return value;
+    }
+    uint64_t U64()
+    {
+        const uint64_t low = U32();
+        return low | (static_cast<uint64_t>(U32()) << 32);
+    }
+    int16_t I16() { return static_cast<int16_t>(U16()); }
+    int32_t I32() { return static_cast<int32_t>(U32()); }
+    const char* Bytes(size_t length)
+    {
+        if (!Need(length))
+            return nullptr;
+        const char* ptr = data_ + pos_;
+        pos_ += length;
+        return ptr;
+    }
+
+    //! True if a read went past the end of data
+    bool Failed() const { return pos_ > size_; }
+    //! Number of bytes not read yet
+    size_t Remaining() const { return Failed() ? 0 : size_ - pos_; }
+
+   private:
+    bool Need(size_t length)
+    {
+        if (pos_ + length > size_) {
+            pos_ = size_ + 1;
+            return false;
+        }
+        return true;
+    }
+    uint32_t Byte(size_t offset) const
+    {
+        return static_cast<uint8_t>(data_[pos_ + offset]);
+    }
+
+    const char* data_;  //!< Data being read
+    size_t size_;       //!< Data size
+    size_t pos_;        //!< Read position
+};
+
+/**
+ * \brief Parse the frame at the beginning of a buffer.
+ * \param data  Buffer.
+ * \param size  Buffer size.
+ * \param frame Output frame view, set when a whole frame is available.
+ * \return Size of the frame, 0 if the buffer does not hold a whole frame yet,
+ *         negative if the data is not a valid frame.
+ */
+int ParseFrame(const char* data, size_t size, Frame* frame);
+
+bool Decode(const Frame& frame, PlayerName* msg);
+bool Decode(const Frame& frame, KeyPress* msg);
+bool Decode(const Frame& frame, Welcome* msg);
+bool Decode(const Frame& frame, PlayerInfo* msg);
+bool Decode(const Frame& frame, PlayerLeave* msg);
+bool Decode(const Frame& frame, SnapshotAck* msg);
+bool Decode(const Frame& frame, UdpHello* msg);
+bool Decode(const Frame& frame, MapInfo* msg);
+bool Decode(const Frame& frame, MapIndexRequest* msg);
+bool Decode(const Frame& frame, MapIndex* msg);
+bool Decode(const Frame& frame, MapChunkRequest* msg);
+bool Decode(const Frame& frame, MapChunk* msg);
+
+/**
+ * Iterates over the entity deltas of a snapshot frame.
+ */
+class SnapshotReader {
+   public:
+    /**
+     * \brief Construct a new Snapshot Reader object.
+     * \param frame Snapshot frame.
+     */
+    explicit SnapshotReader(const Frame& frame);
+
+    /**
+     * \brief Get the snapshot header.
+     */
+    const SnapshotHeader& Header() const { return header_; }
+
+    /**
+     * \brief Read the next entity delta.
+     * \return false when there are no more deltas or the frame is malformed.
+     */
+    bool Next(EntityDelta* delta);
+
+    /**
+     * \brief Check if the frame was malformed.
+     */
+    bool Failed() const { return reader_.Failed(); }
+
+   private:
+    Reader reader_;          //!< Payload reader
+    SnapshotHeader header_;  //!< Snapshot header
+    size_t left_;            //!< Number of deltas left to read
+};
+
+/**
+ * \brief Print a frame in human readable text. Used for debugging.
+ * \param file   Output file.
+ * \param prefix Line prefix.
+ * \param frame  Frame to print.
+ */
+void DumpFrame(FILE* file, const char* prefix, const Frame& frame);
+
+} /* namespace protocol */
+} /* namespace fighttrack */
@@ -0,0 +1,100 @@
+/**
+ * \file renderer.h
+ * \brief Incremental renderer, redrawing only what changed on screen.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "fighttrack/camera.h"
+#include "fighttrack/canvas.h"
+#include "fighttrack/entity_store.h"
+#include "fighttrack/geometry.h"
+#include "fighttrack/map.h"
+#include "fighttrack/sprite_registry.h"
+
+/**************************************************************************************/
+
+namespace fighttrack {
+
+/**
+ * Renderer of the map and the entities, frame by frame.
+ *
+ * The canvas keeps the cells of the previous frame, so it is not erased: every frame,
+ * the entities are compared to what was drawn of them last frame, and only the
+ * rectangles they left and entered are redrawn, map and entities clipped to each
+ * one. The canvas then only sends the cells touched. A frame where nothing changed
+ * touches nothing and skips presenting it.
+ *
+ * The whole screen is redrawn when the camera moves, the screen changes size, or
+ * after Invalidate(), e.g. when another map is loaded.
+ */
+class Renderer {
+   public:
+    /**
+     * \brief Construct a new Renderer object, drawing everything on the first frame.
+     */
+    Renderer();
+
+    /**
+     * \brief Redraw the whole screen on the next frame.
+     */
+    void Invalidate() { full_redraw_ = true; }
+
+    /**
+     * \brief Draw a frame, and present the canvas if anything changed.
+     * \param canvas   Canvas.
+     * \param camera   Camera.
+     * \param map      Map, with the chunks in view streamed in.
+     * \param entities Entities.
+     */
+    void Render(Canvas& canvas, const Camera& camera, Map& map, EntityStore& entities);
+
+   private:
+    /**
+     * What an entity looked like when drawn
+     */
+    struct Drawn {
+        uint32_t handle;   //!< Entity handle
+        size_t order;      //!< Position drawn at, later ones on top
+        Rect bounds;       //!< World cells covered, name included
+        SpriteId sprite;   //!< Graphics
+        std::string name;  //!< Name shown above
+
+        bool operator==(const Drawn& other) const
+        {
+            return order == other.order && bounds == other.bounds &&
+                   sprite == other.sprite && name == other.name;
+        }
+        bool operator!=(const Drawn& other) const { return !(*this == other); }
+    };
+
+    /**
+     * \brief Record how every entity is drawn, sorted by handle, in current_.
+     */
+    void Collect(EntityStore& entities);
+
+    /**
+     * \brief Mark the screen cells of a world rectangle to be redrawn.
+     */
+    void Damage(const Camera& camera, const Rect& bounds);
+
+    /**
+     * \brief Clear a screen rectangle and draw the map and entities in it.
+     */
+    void Redraw(Canvas& canvas, const Camera& camera, Map& map, EntityStore& entities,
+                const Rect& screen);
+
+    bool full_redraw_;             //!< Flag to redraw the whole screen next frame
+    Rect screen_;                  //!< Screen rectangle of the last frame
+    Rect view_;                    //!< World rectangle of the last frame
+    std::vector<Drawn> previous_;  //!< Entities as drawn last frame, sorted by handle
+    std::vector<Drawn> current_;   //!< Entities as drawn this frame, sorted by handle
+    std::vector<Rect> damage_;     //!< Screen rectangles to redraw this frame
+};
+
+} /* namespace fighttrack */
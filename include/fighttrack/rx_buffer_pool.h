@@ -0,0 +1,87 @@
+/**
+ * \file rx_buffer_pool.h
+ * \brief Pool of fixed-size receive buffers recycled between two threads.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "fighttrack/spsc_queue.h"
+
+/**************************************************************************************/
+
+namespace fighttrack {
+
+/**
+ * Receive buffers filled by one thread (the producer) and handed back by another
+ * (the consumer) once their data is consumed.
+ *
+ * The producer keeps the free buffers in a local list, refilled from a lock-free queue
+ * of buffers released by the consumer, so neither side locks. A buffer is only
+ * allocated when none is free (a miss) and is kept until Reset(), so a warmed up pool
+ * does not allocate.
+ */
+class RxBufferPool {
+   public:
+    //! Size of every buffer
+    static constexpr size_t kBufferSize = 4096;
+
+    /**
+     * Pool statistics, cumulative since Reset()
+     */
+    struct Stats {
+        uint64_t hits;    //!< Buffers reused
+        uint64_t misses;  //!< Buffers allocated because none was free
+    };
+
+    /**
+     * \brief Construct a new empty RX Buffer Pool object.
+     */
+    RxBufferPool();
+
+    /**
+     * \brief Free all buffers and reallocate the pool. Not thread-safe.
+     * \param max_buffers Maximum number of buffers, in use or free.
+     * \param preallocate Number of buffers allocated now.
+     */
+    void Reset(size_t max_buffers, size_t preallocate);
+
+    /**
+     * \brief  Take a free buffer. (producer only)
+     * \return Buffer of kBufferSize bytes, nullptr if the maximum is in use.
+     */
+    char* Acquire();
+
+    /**
+     * \brief Give back a buffer once its data is consumed. (consumer only)
+     * \param buffer Buffer.
+     */
+    void Release(const char* buffer);
+
+    /**
+     * \brief  Get the pool statistics.
+     * \return Counters since Reset().
+     */
+    Stats GetStats() const;
+
+   private:
+    //! All buffers, free or in use; producer only
+    std::vector<std::unique_ptr<char[]>> storage_;
+    //! Free buffers; producer only
+    std::vector<char*> free_;
+    //! Buffers released by the consumer, waiting to be taken back by the producer
+    SpscQueue<char*> released_;
+    //! Maximum number of buffers
+    size_t max_buffers_;
+
+    //! Counters reported by GetStats()
+    std::atomic<uint64_t> stat_hits_;
+    std::atomic<uint64_t> stat_misses_;
+};
+
+} /* namespace fighttrack */
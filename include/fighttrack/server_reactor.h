@@ -0,0 +1,289 @@
+/**
+ * \file server_reactor.h
+ * \brief Server Socket event loop, common to all I/O backends.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+
+#include <sys/uio.h>
+#include <netinet/in.h>
+
+#include "safe/lockable.h"
+#include "fighttrack/server_socket.h"
+#include "fighttrack/spsc_queue.h"
+#include "fighttrack/rx_buffer_pool.h"
+#include "fighttrack/slot_map.h"
+
+/**************************************************************************************/
+
+namespace fighttrack {
+
+/**
+ * Event loop thread owning a share of the server connections end to end.
+ *
+ * Every reactor has its own listening socket on the server port, bound with
+ * SO_REUSEPORT when there are several reactors so the kernel spreads incoming
+ * connections among them. Client IDs are slot handles whose index is
+ * slot * N + reactor index, so the owner of a client is found without any shared
+ * table, and an ID kept after its client left never matches the next client of the
+ * slot.
+ *
+ * This class holds the client bookkeeping and the TX/RX queues shared with the API
+ * client thread. Subclasses implement the socket I/O with a particular backend.
+ */
+class ServerReactor {
+   public:
+    using Options = ServerSocket::Options;
+    using RxMessage = ServerSocket::RxMessage;
+    using RxStatus = ServerSocket::RxStatus;
+    using Buffer = ServerSocket::Buffer;
+
+    //! Client ID of requests sent to every connected client
+    static constexpr int kAllClients = -1;
+
+    /**
+     * \brief Construct a new Server Reactor object.
+     * \param options Server socket options.
+     * \param index   Reactor index.
+     * \param count   Number of reactors.
+     */
+    ServerReactor(const Options& options, int index, int count);
+
+    /**
+     * \brief Destroy the Server Reactor object. Subclasses must Terminate() first.
+     */
+    virtual ~ServerReactor();
+
+    /**
+     * \brief  Create the listening socket and start the event thread.
+     * \param  port Server port.
+     * \return 0 on sucess, negative if error.
+     */
+    int Initialize(uint16_t port);
+
+    /**
+     * \brief Stop the event thread and close all connections.
+     */
+    void Terminate();
+
+    /**
+     * \brief  Queue TX requests for the event thread. (API client thread)
+     * \param  client_ids Client IDs, only those owned by this reactor are taken.
+     * \param  count      Number of client IDs.
+     * \param  buffer     Message to send.
+     */
+    void PushRequests(const int* client_ids, size_t count, const Buffer& buffer);
+
+    //! Incoming messages or events from clients; producer: event thread,
+    //! consumer: API client thread
+    SpscQueue<RxMessage> rx_queue;
+    //! Buffers of the NEW_DATA messages, released by the API client thread
+    RxBufferPool rx_pool;
+
+    //! Counters reported by GetTxStats() and GetRxStats()
+    std::atomic<uint64_t> stat_messages_queued;
+    std::atomic<uint64_t> stat_messages_dropped;
+    std::atomic<uint64_t> stat_bytes_sent;
+    std::atomic<uint64_t> stat_send_calls;
+    std::atomic<uint64_t> stat_rx_messages;
+    std::atomic<uint64_t> stat_rx_overflows;
+
+   protected:
+    /**********************************************************************************/
+    /* BACKEND */
+    /**********************************************************************************/
+    /**
+     * \brief  Create the backend resources. Called before the thread starts.
+     * \return 0 on sucess, negative if error.
+     */
+    virtual int Setup() = 0;
+
+    /**
+     * \brief Release the backend resources. Called after the thread stopped.
+     */
+    virtual void Teardown() = 0;
+
+    /**
+     * \brief Thread runnable; Handle events of new connections, clients rx and tx.
+     *        Must return once terminate_ is set and event_fd_ is signaled.
+     */
+    virtual void EventLoop() = 0;
+
+    /**
+     * \brief Close a client connection and notify the API client.
+     * \param slot Client slot.
+     */
+    virtual void RemoveClient(int slot) = 0;
+
+    /**
+     * \brief Send as much of a client TX queue as possible, without blocking.
+     * \param slot Client slot.
+     */
+    virtual void FlushClientOutput(int slot) = 0;
+
+    /**********************************************************************************/
+    /* HELPERS FOR BACKENDS (event thread) */
+    /**********************************************************************************/
+    /* Client connection information */
+    struct ClientInfo {
+        int sock;                      //!< Client socket, -1 if the slot is free
+        struct sockaddr_in addr;       //!< Client address
+        std::vector<Buffer> tx_queue;  //!< Outgoing messages
+        size_t tx_head;                //!< Index of the first message not sent
+        size_t tx_offset;              //!< Bytes of the first message already sent
+        size_t tx_backlog;             //!< Bytes queued and not sent yet
+        bool tx_pending;               //!< Flag indicating new data to flush
+        bool tx_busy;  //!< Backend flag: waiting for the socket to take more data
+    };
+
+    /**
+     * \brief  Take a free client slot and reset it.
+     * \return Slot, -1 if this reactor is full.
+     */
+    int AcquireSlot();
+
+    /**
+     * \brief Free a client slot and its TX queue memory. The socket is not closed.
+     *        The client ID is no longer valid afterwards.
+     * \param slot Client slot.
+     */
+    void ReleaseSlot(int slot);
+
+    /**
+     * \brief  Queue an event for the API client.
+     * \param  slot   Client slot.
+     * \param  status Event status.
+     * \param  data   Received data, for NEW_DATA; copied to a pool buffer.
+     * \param  size   Size of received data, up to RxBufferPool::kBufferSize.
+     * \param  wait   Wait for the API client if the queue is full.
+     * \return true if queued, false if the queue is full or terminating.
+     */
+    bool PostRxMessage(int slot, RxStatus status, const char* data, size_t size,
+                       bool wait);
+
+    /**
+     * \brief  Queue received data already in a buffer taken from rx_pool.
+     * \param  slot   Client slot.
+     * \param  buffer Pool buffer, owned by the API client from now on.
+     * \param  size   Size of received data.
+     * \return true if queued, false if the queue is full.
+     */
+    bool PostRxBuffer(int slot, char* buffer, size_t size);
+
+    /**
+     * \brief  Gather the unsent part of a client TX queue.
+     * \param  client    Client info.
+     * \param  iov       Output array.
+     * \param  max_count Size of the output array.
+     * \return Number of entries written to iov.
+     */
+    static size_t GatherClientOutput(const ClientInfo& client, struct iovec* iov,
+                                     size_t max_count);
+
+    /**
+     * \brief Advance a client TX queue past sent bytes, releasing sent buffers.
+     * \param client Client info.
+     * \param sent   Number of bytes sent.
+     */
+    void ConsumeClientOutput(ClientInfo& client, size_t sent);
+
+    /**
+     * \brief Move messages from PushRequests() into the client TX queues and flush.
+     */
+    void HandleTxRequests();
+
+    /**
+     * \brief Client ID of a slot of this reactor.
+     */
+    int ClientId(int slot) const
+    {
+        return (int) SlotHandle::Make(slot * count_ + index_, slots_.Generation(slot));
+    }
+
+    //! Server socket options
+    const Options& options_;
+    //! Reactor index
+    const int index_;
+    //! Number of reactors
+    const int count_;
+    //! Socket which listens for new connections
+    int listen_sock_;
+    //! File descriptor used for waking up the event handling thread
+    int event_fd_;
+    //! Flag requesting the event handling thread to terminate
+    std::atomic<bool> terminate_;
+
+    /* Client bookkeeping, only accessed by the event thread so it needs no lock */
+    //! Table of clients; index: client slot (client ID / number of reactors)
+    std::vector<ClientInfo> clients_;
+    //! Number of connected clients
+    size_t num_clients_;
+
+   private:
+    /**
+     * \brief  Create the listening socket and the wake up event FD.
+     * \param  port Server port.
+     * \return 0 on sucess, negative if error.
+     */
+    int OpenSockets(uint16_t port);
+
+    /**
+     * \brief Wake up the event thread.
+     */
+    void NotifyEventThread();
+
+    /**
+     * \brief  Queue data to be sent to a client, applying the slow client policy.
+     * \param  slot   Client slot.
+     * \param  buffer Data to send.
+     * \return true if queued, false if dropped or client disconnected.
+     */
+    bool QueueClientOutput(int slot, const Buffer& buffer);
+
+    /* Message to send to a client, or to all */
+    struct TxRequest {
+        int client_id;  //!< Client ID or kAllClients
+        Buffer buffer;  //!< Message buffer
+    };
+
+    //! Event handling thread
+    std::thread event_thread_;
+    //! Allocator of client slots and their generations
+    SlotAllocator slots_;
+    //! Client slots with new data queued, to be flushed
+    std::vector<int> tx_pending_slots_;
+    //! Requests taken from the shared queue, swapped back to keep both allocations
+    std::vector<TxRequest> tx_requests_;
+
+    /** TX thread-shared data
+     * (access by API client thread and event thread) */
+    struct TxData {
+        //! Requests not yet handled by the event thread
+        std::vector<TxRequest> tx_requests;
+    };
+    //! Cached TX data, acessed by API client thread and event thread
+    safe::Lockable<TxData, std::shared_timed_mutex> tx_data_;
+
+    /**********************************************************************************/
+    /* ALIASES */
+    /**********************************************************************************/
+    //! Alias to the Write accessor type
+    template<typename ValueType>
+    auto WriteAccess(typename safe::Lockable<ValueType, std::shared_timed_mutex>& value)
+    {
+        return typename safe::Lockable<
+            ValueType, std::shared_timed_mutex>::template WriteAccess<std::unique_lock>{
+            value
+        };
+    }
+};
+
+} /* namespace fighttrack */
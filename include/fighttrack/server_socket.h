@@ -6,23 +6,20 @@
 #pragma once
 
 #include <cstdint>
-#include <map>
-#include <deque>
-#include <queue>
-#include <thread>
-#include <mutex>
-#include <shared_mutex>
-#include <future>
-#include <condition_variable>
+#include <string>
+#include <vector>
+#include <memory>
 
-#include <netinet/in.h>
-
-#include "safe/lockable.h"
+#include "fighttrack/spsc_queue.h"
+#include "fighttrack/rx_buffer_pool.h"
+#include "fighttrack/slot_map.h"
 
 /**************************************************************************************/
 
 namespace fighttrack {
 
+class ServerReactor;
+
 class ServerSocket {
    public:
     /**********************************************************************************/
@@ -42,12 +39,55 @@ class ServerSocket {
     /* CONTROL */
     /**********************************************************************************/
     /**
-     * \brief Create and configure the server socket.
+     * What to do with a client whose outgoing backlog is full
+     */
+    enum class SlowClientPolicy {
+        DISCONNECT = 0,     //!< Close the connection
+        DROP_MESSAGES = 1,  //!< Drop new messages until the backlog drains
+    };
+
+    /**
+     * Socket I/O backend of the event loop threads
+     */
+    enum class Backend {
+        EPOLL = 0,     //!< Readiness with epoll, then recv() and sendmsg()
+        IO_URING = 1,  //!< Completions with io_uring, multishot accept and recv
+    };
+
+    /**
+     * Server socket options
+     */
+    struct Options {
+        //! Maximum number of simultaneous connections, client ID indices are below it
+        size_t max_clients = 4;
+        //! Maximum number of bytes queued and not yet sent to a client
+        size_t max_tx_backlog = 256 * 1024;
+        //! Policy for clients that exceed the TX backlog
+        SlowClientPolicy slow_client_policy = SlowClientPolicy::DISCONNECT;
+        //! Number of received messages buffered until handled by GetMessages(),
+        //! per reactor
+        size_t rx_queue_size = 4096;
+        //! Number of event loop threads, 0 for one per CPU core
+        size_t num_reactors = 1;
+        //! Socket I/O backend, falls back to EPOLL if IO_URING is not available
+        Backend backend = Backend::EPOLL;
+    };
+
+    /**
+     * \brief Create and configure the server socket with default options.
      * \param port Server port.
      * \return 0 on sucess, negative if error.
      */
     int Initialize(const uint16_t port);
 
+    /**
+     * \brief Create and configure the server socket.
+     * \param port    Server port.
+     * \param options Server socket options.
+     * \return 0 on sucess, negative if error.
+     */
+    int Initialize(const uint16_t port, const Options& options);
+
     /**
      * \brief Close all open connections and clean resources.
      */
@@ -74,155 +114,155 @@ class ServerSocket {
     };
 
     /**
-     * Transmit message
+     * Immutable message buffer, shared by the TX queues of all its recipients
+     */
+    using Buffer = std::shared_ptr<const std::string>;
+
+    /**
+     * \brief  Wrap encoded data in a shareable buffer.
+     * \param  data Encoded message.
+     * \return Shared buffer.
      */
-    struct TxMessage {
-        std::vector<int> client_ids;  //!< Client IDs to send this message.
-        std::string buffer;           //!< Message buffer
+    static Buffer MakeBuffer(std::string data)
+    {
+        return std::make_shared<const std::string>(std::move(data));
+    }
+
+    /**
+     * Transmit statistics, cumulative since initialization
+     */
+    struct TxStats {
+        uint64_t messages_queued;   //!< Messages queued for a client
+        uint64_t messages_dropped;  //!< Messages dropped, unknown or slow client
+        uint64_t bytes_sent;        //!< Bytes written to client sockets
+        uint64_t send_calls;        //!< Number of sendmsg() calls
     };
 
     /**
      * Received message
      */
     struct RxMessage {
-        int client_id;       //!< Client ID.
-        RxStatus status;     //!< Receive message status, should check first.
-        std::string buffer;  //!< Received data, set when status is NEW_DATA.
+        int client_id;     //!< Client ID, a SlotHandle unique among recent clients.
+        RxStatus status;   //!< Receive message status, should check first.
+        const char* data;  //!< Received data, set when status is NEW_DATA.
+        size_t size;       //!< Size of received data.
     };
 
     /**
-     * \brief  Get queue of received messages from clients.
-     * \return Queue of messages.
+     * Receive statistics
      */
-    std::queue<RxMessage> GetMessages();
+    struct RxStats {
+        size_t queue_depth;     //!< Messages waiting to be handled
+        size_t queue_capacity;  //!< Maximum number of messages waiting
+        uint64_t messages;      //!< Messages received since initialization
+        uint64_t overflows;     //!< Reads or accepts deferred because the queue was full
+        uint64_t pool_hits;     //!< Receive buffers reused from the pool
+        uint64_t pool_misses;   //!< Receive buffers allocated
+    };
 
     /**
-     * \brief  Send data to clients.
-     * \param  message Message to send.
-     * \return Future trasmission status.
+     * \brief  Handle the messages received from clients. Never locks nor allocates.
+     * \param  handler Callable as `int handler(const RxMessage&)`. The message and
+     *                 its data are only valid during the call, then the receive
+     *                 buffer goes back to its pool. Returning non-zero stops draining.
+     * \return 0 if all messages queued at the time of the call were handled,
+     *         otherwise the value returned by the handler.
      */
-    std::future<TxStatus> Transmit(TxMessage message);
+    template<typename Handler>
+    int GetMessages(Handler&& handler);
 
-   private:
-    /**********************************************************************************/
-    /* HELPERS */
-    /**********************************************************************************/
+    /**
+     * \brief  Get the receive statistics.
+     * \return Current queue depth and counters since initialization.
+     */
+    RxStats GetRxStats() const;
 
     /**
-     * \brief Thread runnable; Handle events of new connections and clients rx.
+     * \brief  Send data to a client. Never blocks on a slow client.
+     * \param  client_id Client ID.
+     * \param  buffer    Message to send.
+     * \return SUCCESS if the request was queued, ERROR if invalid.
+     *         Delivery failures are only reported through GetTxStats().
      */
-    void RxEventHandler();
+    TxStatus Transmit(int client_id, Buffer buffer);
 
     /**
-     * \brief Thread runnable; Handle events transmission.
+     * \brief  Send the same data to several clients, sharing the buffer.
+     * \param  client_ids Client IDs.
+     * \param  buffer     Message to send.
+     * \return SUCCESS if the request was queued, ERROR if invalid.
      */
-    void TxEventHandler();
+    TxStatus Transmit(const std::vector<int>& client_ids, const Buffer& buffer);
 
     /**
-     * \brief Accept a connection from listener socket and add it to the client list.
-     * \return 0 on success, positive if failure, negative if fatal error.
+     * \brief  Send data to every connected client, sharing the buffer.
+     * \param  buffer Message to send.
+     * \return SUCCESS if the request was queued, ERROR if invalid.
      */
-    int AddNewClient();
+    TxStatus Broadcast(Buffer buffer);
 
     /**
-     * \brief  Handle client socket input. Try to read data and queue it.
-     * \param  client_sock  Client socket.
-     * \return 0 on success, positive if failure, negative if fatal error.
+     * \brief  Get the transmit statistics.
+     * \return Counters since initialization.
      */
-    int HandleClientInput(int client_sock);
+    TxStats GetTxStats() const;
 
    private:
+    /**
+     * \brief  Get the RX queue of a reactor.
+     * \param  index Reactor index.
+     * \return Reactor's RX queue.
+     */
+    SpscQueue<RxMessage>& RxQueue(size_t index);
+
+    /**
+     * \brief  Get the receive buffer pool of a reactor.
+     * \param  index Reactor index.
+     * \return Reactor's receive buffer pool.
+     */
+    RxBufferPool& RxPool(size_t index);
+
     /**********************************************************************************/
     /* MEMBER VARIABLES */
     /**********************************************************************************/
     //! Flag indicating if socket is initialized
     bool initialized_;
-    //! Master socket which listens for new connections
-    int listen_sock_;
-    //! Event poll file descriptor
-    int epoll_fd_;
-    //! File descriptor used for notifying the RX handling thread
-    int rx_thread_event_fd_;
-
-    //! RX event handling thread
-    std::thread rx_thread_;
-    //! TX event handling thread
-    std::thread tx_thread_;
-
-    /**
-     * Events for TX thread
-     */
-    enum class TxThreadEvent {
-        NONE = 0,
-        NEW_DATA = 1,
-        TERMINATE = 2,
-    };
-
-    /* Client connection information */
-    struct ClientInfo {
-        int sock;
-        struct sockaddr_in addr;
-    };
+    //! Options the socket was initialized with
+    Options options_;
+    //! Event loop threads, each one owning a share of the clients
+    std::vector<std::unique_ptr<ServerReactor>> reactors_;
+    //! Reactor drained first by the next GetMessages(), for fairness
+    size_t rx_next_reactor_;
+};
 
-    /** Common thread-shared data.
-     * (access by API client thread, RX thread and TX thread) */
-    struct CommonData {
-        //! Deque of available client IDs (sorted)
-        std::deque<int> available_ids;
-        //! Map of clients; key: client ID; element: client info
-        std::map<int, ClientInfo> clients;
-    };
-    //! Cached common data, acessed by API client thread, RX thread and TX thread
-    safe::Lockable<CommonData, std::shared_timed_mutex> common_data_;
-
-    /** RX thread-shared data.
-     * (access by API client thread and RX thread) */
-    struct RxData {
-        //! Queue of incomming messages or events from clients
-        std::queue<RxMessage> rx_queue;
-    };
-    //! Cached RX data, acessed by API client thread and RX thread
-    safe::Lockable<RxData, std::shared_timed_mutex> rx_data_;
-
-    /** TX thread-shared data
-     * (access by API client thread and TX thread) */
-    struct TxData {
-        struct TxFutureMsg {
-            std::promise<TxStatus> promise;  //!< Promise is set when message was sent
-            TxMessage message;               //!< Message content
-        };
-        //!< Queues of outgoing messages for clients
-        std::queue<TxFutureMsg> tx_queue;
-        //! TX thread event
-        TxThreadEvent tx_event;
-    };
-    //! Cached TX data, acessed by API client thread and TX thread
-    safe::Lockable<TxData, std::shared_timed_mutex> tx_data_;
+/**************************************************************************************/
 
-    //! TX thread event notifier
-    std::condition_variable_any tx_thread_notify_;
+template<typename Handler>
+int ServerSocket::GetMessages(Handler&& handler)
+{
+    /* Start from a different reactor each time so none is favored */
+    const size_t count = reactors_.size();
+    const size_t first = rx_next_reactor_;
+    rx_next_reactor_ = (count > 0) ? (first + 1) % count : 0;
 
-    /**********************************************************************************/
-    /* ALIASES */
-    /**********************************************************************************/
-    //! Alias to the Read accessor type
-    template<typename ValueType>
-    auto ReadAccess(typename safe::Lockable<ValueType, std::shared_timed_mutex>& value)
-    {
-        return typename safe::Lockable<
-            ValueType, std::shared_timed_mutex>::template ReadAccess<std::shared_lock>{
-            value
-        };
+    for (size_t i = 0; i < count; ++i) {
+        auto& rx_queue = RxQueue((first + i) % count);
+        auto& rx_pool = RxPool((first + i) % count);
+        /* Only what is queued now, so a busy event thread can't keep us here forever */
+        for (size_t n = rx_queue.Size(); n > 0; --n) {
+            RxMessage* msg = rx_queue.Front();
+            if (msg == nullptr)
+                break;
+            int ret = handler(static_cast<const RxMessage&>(*msg));
+            /* Give the buffer back before the slot, so a free slot has a buffer too */
+            if (msg->data != nullptr)
+                rx_pool.Release(msg->data);
+            rx_queue.Pop();
+            if (ret != 0)
+                return ret;
+        }
     }
-    //! Alias to the Write accessor type
-    template<typename ValueType>
-    auto WriteAccess(typename safe::Lockable<ValueType, std::shared_timed_mutex>& value)
-    {
-        return typename safe::Lockable<
-            ValueType, std::shared_timed_mutex>::template WriteAccess<std::unique_lock>{
-            value
-        };
-    }
-};
+    return 0;
+}
 
 } /* namespace fighttrack */
@@ -0,0 +1,311 @@
+/**
+ * \file slot_map.h
+ * \brief Generational handles, slot allocator and slot map.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/**************************************************************************************/
+
+namespace fighttrack {
+
+/**
+ * Handle to a slot, packing the slot index and the generation of the slot.
+ *
+ * The generation changes every time a slot is freed, so a handle kept after its
+ * object is gone no longer matches the slot even if the slot is reused. Handles fit
+ * in a non-negative int, so they are used as client IDs and entity IDs as is.
+ */
+struct SlotHandle {
+    //! Number of bits of the slot index
+    static constexpr unsigned kIndexBits = 20;
+    //! Highest slot index
+    static constexpr uint32_t kMaxIndex = (1u << kIndexBits) - 1;
+    //! Highest generation, it wraps around to 0 after this
+    static constexpr uint32_t kMaxGeneration = (1u << (31 - kIndexBits)) - 1;
+    //! Value of no handle, never returned for a slot
+    static constexpr uint32_t kInvalid = UINT32_MAX;
+
+    /**
+     * \brief Pack a slot index and a generation.
+     */
+    static constexpr uint32_t Make(uint32_t index, uint32_t generation)
+    {
+        return (generation << kIndexBits) | index;
+    }
+
+    /**
+     * \brief Slot index of a handle.
+     */
+    static constexpr uint32_t Index(uint32_t handle) { return handle & kMaxIndex; }
+
+    /**
+     * \brief Generation of a handle.
+     */
+    static constexpr uint32_t Generation(uint32_t handle) { return handle >> kIndexBits; }
+};
+
+/**
+ * Allocator of slot indices with a generation per slot, in O(1).
+ *
+ * Free slots are kept in a stack, so the most recently freed slot, still warm in
+ * cache, is reused first. Slots are created on demand up to the capacity.
+ */
+class SlotAllocator {
+   public:
+    /**
+     * \brief Construct a new Slot Allocator object.
+     * \param capacity Maximum number of slots.
+     */
+    explicit SlotAllocator(size_t capacity = SlotHandle::kMaxIndex + 1)
+    {
+        Reset(capacity);
+    }
+
+    /**
+     * \brief Free all slots and forget their generations.
+     * \param capacity Maximum number of slots, at most SlotHandle::kMaxIndex + 1.
+     */
+    void Reset(size_t capacity)
+    {
+        generations_.clear();
+        free_.clear();
+        capacity_ = (capacity > SlotHandle::kMaxIndex + 1) ? SlotHandle::kMaxIndex + 1
+                                                            : capacity;
+        size_ = 0;
+    }
+
+    /**
+     * \brief  Take a free slot.
+     * \return Slot index, -1 if all slots are in use.
+     */
+    int Allocate()
+    {
+        int slot;
+        if (!free_.empty()) {
+            slot = free_.back();
+            free_.pop_back();
+        }
+        else if (generations_.size() < capacity_) {
+            slot = (int) generations_.size();
+            generations_.push_back(0);
+        }
+        else {
+            return -1;
+        }
+        size_++;
+        return slot;
+    }
+
+    /**
+     * \brief Free a slot in use, invalidating its handles.
+     * \param slot Slot index.
+     */
+    void Free(int slot)
+    {
+        uint32_t& generation = generations_[slot];
+        generation = (generation == SlotHandle::kMaxGeneration) ? 0 : generation + 1;
+        free_.push_back(slot);
+        size_--;
+    }
+
+    /**
+     * \brief Current generation of a slot.
+     */
+    uint32_t Generation(int slot) const { return generations_[slot]; }
+
+    /**
+     * \brief  Handle to a slot in use.
+     * \param  slot Slot index.
+     */
+    uint32_t Handle(int slot) const
+    {
+        return SlotHandle::Make((uint32_t) slot, generations_[slot]);
+    }
+
+    /**
+     * \brief  Get the slot of a handle.
+     * \param  handle Slot handle.
+     * \return Slot index, -1 if the handle is stale or invalid. Free slots are not
+     *         detected, their handles are already stale.
+     */
+    int Find(uint32_t handle) const
+    {
+        const uint32_t slot = SlotHandle::Index(handle);
+        if (slot >= generations_.size() ||
+            generations_[slot] != SlotHandle::Generation(handle) ||
+            handle == SlotHandle::kInvalid) {
+            return -1;
+        }
+        return (int) slot;
+    }
+
+    /**
+     * \brief Number of slots in use.
+     */
+    size_t Size() const { return size_; }
+
+    /**
+     * \brief Maximum number of slots.
+     */
+    size_t Capacity() const { return capacity_; }
+
+   private:
+    std::vector<uint32_t> generations_;  //!< Generation of every slot created
+    std::vector<int> free_;              //!< Stack of free slots
+    size_t capacity_;                    //!< Maximum number of slots
+    size_t size_;                        //!< Number of slots in use
+};
+
+/**
+ * Objects addressed by generational handles, stored contiguously.
+ *
+ * Insert, erase and lookup are O(1). Values are kept packed in insertion order until
+ * an erase moves the last value into the hole, so iterating walks a plain array.
+ * Pointers to values are invalidated by Insert() and Erase().
+ */
+template<typename T>
+class SlotMap {
+   public:
+    /**
+     * \brief Construct a new empty Slot Map object.
+     * \param capacity Maximum number of values.
+     */
+    explicit SlotMap(size_t capacity = SlotHandle::kMaxIndex + 1) : slots_{ capacity } {}
+
+    /**
+     * \brief Remove all values, and forget slot generations.
+     * \param capacity Maximum number of values.
+     */
+    void Reset(size_t capacity)
+    {
+        slots_.Reset(capacity);
+        slot_to_dense_.clear();
+        dense_to_slot_.clear();
+        values_.clear();
+    }
+
+    /**
+     * \brief Allocate memory for a number of values.
+     */
+    void Reserve(size_t count)
+    {
+        slot_to_dense_.reserve(count);
+        dense_to_slot_.reserve(count);
+        values_.reserve(count);
+    }
+
+    /**
+     * \brief  Add a value.
+     * \param  value Value.
+     * \return Handle to the value, SlotHandle::kInvalid if the map is full.
+     */
+    uint32_t Insert(T value)
+    {
+        const int slot = slots_.Allocate();
+        if (slot == -1) {
+            return SlotHandle::kInvalid;
+        }
+        if ((size_t) slot == slot_to_dense_.size()) {
+            slot_to_dense_.push_back(0);
+        }
+        slot_to_dense_[slot] = (uint32_t) values_.size();
+        dense_to_slot_.push_back((uint32_t) slot);
+        values_.push_back(std::move(value));
+        return slots_.Handle(slot);
+    }
+
+    /**
+     * \brief  Remove a value.
+     * \param  handle Handle to the value.
+     * \return true if removed, false if the handle is stale.
+     */
+    bool Erase(uint32_t handle)
+    {
+        const int slot = slots_.Find(handle);
+        if (slot == -1 || !IsLive(slot)) {
+            return false;
+        }
+
+        /* Move the last value into the hole */
+        const uint32_t dense = slot_to_dense_[slot];
+        const uint32_t last = (uint32_t) values_.size() - 1;
+        if (dense != last) {
+            values_[dense] = std::move(values_[last]);
+            dense_to_slot_[dense] = dense_to_slot_[last];
+            slot_to_dense_[dense_to_slot_[dense]] = dense;
+        }
+        values_.pop_back();
+        dense_to_slot_.pop_back();
+        slots_.Free(slot);
+        return true;
+    }
+
+    /**
+     * \brief  Look up a value.
+     * \param  handle Handle to the value.
+     * \return Value, nullptr if the handle is stale.
+     */
+    T* Find(uint32_t handle)
+    {
+        const int slot = slots_.Find(handle);
+        return (slot != -1 && IsLive(slot)) ? &values_[slot_to_dense_[slot]] : nullptr;
+    }
+    const T* Find(uint32_t handle) const
+    {
+        return const_cast<SlotMap*>(this)->Find(handle);
+    }
+
+    /**
+     * \brief  Get the position of a value in the packed array.
+     * \param  handle Handle to the value.
+     * \return Position, -1 if the handle is stale.
+     */
+    int Position(uint32_t handle) const
+    {
+        const int slot = slots_.Find(handle);
+        return (slot != -1 && IsLive(slot)) ? (int) slot_to_dense_[slot] : -1;
+    }
+
+    /**
+     * \brief Handle to the value at a position of the packed array.
+     */
+    uint32_t HandleAt(size_t position) const
+    {
+        return slots_.Handle((int) dense_to_slot_[position]);
+    }
+
+    /**
+     * \brief Number of values.
+     */
+    size_t Size() const { return values_.size(); }
+    bool Empty() const { return values_.empty(); }
+
+    /* Iteration over the packed values, in no particular order */
+    T* begin() { return values_.data(); }
+    T* end() { return values_.data() + values_.size(); }
+    const T* begin() const { return values_.data(); }
+    const T* end() const { return values_.data() + values_.size(); }
+
+   private:
+    /**
+     * \brief Check that a slot holds a value, not just a current generation.
+     */
+    bool IsLive(int slot) const
+    {
+        const uint32_t dense = slot_to_dense_[slot];
+        return dense < dense_to_slot_.size() && dense_to_slot_[dense] == (uint32_t) slot;
+    }
+
+    SlotAllocator slots_;                 //!< Slot indices and generations
+    std::vector<uint32_t> slot_to_dense_;  //!< Position of the value; index: slot
+    std::vector<uint32_t> dense_to_slot_;  //!< Slot of the value; index: position
+    std::vector<T> values_;               //!< Packed values
+};
+
+} /* namespace fighttrack */
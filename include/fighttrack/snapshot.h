@@ -0,0 +1,102 @@
+/**
+ * \file snapshot.h
+ * \brief World snapshots and delta compression.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "fighttrack/protocol.h"
+
+/**************************************************************************************/
+
+namespace fighttrack {
+
+//! Number of snapshots kept as possible delta baselines
+constexpr size_t kSnapshotHistorySize = 32;
+
+/**
+ * State of every entity at a given tick.
+ */
+struct WorldSnapshot {
+    uint32_t sequence = 0;                        //!< Sequence number, 0 if invalid
+    std::vector<protocol::EntityState> entities;  //!< Entity states, sorted by ID
+};
+
+/**
+ * Ring of the most recent snapshots, indexed by sequence number.
+ * Slots are reused, so once warmed up storing a snapshot does not allocate.
+ */
+class SnapshotHistory {
+   public:
+    /**
+     * \brief Construct a new Snapshot History object.
+     * \param capacity Number of snapshots kept.
+     */
+    explicit SnapshotHistory(size_t capacity = kSnapshotHistorySize);
+
+    /**
+     * \brief Get an empty snapshot to be filled, evicting the oldest one.
+     * \param sequence Sequence number of the new snapshot, must not be 0.
+     * \return Snapshot with no entities.
+     */
+    WorldSnapshot& Insert(uint32_t sequence);
+
+    /**
+     * \brief Invalidate a snapshot, e.g. if it could not be filled.
+     */
+    void Discard(uint32_t sequence);
+
+    /**
+     * \brief Find a snapshot by sequence number.
+     * \return Snapshot, nullptr if not in history.
+     */
+    const WorldSnapshot* Find(uint32_t sequence) const;
+
+    /**
+     * \brief Get the snapshot with the highest sequence number.
+     * \return Snapshot, nullptr if history is empty.
+     */
+    const WorldSnapshot* Latest() const { return Find(latest_); }
+
+    /**
+     * \brief Get the highest sequence number stored, 0 if none.
+     */
+    uint32_t LatestSequence() const { return latest_; }
+
+    /**
+     * \brief Get the number of snapshots kept.
+     */
+    size_t Capacity() const { return slots_.size(); }
+
+   private:
+    std::vector<WorldSnapshot> slots_;  //!< Snapshot slots; index: sequence % capacity
+    uint32_t latest_;                   //!< Highest sequence number stored
+};
+
+/**
+ * \brief Encode a snapshot as a delta to a baseline.
+ *
+ * Only entities whose fields changed since the baseline are written, with only
+ * the changed fields. Entities gone since the baseline are written as removed.
+ *
+ * \param out      Output buffer.
+ * \param current  Snapshot to encode.
+ * \param baseline Snapshot known by the receiver, nullptr to encode a keyframe.
+ */
+void EncodeSnapshot(std::string& out, const WorldSnapshot& current,
+                    const WorldSnapshot* baseline);
+
+/**
+ * \brief Decode a snapshot frame and store the resulting snapshot in history.
+ * \param frame   Snapshot frame.
+ * \param history History holding the baseline; receives the decoded snapshot.
+ * \return Sequence number of the decoded snapshot, 0 if the baseline is not in
+ *         history or the frame is malformed.
+ */
+uint32_t DecodeSnapshot(const protocol::Frame& frame, SnapshotHistory& history);
+
+} /* namespace fighttrack */
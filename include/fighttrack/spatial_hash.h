@@ -0,0 +1,132 @@
+/**
+ * \file spatial_hash.h
+ * \brief Uniform-grid spatial hash, the broadphase of entity collisions.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "fighttrack/geometry.h"
+
+/**************************************************************************************/
+
+namespace fighttrack {
+
+//! Side of a spatial hash cell, a few times the size of a fighter
+constexpr int kSpatialHashCellSize = 8;
+
+/**
+ * Boxes bucketed by the grid cell of their top-left corner, rebuilt every tick.
+ *
+ * Boxes are staged with Insert(), then Build() sorts them by bucket with a counting
+ * sort, so each bucket is a contiguous run and a rebuild allocates nothing once the
+ * arrays have grown. Queries widen the area by the largest box inserted, visit the
+ * cells under it, and report each box overlapping the area exactly once: entries
+ * remember their cell, so cells sharing a bucket are told apart.
+ *
+ * Cost is linear in the boxes near the area, as long as the cell size is not much
+ * smaller than the boxes.
+ */
+class SpatialHash {
+   public:
+    /**
+     * \brief Construct a new empty Spatial Hash object.
+     * \param cell_size Side of a grid cell.
+     */
+    explicit SpatialHash(int cell_size = kSpatialHashCellSize);
+
+    /**
+     * \brief Remove all boxes, to insert them again.
+     */
+    void Clear();
+
+    /**
+     * \brief Stage a box. Not visible to queries until Build().
+     * \param id     Identifier reported by queries.
+     * \param bounds Box.
+     */
+    void Insert(uint32_t id, const Rect& bounds);
+
+    /**
+     * \brief Sort the boxes staged into their buckets.
+     */
+    void Build();
+
+    /**
+     * \brief Visit every box overlapping an area.
+     * \param area Area.
+     * \param fn   Called as fn(uint32_t id, const Rect& bounds) for every box.
+     */
+    template<typename Fn>
+    void Query(const Rect& area, Fn fn) const;
+
+    /**
+     * \brief Number of boxes built.
+     */
+    size_t Size() const { return entries_.size(); }
+
+   private:
+    /**
+     * Box in a bucket
+     */
+    struct Entry {
+        uint32_t id;  //!< Identifier
+        int cell_x;   //!< Grid column of the top-left corner
+        int cell_y;   //!< Grid row of the top-left corner
+        Rect bounds;  //!< Box
+    };
+
+    /* Grid cell of a coordinate, rounding down */
+    int CellOf(int value) const
+    {
+        return (value >= 0 ? value : value - cell_size_ + 1) / cell_size_;
+    }
+
+    /* Bucket of a grid cell */
+    size_t BucketOf(int cell_x, int cell_y) const
+    {
+        const uint32_t hash = static_cast<uint32_t>(cell_x) * 73856093u ^
+                              static_cast<uint32_t>(cell_y) * 19349663u;
+        return hash & (starts_.size() - 2);
+    }
+
+    int cell_size_;               //!< Side of a grid cell
+    int max_width_;               //!< Width of the widest box built
+    int max_height_;              //!< Height of the tallest box built
+    std::vector<Entry> staged_;   //!< Boxes inserted since Clear()
+    std::vector<Entry> entries_;  //!< Boxes sorted by bucket
+    //! Start of every bucket in entries_, and the end; size: buckets + 1
+    std::vector<uint32_t> starts_;
+};
+
+/**************************************************************************************/
+
+template<typename Fn>
+void SpatialHash::Query(const Rect& area, Fn fn) const
+{
+    if (entries_.empty() || area.Empty()) {
+        return;
+    }
+    /* Boxes starting up to their size before the area may still reach into it */
+    const int cx_begin = CellOf(area.x - max_width_ + 1);
+    const int cy_begin = CellOf(area.y - max_height_ + 1);
+    const int cx_end = CellOf(area.Right() - 1);
+    const int cy_end = CellOf(area.Bottom() - 1);
+    for (int cy = cy_begin; cy <= cy_end; ++cy) {
+        for (int cx = cx_begin; cx <= cx_end; ++cx) {
+            const size_t bucket = BucketOf(cx, cy);
+            for (uint32_t e = starts_[bucket]; e < starts_[bucket + 1]; ++e) {
+                const Entry& entry = entries_[e];
+                if (entry.cell_x == cx && entry.cell_y == cy &&
+                    entry.bounds.Intersects(area)) {
+                    fn(entry.id, entry.bounds);
+                }
+            }
+        }
+    }
+}
+
+} /* namespace fighttrack */
@@ -0,0 +1,72 @@
+/**
+ * \file sprite_registry.h
+ * \brief Registry of immutable sprites shared by all entities.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "fighttrack/ascii_art.h"
+
+/**************************************************************************************/
+
+namespace fighttrack {
+
+//! Handle to a sprite of the Sprite Registry
+using SpriteId = uint16_t;
+
+/**
+ * Sprites registered once and then only read, referenced by a SpriteId.
+ *
+ * Entities store the ID of their current graphics instead of a copy of the art, so
+ * changing graphics is a plain store, and drawing and collision look the art up by
+ * ID. Registering allocates; it is meant for load time, not for the game loop.
+ * Not thread-safe: each process runs its game loop on one thread.
+ */
+class SpriteRegistry {
+   public:
+    //! Empty sprite, always registered
+    static constexpr SpriteId kNone = 0;
+
+    /**
+     * \brief Get the registry of the process.
+     */
+    static SpriteRegistry& Global();
+
+    /**
+     * \brief  Add a sprite.
+     * \param  art Sprite graphics.
+     * \return ID of the sprite, kNone if the registry is full.
+     */
+    SpriteId Register(AsciiArt art);
+
+    /**
+     * \brief  Get a sprite.
+     * \param  id Sprite ID.
+     * \return Sprite graphics, the empty sprite if the ID is unknown.
+     */
+    const AsciiArt& Get(SpriteId id) const
+    {
+        return sprites_[id < sprites_.size() ? id : kNone];
+    }
+
+    /**
+     * \brief Number of sprites, kNone included.
+     */
+    size_t Size() const { return sprites_.size(); }
+
+   private:
+    /**
+     * \brief Construct a new Sprite Registry object, holding only kNone.
+     */
+    SpriteRegistry();
+
+    //! Sprites; index: sprite ID. A deque keeps references valid while registering
+    std::deque<AsciiArt> sprites_;
+};
+
+} /* namespace fighttrack */
@@ -0,0 +1,129 @@
+/**
+ * \file spsc_queue.h
+ * \brief Bounded lock-free single-producer/single-consumer queue.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <atomic>
+#include <vector>
+
+/**************************************************************************************/
+
+namespace fighttrack {
+
+/**
+ * Ring of preallocated slots shared by exactly one producer thread and one consumer
+ * thread.
+ *
+ * Elements are written and read in place: the producer fills the slot returned by
+ * BeginPush() and publishes it with CommitPush(), the consumer reads Front() and
+ * releases it with Pop(). Slots are never destroyed, so members such as strings keep
+ * their capacity and a warmed up queue does not allocate.
+ */
+template<typename T>
+class SpscQueue {
+   public:
+    /**
+     * \brief Construct a new SPSC Queue object.
+     * \param capacity Number of slots, rounded up to a power of two.
+     */
+    explicit SpscQueue(size_t capacity = 0) { Reset(capacity); }
+
+    /**
+     * \brief Reallocate the slots and empty the queue. Not thread-safe.
+     * \param capacity Number of slots, rounded up to a power of two.
+     */
+    void Reset(size_t capacity)
+    {
+        size_t size = 1;
+        while (size < capacity)
+            size <<= 1;
+        slots_.clear();
+        slots_.resize(capacity ? size : 0);
+        mask_ = size - 1;
+        head_ = 0;
+        tail_ = 0;
+        producer_head_ = 0;
+        consumer_tail_ = 0;
+    }
+
+    /**
+     * \brief  Get the next free slot. (producer only)
+     * \return Slot to fill, nullptr if the queue is full.
+     */
+    T* BeginPush()
+    {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - producer_head_ == slots_.size()) {
+            producer_head_ = head_.load(std::memory_order_acquire);
+            if (tail - producer_head_ == slots_.size())
+                return nullptr;
+        }
+        return &slots_[tail & mask_];
+    }
+
+    /**
+     * \brief Publish the slot returned by BeginPush(). (producer only)
+     */
+    void CommitPush()
+    {
+        tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /**
+     * \brief  Get the oldest element. (consumer only)
+     * \return Element, nullptr if the queue is empty.
+     */
+    T* Front()
+    {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (head == consumer_tail_) {
+            consumer_tail_ = tail_.load(std::memory_order_acquire);
+            if (head == consumer_tail_)
+                return nullptr;
+        }
+        return &slots_[head & mask_];
+    }
+
+    /**
+     * \brief Release the element returned by Front(). (consumer only)
+     */
+    void Pop()
+    {
+        head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /**
+     * \brief Number of elements queued. Approximate if called while in use.
+     */
+    size_t Size() const
+    {
+        const size_t head = head_.load(std::memory_order_acquire);
+        return tail_.load(std::memory_order_acquire) - head;
+    }
+
+    /**
+     * \brief Number of slots.
+     */
+    size_t Capacity() const { return slots_.size(); }
+
+   private:
+    //! Size of a cache line, indices are kept apart to avoid false sharing
+    static constexpr size_t kCacheLine = 64;
+
+    std::vector<T> slots_;  //!< Preallocated slots
+    size_t mask_;           //!< Capacity - 1, for wrapping indices
+
+    std::atomic<size_t> head_;  //!< Next slot to read, written by the consumer
+    char head_pad_[kCacheLine - sizeof(std::atomic<size_t>)];
+    size_t consumer_tail_;  //!< Consumer's cached copy of tail_
+    char consumer_pad_[kCacheLine - sizeof(size_t)];
+
+    std::atomic<size_t> tail_;  //!< Next slot to write, written by the producer
+    char tail_pad_[kCacheLine - sizeof(std::atomic<size_t>)];
+    size_t producer_head_;  //!< Producer's cached copy of head_
+};
+
+} /* namespace fighttrack */
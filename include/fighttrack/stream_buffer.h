@@ -0,0 +1,114 @@
+/**
+ * \file stream_buffer.h
+ * \brief Reassembly of protocol frames from a byte stream.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "fighttrack/protocol.h"
+
+/**************************************************************************************/
+
+namespace fighttrack {
+
+/**
+ * Per-connection reassembly buffer.
+ *
+ * TCP may split a frame across reads or merge several frames into one. Chunks are
+ * fed in as they are received and every complete frame is handed to a callback.
+ * Frames that lie entirely inside a chunk are handed up as views into that chunk,
+ * without copying. Only the bytes of a frame that straddles two chunks are copied
+ * into the internal buffer, and the frame is handed up from there once complete.
+ */
+class StreamBuffer {
+   public:
+    /**
+     * \brief Construct a new Stream Buffer object.
+     */
+    StreamBuffer() = default;
+
+    /**
+     * \brief Destroy the Stream Buffer object.
+     */
+    ~StreamBuffer() = default;
+
+    /**
+     * \brief Feed received bytes and handle every frame completed by them.
+     * \param data    Received bytes.
+     * \param size    Number of received bytes.
+     * \param handler Callable as `handler(const protocol::Frame&)`. The frame is only
+     *                valid during the call.
+     * \return 0 on success, negative if the stream is malformed. The buffer is
+     *         cleared on error.
+     */
+    template<typename Handler>
+    int Feed(const char* data, size_t size, Handler&& handler);
+
+    /**
+     * \brief Discard any partial frame.
+     */
+    void Clear() { pending_.clear(); }
+
+    /**
+     * \brief Number of bytes held waiting for the rest of a frame.
+     */
+    size_t Pending() const { return pending_.size(); }
+
+   private:
+    /**
+     * \brief Move bytes into the pending frame until it is complete.
+     * \param data  Received bytes, advanced past the consumed bytes.
+     * \param size  Number of received bytes, decreased by the consumed bytes.
+     * \param frame Output frame view, set when the pending frame is complete.
+     * \return Positive if the frame is complete, 0 if more data is needed,
+     *         negative if the stream is malformed.
+     */
+    int FillPending(const char*& data, size_t& size, protocol::Frame* frame);
+
+    std::vector<char> pending_;  //!< Bytes of a frame split across chunks
+};
+
+/**************************************************************************************/
+
+template<typename Handler>
+int StreamBuffer::Feed(const char* data, size_t size, Handler&& handler)
+{
+    /* Complete the frame left over from a previous chunk */
+    if (!pending_.empty()) {
+        protocol::Frame frame;
+        int ret = FillPending(data, size, &frame);
+        if (ret < 0) {
+            Clear();
+            return -1;
+        }
+        if (ret == 0) {
+            return 0;
+        }
+        handler(static_cast<const protocol::Frame&>(frame));
+        pending_.clear();
+    }
+
+    /* Hand up whole frames straight from the chunk */
+    while (size > 0) {
+        protocol::Frame frame;
+        int len = protocol::ParseFrame(data, size, &frame);
+        if (len < 0) {
+            return -1;
+        }
+        if (len == 0) {
+            /* Keep the partial frame for the next chunk */
+            pending_.assign(data, data + size);
+            break;
+        }
+        handler(static_cast<const protocol::Frame&>(frame));
+        data += len;
+        size -= len;
+    }
+
+    return 0;
+}
+
+} /* namespace fighttrack */
@@ -0,0 +1,97 @@
+/**
+ * \file udp_socket.h
+ * \brief UDP Socket API.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <random>
+
+#include <netinet/in.h>
+
+/**************************************************************************************/
+
+namespace fighttrack {
+
+/**
+ * Non-blocking datagram socket used for unreliable traffic.
+ *
+ * For testing under packet loss, the environment variable FIGHTTRACK_UDP_LOSS can
+ * be set to a percentage (0~100) of outgoing datagrams to drop.
+ */
+class UdpSocket {
+   public:
+    /**
+     * \brief Construct a new UDP Socket object
+     */
+    UdpSocket();
+
+    /**
+     * \brief Destroy the UDP Socket object
+     */
+    ~UdpSocket();
+
+    /**
+     * \brief Create a socket bound to a local port, to receive from any peer.
+     * \param port Local port.
+     * \return 0 on success, negative if error.
+     */
+    int Initialize(const uint16_t port);
+
+    /**
+     * \brief Create a socket connected to a remote peer.
+     * \param server_addr Server address.
+     * \param port Server port.
+     * \return 0 on success, negative if error.
+     */
+    int Initialize(const std::string& server_addr, const uint16_t port);
+
+    /**
+     * \brief Close the socket.
+     */
+    void Terminate();
+
+    /**
+     * \brief Send a datagram.
+     * \param to   Destination address, nullptr to send to the connected peer.
+     * \param data Datagram content.
+     * \param size Datagram size.
+     * \return 0 on success (or if dropped by the loss shim), negative if error.
+     */
+    int Send(const struct sockaddr_in* to, const char* data, size_t size);
+
+    /**
+     * \brief Try to read a datagram. (non-blocking)
+     * \param buffer Output buffer.
+     * \param size   Output buffer size.
+     * \param from   Output source address, may be nullptr.
+     * \return Size of the datagram, 0 if none available, negative if error.
+     */
+    int Receive(char* buffer, size_t size, struct sockaddr_in* from);
+
+    /**
+     * \brief Set the percentage of outgoing datagrams to drop. (testing only)
+     */
+    void SetLossPercent(int percent) { loss_percent_ = percent; }
+
+   private:
+    /**
+     * \brief Create the socket and apply common configuration.
+     * \return 0 on success, negative if error.
+     */
+    int Open();
+
+    //! Flag indicating if socket is initialized
+    bool initialized_;
+    //! Datagram socket
+    int socket_;
+    //! Percentage of outgoing datagrams dropped on purpose
+    int loss_percent_;
+    //! Random generator for the loss shim
+    std::minstd_rand loss_rng_;
+};
+
+} /* namespace fighttrack */
@@ -0,0 +1,218 @@
+/**
+ * \file uring_reactor.h
+ * \brief Server Socket event loop based on io_uring.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+#include "fighttrack/server_reactor.h"
+
+/**************************************************************************************/
+
+namespace fighttrack {
+
+/**
+ * Reactor submitting the socket I/O itself to the kernel with io_uring.
+ *
+ * A single multishot accept produces all new connections, and a multishot recv per
+ * client reads into buffers picked by the kernel from a ring of provided buffers, so
+ * neither needs to be re-submitted per event. Sends are SENDMSG requests of the
+ * gathered TX queue, one in flight per client. All requests made in an iteration are
+ * submitted with the same io_uring_enter() call that waits for completions.
+ *
+ * Needs Linux 6.0 or newer for multishot recv and provided buffer rings.
+ */
+class UringReactor : public ServerReactor {
+   public:
+    /**
+     * \brief Construct a new Uring Reactor object.
+     * \param options Server socket options.
+     * \param index   Reactor index.
+     * \param count   Number of reactors.
+     */
+    UringReactor(const Options& options, int index, int count);
+
+    /**
+     * \brief Destroy the Uring Reactor object.
+     */
+    ~UringReactor() override;
+
+   protected:
+    int Setup() override;
+    void Teardown() override;
+    void EventLoop() override;
+    void RemoveClient(int slot) override;
+    void FlushClientOutput(int slot) override;
+
+   private:
+    /* Kind of request, stored in the user data of its submission */
+    enum class Op : uint8_t {
+        ACCEPT = 1,  //!< Multishot accept on the listening socket
+        WAKE = 2,    //!< Multishot poll on the event FD
+        RECV = 3,    //!< Multishot recv on a client socket
+        SEND = 4,    //!< Sendmsg on a client socket
+        CANCEL = 5,  //!< Cancellation of all requests
+    };
+
+    /* io_uring state of a client, indexed by client slot like clients_ */
+    struct UringClient {
+        uint32_t generation;   //!< Bumped on removal, to discard stale completions
+        bool recv_armed;       //!< Flag indicating a recv request is active
+        bool removed;          //!< Flag indicating the client is gone, slot not freed
+        bool disconnect_held;  //!< Flag indicating DISCONNECTED waits in deferred_
+        struct msghdr msg;     //!< Message of the send in flight
+        std::vector<struct iovec> iov;  //!< Data of the send in flight
+    };
+
+    /* Event held because the RX queue was full. The slot is not released before its
+     * DISCONNECTED event is posted, so the client ID of every event stays valid */
+    struct DeferredEvent {
+        RxStatus status;  //!< Event status
+        int slot;         //!< Client slot
+        int buffer_id;    //!< Provided buffer holding NEW_DATA, -1 otherwise
+        uint32_t size;    //!< Number of bytes received
+    };
+
+    /**
+     * \brief  Map the submission and completion rings.
+     * \param  params Parameters returned by io_uring_setup().
+     * \return 0 on sucess, negative if error.
+     */
+    int MapRings(const struct io_uring_params& params);
+
+    /**
+     * \brief  Allocate the provided buffers and register their ring.
+     * \return 0 on sucess, negative if error.
+     */
+    int SetupBufferRing();
+
+    /**
+     * \brief  Get the next submission entry, cleared.
+     *         Submits the pending entries first if the queue is full.
+     * \param  op   Request kind.
+     * \param  slot Client slot, 0 if not a client request.
+     * \return Submission entry, nullptr if the queue is still full.
+     */
+    struct io_uring_sqe* GetSqe(Op op, int slot);
+
+    /**
+     * \brief  Submit pending entries and optionally wait for completions.
+     * \param  wait_nr Number of completions to wait for.
+     * \return 0 on sucess, negative if error.
+     */
+    int Submit(unsigned wait_nr);
+
+    /**
+     * \brief  Handle all available completions.
+     * \param  dispatch Call the handlers, or only account for finished requests.
+     * \return 0 on sucess, 1 if asked to terminate.
+     */
+    int ReapCompletions(bool dispatch);
+
+    void ArmAccept();
+    void ArmWake();
+    void ArmRecv(int slot);
+
+    void OnAccept(int res, unsigned flags);
+    int OnWake(unsigned flags);
+    void OnRecv(int slot, uint32_t generation, int res, unsigned flags);
+    void OnSend(int slot, int res);
+
+    /**
+     * \brief Cancel the requests on a client socket, before it is closed.
+     *        Submits them first, along with the cancellation, so none reaches the
+     *        kernel after the descriptor number is reused.
+     * \param slot Client slot.
+     */
+    void CancelRequests(int slot);
+
+    /**
+     * \brief Give a provided buffer back to the kernel.
+     * \param buffer_id Provided buffer ID.
+     */
+    void RecycleBuffer(int buffer_id);
+
+    /**
+     * \brief  Post an event for the API client, or hold it after the events held.
+     * \param  status    Event status.
+     * \param  slot      Client slot.
+     * \param  buffer_id Provided buffer holding NEW_DATA, -1 otherwise.
+     * \param  size      Number of bytes received.
+     * \return true if posted, false if held.
+     */
+    bool PostOrHold(RxStatus status, int slot, int buffer_id, uint32_t size);
+
+    /**
+     * \brief Post the held events in order, as long as the RX queue has room.
+     *        Re-arms the recv requests stopped meanwhile once all is posted.
+     */
+    void DrainDeferred();
+
+    /**
+     * \brief Release the slot of a removed client, once nothing refers to it anymore:
+     *        no send in flight, and its DISCONNECTED event posted.
+     * \param slot Client slot.
+     */
+    void ReleaseRemoved(int slot);
+
+    //! Number of provided receive buffers, a power of two
+    static constexpr unsigned kNumBuffers = 256;
+    //! Size of a provided receive buffer, data is then copied to an RX pool buffer
+    static constexpr unsigned kBufferSize = RxBufferPool::kBufferSize;
+    //! Buffer group ID of the provided buffer ring
+    static constexpr uint16_t kBufferGroup = 0;
+    //! Maximum number of messages gathered in a send. There is a single send in
+    //! flight per client, so this bounds what a client gets per loop iteration.
+    static constexpr size_t kMaxSendIov = 256;
+
+    //! io_uring file descriptor
+    int ring_fd_;
+    //! Features reported by the kernel
+    uint32_t features_;
+
+    /* Submission queue ring */
+    void* sq_ring_;            //!< Mapped submission ring
+    size_t sq_ring_size_;      //!< Size of the submission ring mapping
+    struct io_uring_sqe* sqes_;  //!< Mapped submission entries
+    size_t sqes_size_;         //!< Size of the submission entries mapping
+    unsigned* sq_head_;        //!< Consumed by the kernel
+    unsigned* sq_tail_;        //!< Published to the kernel
+    unsigned* sq_array_;       //!< Indirection array to the entries
+    unsigned sq_mask_;         //!< Number of entries - 1
+    unsigned sq_entries_;      //!< Number of entries
+    unsigned sq_local_tail_;   //!< Next entry to fill, not published yet
+    unsigned sq_to_submit_;    //!< Entries filled since the last submission
+
+    /* Completion queue ring */
+    void* cq_ring_;                //!< Mapped completion ring, may be sq_ring_
+    size_t cq_ring_size_;          //!< Size of the completion ring mapping
+    unsigned* cq_head_;            //!< Consumed by us
+    unsigned* cq_tail_;            //!< Produced by the kernel
+    unsigned cq_mask_;             //!< Number of entries - 1
+    struct io_uring_cqe* cqes_;    //!< Completion entries
+
+    /* Provided receive buffers */
+    struct io_uring_buf_ring* buf_ring_;  //!< Ring of free buffers, shared with kernel
+    size_t buf_ring_size_;                //!< Size of the buffer ring mapping
+    char* buffers_;                       //!< Memory of the buffers
+    uint16_t buf_tail_;                   //!< Next free entry of the buffer ring
+
+    //! io_uring state of clients; index: client slot
+    std::vector<UringClient> uring_clients_;
+    //! Events waiting for room in the RX queue, in order from deferred_head_
+    std::vector<DeferredEvent> deferred_;
+    size_t deferred_head_;
+    //! Client slots whose recv ended and must be re-armed
+    std::vector<int> rearm_slots_;
+    //! Number of requests which will still produce a completion
+    size_t inflight_;
+};
+
+} /* namespace fighttrack */
@@ -0,0 +1,273 @@
+/**
+ * \file ansi_canvas.cc
+ * \brief Canvas written to the terminal with ANSI escape sequences, without ncurses.
+ */
+
+#include "fighttrack/ansi_canvas.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <algorithm>
+#include <unistd.h>
+
+/**************************************************************************************/
+
+namespace fighttrack {
+
+/* Number of bytes of a character in UTF-8 */
+static size_t Utf8Length(wchar_t wc)
+{
+    const uint32_t code = static_cast<uint32_t>(wc);
+    return (code < 0x80) ? 1 : (code < 0x800) ? 2 : (code < 0x10000) ? 3 : 4;
+}
+
+/* Append a character in UTF-8 */
+static void AppendUtf8(std::string& out, wchar_t wc)
+{
+    const uint32_t code = static_cast<uint32_t>(wc);
+    switch (Utf8Length(wc)) {
+        case 1: out += static_cast<char>(code); break;
+        case 2:
+            out += static_cast<char>(0xC0 | (code >> 6));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+            break;
+        case 3:
+            out += static_cast<char>(0xE0 | (code >> 12));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+            break;
+        default:
+            out += static_cast<char>(0xF0 | (code >> 18));
+            out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+            break;
+    }
+}
+
+/* Number of decimal digits of a positive number */
+static size_t Digits(int value)
+{
+    size_t digits = 1;
+    for (; value >= 10; value /= 10) {
+        digits++;
+    }
+    return digits;
+}
+
+/**************************************************************************************/
+
+bool AnsiCanvas::Cell::operator==(const Cell& other) const
+{
+    if (width != other.width) {
+        return false;
+    }
+    for (int i = 0; i <= CCHARW_MAX; ++i) {
+        if (text[i] != other.text[i]) {
+            return false;
+        }
+        if (text[i] == L'\0') {
+            break;
+        }
+    }
+    return true;
+}
+
+/**************************************************************************************/
+
+AnsiCanvas::AnsiCanvas(int fd, const Rect& area)
+    : fd_{ fd }, area_{ area }, back_{}, front_{}, out_{}, cursor_x_{ -1 },
+      cursor_y_{ -1 }, frames_written_{ 0 }, bytes_written_{ 0 }
+{
+    area_.width = std::max(area_.width, 0);
+    area_.height = std::max(area_.height, 0);
+    back_.assign(area_.width * area_.height, Cell{ { L' ' }, 1 });
+    front_.resize(back_.size());
+    Invalidate();
+}
+
+/**************************************************************************************/
+
+void AnsiCanvas::Put(int pos_x, int pos_y, const cchar_t* cells, const uint8_t* widths,
+                     size_t count)
+{
+    if (pos_y < 0 || pos_y >= area_.height) {
+        return;
+    }
+    for (size_t i = 0; i < count && pos_x < area_.width; pos_x += widths[i++]) {
+        if (pos_x < 0) {
+            continue;
+        }
+        Cell cell{ {}, static_cast<int8_t>(widths[i]) };
+        attr_t attrs;
+        short pair;
+        getcchar(&cells[i], cell.text, &attrs, &pair, nullptr);
+        Set(pos_x, pos_y, cell);
+    }
+}
+
+/**************************************************************************************/
+
+void AnsiCanvas::Clear(const Rect& area)
+{
+    const Rect clipped = area.Intersection({ 0, 0, area_.width, area_.height });
+    for (int y = clipped.y; y < clipped.Bottom(); ++y) {
+        for (int x = clipped.x; x < clipped.Right(); ++x) {
+            Set(x, y, Cell{ { L' ' }, 1 });
+        }
+    }
+}
+
+/**************************************************************************************/
+
+void AnsiCanvas::Border()
+{
+    const int right = area_.width - 1;
+    const int bottom = area_.height - 1;
+    if (right < 1 || bottom < 1) {
+        return;
+    }
+    for (int x = 1; x < right; ++x) {
+        Set(x, 0, Cell{ { L'─' }, 1 });
+        Set(x, bottom, Cell{ { L'─' }, 1 });
+    }
+    for (int y = 1; y < bottom; ++y) {
+        Set(0, y, Cell{ { L'│' }, 1 });
+        Set(right, y, Cell{ { L'│' }, 1 });
+    }
+    Set(0, 0, Cell{ { L'┌' }, 1 });
+    Set(right, 0, Cell{ { L'┐' }, 1 });
+    Set(0, bottom, Cell{ { L'└' }, 1 });
+    Set(right, bottom, Cell{ { L'┘' }, 1 });
+}
+
+/**************************************************************************************/
+
+void AnsiCanvas::Present()
+{
+    /* Changed cells, in order; right halves of wide cells go with their left half */
+    out_.clear();
+    const int width = area_.width;
+    for (int y = 0; y < area_.height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            const size_t i = y * width + x;
+            if (back_[i] == front_[i] || back_[i].width == 0) {
+                continue;
+            }
+            MoveCursor(x, y);
+            AppendCell(back_[i]);
+            front_[i] = back_[i];
+            if (back_[i].width == 2) {
+                front_[i + 1] = back_[i + 1];
+                x++;
+            }
+            /* Past the right edge the terminal may wrap, or not */
+            cursor_x_ = (x + 1 < width) ? x + 1 : -1;
+        }
+    }
+    if (out_.empty()) {
+        return;
+    }
+
+    size_t written = 0;
+    while (written < out_.size()) {
+        const ssize_t ret = write(fd_, out_.data() + written, out_.size() - written);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Failed to write to the terminal");
+            Invalidate();
+            return;
+        }
+        written += ret;
+    }
+    frames_written_++;
+    bytes_written_ += written;
+}
+
+/**************************************************************************************/
+
+void AnsiCanvas::Invalidate()
+{
+    std::fill(front_.begin(), front_.end(), Cell{ {}, -1 });
+    cursor_x_ = -1;
+    cursor_y_ = -1;
+}
+
+/**************************************************************************************/
+
+void AnsiCanvas::Set(int pos_x, int pos_y, const Cell& cell)
+{
+    const Cell kBlank{ { L' ' }, 1 };
+    Cell* row = &back_[pos_y * area_.width];
+    const int right = area_.width - 1;
+
+    /* Break up the wide cell written over, if any */
+    if (row[pos_x].width == 0 && pos_x > 0) {
+        row[pos_x - 1] = kBlank;
+    }
+    if (row[pos_x].width == 2 && cell.width != 2 && pos_x < right) {
+        row[pos_x + 1] = kBlank;
+    }
+    if (cell.width == 2) {
+        if (pos_x == right) {
+            row[pos_x] = kBlank;  // no room for it
+            return;
+        }
+        if (row[pos_x + 1].width == 2 && pos_x + 1 < right) {
+            row[pos_x + 2] = kBlank;
+        }
+        row[pos_x + 1] = Cell{ {}, 0 };
+    }
+    row[pos_x] = cell;
+}
+
+/**************************************************************************************/
+
+void AnsiCanvas::MoveCursor(int pos_x, int pos_y)
+{
+    if (pos_x == cursor_x_ && pos_y == cursor_y_) {
+        return;
+    }
+    /* Cheapest of: jumping there, moving forward, or writing the cells in between */
+    const int row = area_.y + pos_y + 1;
+    const int column = area_.x + pos_x + 1;
+    const size_t jump_length = 4 + Digits(row) + Digits(column);
+    size_t forward_length = SIZE_MAX;
+    size_t rewrite_length = SIZE_MAX;
+    if (pos_y == cursor_y_ && cursor_x_ >= 0 && pos_x > cursor_x_) {
+        forward_length = 3 + Digits(pos_x - cursor_x_);
+        rewrite_length = 0;
+        for (int x = cursor_x_; x < pos_x; ++x) {
+            for (const wchar_t* wc = front_[pos_y * area_.width + x].text; *wc; ++wc) {
+                rewrite_length += Utf8Length(*wc);
+            }
+        }
+    }
+    if (rewrite_length <= std::min(forward_length, jump_length)) {
+        for (int x = cursor_x_; x < pos_x; ++x) {
+            AppendCell(front_[pos_y * area_.width + x]);
+        }
+    }
+    else if (forward_length <= jump_length) {
+        out_ += "\x1b[" + std::to_string(pos_x - cursor_x_) + "C";
+    }
+    else {
+        out_ += "\x1b[" + std::to_string(row) + ";" + std::to_string(column) + "H";
+    }
+    cursor_x_ = pos_x;
+    cursor_y_ = pos_y;
+}
+
+/**************************************************************************************/
+
+void AnsiCanvas::AppendCell(const Cell& cell)
+{
+    for (const wchar_t* wc = cell.text; *wc; ++wc) {
+        AppendUtf8(out_, *wc);
+    }
+}
+
+} /* namespace fighttrack */
@@ -5,51 +5,209 @@
 
 #include "fighttrack/ascii_art.h"
 
+#include <cstdint>
+#include <cwchar>
+#include <algorithm>
+
 /**************************************************************************************/
 
 namespace fighttrack {
 
+/* Check if a byte continues a UTF-8 sequence, rather than starting a character */
+static bool IsContinuation(char c)
+{
+    return (static_cast<uint8_t>(c) & 0xC0) == 0x80;
+}
+
+/* Decode the character at the start of UTF-8 text; malformed bytes decode one at a time
+ * as U+FFFD. Returns the number of bytes decoded. */
+static size_t DecodeUtf8(const char* text, size_t length, wchar_t* wc)
+{
+    const uint8_t lead = static_cast<uint8_t>(text[0]);
+    const size_t size = (lead < 0x80)          ? 1
+                        : ((lead >> 5) == 0x6)  ? 2
+                        : ((lead >> 4) == 0xE)  ? 3
+                        : ((lead >> 3) == 0x1E) ? 4
+                                                : 0;
+    if (size == 0 || size > length) {
+        *wc = 0xFFFD;
+        return 1;
+    }
+    uint32_t code = (size == 1) ? lead : lead & (0x7F >> size);
+    for (size_t i = 1; i < size; ++i) {
+        if (!IsContinuation(text[i])) {
+            *wc = 0xFFFD;
+            return 1;
+        }
+        code = (code << 6) | (static_cast<uint8_t>(text[i]) & 0x3F);
+    }
+    *wc = static_cast<wchar_t>(code);
+    return size;
+}
+
+/* Display width of a character; ones the locale can't tell take one column */
+static int CharWidth(wchar_t wc)
+{
+    const int width = wcwidth(wc);
+    return (width < 1) ? 1 : width;
+}
+
+/* Decode a character of UTF-8 text into a cell, along with the zero-width characters
+ * following it. Returns the number of bytes decoded. */
+static size_t DecodeCell(const char* text, size_t length, cchar_t* cell, uint8_t* width)
+{
+    wchar_t chars[CCHARW_MAX + 1] = {};
+    size_t used = DecodeUtf8(text, length, &chars[0]);
+    *width = CharWidth(chars[0]);
+    for (int n = 1; n < CCHARW_MAX && used < length; ++n) {
+        wchar_t wc;
+        const size_t size = DecodeUtf8(text + used, length - used, &wc);
+        if (wcwidth(wc) != 0) {
+            break;
+        }
+        chars[n] = wc;
+        used += size;
+    }
+    setcchar(cell, chars, A_NORMAL, 0, nullptr);
+    return used;
+}
+
+/* Draw cells on a line of the canvas, only the ones entirely inside a rectangle */
+static void DrawCells(Canvas& canvas, int pos_x, int pos_y, const cchar_t* cells,
+                      const uint8_t* widths, size_t count, const Rect& clip)
+{
+    size_t begin = 0;
+    int x = pos_x;
+    while (begin < count && x < clip.x) {
+        x += widths[begin++];
+    }
+    const int begin_x = x;
+    size_t end = begin;
+    while (end < count && x + widths[end] <= clip.Right()) {
+        x += widths[end++];
+    }
+    if (begin < end) {
+        canvas.Put(begin_x, pos_y, cells + begin, widths + begin, end - begin);
+    }
+}
+
+/**************************************************************************************/
+
 AsciiArt::AsciiArt(std::vector<std::string> chars)
-    : matrix_{ chars }, max_x_{ 0 }, max_y_{ 0 }
+    : max_x_{ 0 }, max_y_{ 0 }, cells_{}, widths_{}, spans_{}, row_spans_{}
 {
-    max_y_ = matrix_.size();
-    for (const auto& seq : matrix_) {
-        if (max_x_ < seq.size()) {
-            max_x_ = seq.size();
+    max_y_ = chars.size();
+    row_spans_.reserve(chars.size() + 1);
+    for (const auto& row : chars) {
+        row_spans_.push_back(spans_.size());
+
+        /* Split the row at spaces, decoding the runs in between */
+        int x = 0;
+        for (size_t i = 0; i < row.length();) {
+            if (row[i] == ' ') {
+                x++, i++;
+                continue;
+            }
+            Span span{ x, 0, (uint32_t) cells_.size(), 0 };
+            while (i < row.length() && row[i] != ' ') {
+                cchar_t cell;
+                uint8_t width;
+                i += DecodeCell(&row[i], row.length() - i, &cell, &width);
+                cells_.push_back(cell);
+                widths_.push_back(width);
+                span.width += width;
+            }
+            span.length = cells_.size() - span.offset;
+            x += span.width;
+            spans_.push_back(span);
         }
+        max_x_ = std::max(max_x_, x);
     }
+    row_spans_.push_back(spans_.size());
 }
 
 /**************************************************************************************/
 
-void AsciiArt::Draw(int pos_x, int pos_y, WINDOW* win)
+void AsciiArt::Draw(int pos_x, int pos_y, Canvas& canvas) const
 {
-    for (size_t y = 0; y < matrix_.size(); ++y) {
-        const auto& chars = matrix_[y];
+    Draw(pos_x, pos_y, canvas, Rect{ 0, 0, canvas.GetWidth(), canvas.GetHeight() });
+}
 
-        for (size_t x = 0; x < chars.length();) {
-            size_t x_end = chars.find_first_of(' ', x);
-            x_end = (x_end == std::string::npos ? chars.length() : x_end);
+/**************************************************************************************/
 
-            size_t length = x_end - x;
-            if (length > 0) {
-                mvwaddnstr(win, pos_y + y, pos_x + x, &chars[x], length);
+void AsciiArt::Draw(int pos_x, int pos_y, Canvas& canvas, const Rect& clip) const
+{
+    const int y_begin = std::max(0, clip.y - pos_y);
+    const int y_end = std::min(max_y_, clip.Bottom() - pos_y);
+    for (int y = y_begin; y < y_end; ++y) {
+        for (uint32_t s = row_spans_[y]; s < row_spans_[y + 1]; ++s) {
+            const Span& span = spans_[s];
+            const int x = pos_x + span.x;
+            if (x >= clip.x && x + span.width <= clip.Right()) {
+                canvas.Put(x, pos_y + y, &cells_[span.offset], &widths_[span.offset],
+                           span.length);
+            }
+            else if (x < clip.Right() && x + span.width > clip.x) {
+                DrawCells(canvas, x, pos_y + y, &cells_[span.offset],
+                          &widths_[span.offset], span.length, clip);
             }
-
-            x += length + 1;
         }
     }
 }
 
 /**************************************************************************************/
 
-char AsciiArt::GetChar(int pos_x, int pos_y)
+wchar_t AsciiArt::GetChar(int pos_x, int pos_y) const
 {
     /* Check boundaries */
-    if (pos_y >= matrix_.size() || pos_x >= matrix_[pos_y].length()) {
-        return '\0';
+    if (pos_x < 0 || pos_y < 0 || pos_y >= max_y_) {
+        return L'\0';
+    }
+    for (uint32_t s = row_spans_[pos_y]; s < row_spans_[pos_y + 1]; ++s) {
+        const Span& span = spans_[s];
+        if (pos_x < span.x) {
+            return L' ';
+        }
+        if (pos_x >= span.x + span.width) {
+            continue;
+        }
+        /* Find the cell covering the column */
+        int x = span.x;
+        uint32_t c = span.offset;
+        while (x + widths_[c] <= pos_x) {
+            x += widths_[c++];
+        }
+        wchar_t chars[CCHARW_MAX + 1];
+        attr_t attrs;
+        short pair;
+        getcchar(&cells_[c], chars, &attrs, &pair, nullptr);
+        return chars[0];
+    }
+    return (pos_x < max_x_) ? L' ' : L'\0';
+}
+
+/**************************************************************************************/
+
+void DrawClipped(Canvas& canvas, int pos_x, int pos_y, const char* text, size_t length,
+                 const Rect& clip)
+{
+    if (pos_y < clip.y || pos_y >= clip.Bottom()) {
+        return;
+    }
+    /* Decode a piece at a time, the text being short */
+    constexpr size_t kPieceCells = 64;
+    cchar_t cells[kPieceCells];
+    uint8_t widths[kPieceCells];
+    for (size_t i = 0; i < length && pos_x < clip.Right();) {
+        size_t count = 0;
+        int width = 0;
+        while (count < kPieceCells && i < length) {
+            i += DecodeCell(text + i, length - i, &cells[count], &widths[count]);
+            width += widths[count++];
+        }
+        DrawCells(canvas, pos_x, pos_y, cells, widths, count, clip);
+        pos_x += width;
     }
-    return matrix_[pos_y][pos_x];
 }
 
 } /* namespace fighttrack */
@@ -97,8 +97,8 @@ ClientSocket::RecvData ClientSocket::Receive()
     RecvData ret = { Status::SUCCESS, {} };
 
     while (true) {
-        char buffer[2000];
-        int n = recv(socket_, buffer, sizeof(buffer) - 1, MSG_DONTWAIT);
+        char buffer[16384];
+        int n = recv(socket_, buffer, sizeof(buffer), MSG_DONTWAIT);
         if (n == -1) {
             if (errno == EWOULDBLOCK) {
                 break;
@@ -113,7 +113,6 @@ ClientSocket::RecvData ClientSocket::Receive()
             break;
         }
         /* There is data available */
-        buffer[n] = '\0';
         printf("Client: received %d bytes from server\n", n);
         ret.queue.emplace(std::string{ buffer, (size_t)n });
     }
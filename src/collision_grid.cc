@@ -0,0 +1,149 @@
+/**
+ * \file collision_grid.cc
+ * \brief Bit-packed occupancy grid of map cells.
+ */
+
+#include "fighttrack/collision_grid.h"
+
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/**************************************************************************************/
+
+namespace fighttrack {
+
+namespace {
+
+/* Bits [from, 64) of a word */
+inline uint64_t MaskFrom(unsigned from)
+{
+    return ~uint64_t{ 0 } << from;
+}
+
+/* Bits [0, to) of a word, to in [1, 64] */
+inline uint64_t MaskTo(unsigned to)
+{
+    return ~uint64_t{ 0 } >> (64 - to);
+}
+
+/* Check if any masked bit is set in the same word of consecutive rows */
+inline bool AnyBits(const uint64_t* word, size_t stride, int rows, uint64_t mask)
+{
+#ifdef __SSE2__
+    /* Two rows at a time */
+    const __m128i mask2 = _mm_set1_epi64x((long long) mask);
+    __m128i acc = _mm_setzero_si128();
+    for (; rows >= 2; rows -= 2, word += 2 * stride) {
+        const __m128i words = _mm_set_epi64x((long long) word[stride], (long long) word[0]);
+        acc = _mm_or_si128(acc, _mm_and_si128(words, mask2));
+    }
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128())) != 0xFFFF) {
+        return true;
+    }
+#endif
+    uint64_t acc_bits = 0;
+    for (; rows > 0; --rows, word += stride) {
+        acc_bits |= *word;
+    }
+    return (acc_bits & mask) != 0;
+}
+
+/* Number of display cells of a UTF-8 string, one per character */
+inline size_t CountCells(const std::string& row)
+{
+    return std::count_if(row.begin(), row.end(),
+                         [](char c) { return (static_cast<uint8_t>(c) & 0xC0) != 0x80; });
+}
+
+}  // namespace
+
+/**************************************************************************************/
+CollisionGrid::CollisionGrid() : width_{ 0 }, height_{ 0 }, stride_{ 0 }, bits_{} {}
+
+/**************************************************************************************/
+CollisionGrid::CollisionGrid(const std::vector<std::string>& rows) : CollisionGrid()
+{
+    size_t width = 0;
+    for (const auto& row : rows) {
+        width = std::max(width, CountCells(row));
+    }
+    Reset((int) width, (int) rows.size());
+
+    for (size_t y = 0; y < rows.size(); ++y) {
+        int x = 0;
+        for (char c : rows[y]) {
+            if ((static_cast<uint8_t>(c) & 0xC0) == 0x80) {
+                continue;  // continuation byte, same cell
+            }
+            Set(x++, (int) y, c != ' ');
+        }
+    }
+}
+
+/**************************************************************************************/
+void CollisionGrid::Reset(int width, int height)
+{
+    width_ = std::max(width, 0);
+    height_ = std::max(height, 0);
+    stride_ = (width_ + 63) / 64;
+    bits_.assign(stride_ * height_, 0);
+}
+
+/**************************************************************************************/
+void CollisionGrid::Set(int x, int y, bool solid)
+{
+    if (x < 0 || y < 0 || x >= width_ || y >= height_) {
+        return;
+    }
+    uint64_t& word = bits_[y * stride_ + x / 64];
+    const uint64_t bit = uint64_t{ 1 } << (x % 64);
+    word = solid ? (word | bit) : (word & ~bit);
+}
+
+/**************************************************************************************/
+bool CollisionGrid::IsSolid(int x, int y) const
+{
+    if (x < 0 || y < 0 || x >= width_ || y >= height_) {
+        return false;
+    }
+    return (bits_[y * stride_ + x / 64] >> (x % 64)) & 1;
+}
+
+/**************************************************************************************/
+bool CollisionGrid::AnySolid(int x, int y, int width) const
+{
+    return AnySolid(x, y, width, 1);
+}
+
+/**************************************************************************************/
+bool CollisionGrid::AnySolid(int x, int y, int width, int height) const
+{
+    /* Clip to the grid */
+    const int x_end = std::min(x + width, width_);
+    const int y_end = std::min(y + height, height_);
+    x = std::max(x, 0);
+    y = std::max(y, 0);
+    if (x >= x_end || y >= y_end) {
+        return false;
+    }
+
+    /* Column of words by column of words, usually a single one for a sprite */
+    const unsigned first = x / 64;
+    const unsigned last = (x_end - 1) / 64;
+    for (unsigned w = first; w <= last; ++w) {
+        uint64_t mask = ~uint64_t{ 0 };
+        if (w == first)
+            mask &= MaskFrom(x % 64);
+        if (w == last)
+            mask &= MaskTo((x_end - 1) % 64 + 1);
+        if (AnyBits(&bits_[y * stride_ + w], stride_, y_end - y, mask)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} /* namespace fighttrack */
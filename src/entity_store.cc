@@ -0,0 +1,195 @@
+/**
+ * \file entity_store.cc
+ * \brief Entity Store, the fighters of the game simulation.
+ */
+
+#include "fighttrack/entity_store.h"
+
+#include <algorithm>
+
+#include "fighttrack/physics.h"
+#include "fighttrack/player.h"
+
+/**************************************************************************************/
+
+namespace fighttrack {
+
+/**************************************************************************************/
+EntityStore::EntityStore(size_t capacity)
+    : pos_x_{}, pos_y_{}, vel_x_{}, vel_y_{}, state_{}, jump_{}, on_ground_{},
+      health_{}, sprite_{}, dirty_{}, cold_{ capacity }
+{
+}
+
+/**************************************************************************************/
+void EntityStore::Reset(size_t capacity)
+{
+    pos_x_.clear();
+    pos_y_.clear();
+    vel_x_.clear();
+    vel_y_.clear();
+    state_.clear();
+    jump_.clear();
+    on_ground_.clear();
+    health_.clear();
+    sprite_.clear();
+    dirty_.clear();
+    cold_.Reset(capacity);
+}
+
+/**************************************************************************************/
+void EntityStore::Reserve(size_t count)
+{
+    pos_x_.reserve(count);
+    pos_y_.reserve(count);
+    vel_x_.reserve(count);
+    vel_y_.reserve(count);
+    state_.reserve(count);
+    jump_.reserve(count);
+    on_ground_.reserve(count);
+    health_.reserve(count);
+    sprite_.reserve(count);
+    dirty_.reserve(count);
+    cold_.Reserve(count);
+}
+
+/**************************************************************************************/
+uint32_t EntityStore::Create(std::string name, int owner)
+{
+    const uint32_t handle = cold_.Insert({ std::move(name), owner });
+    if (handle == SlotHandle::kInvalid) {
+        return handle;
+    }
+    pos_x_.push_back(0);
+    pos_y_.push_back(0);
+    vel_x_.push_back(0);
+    vel_y_.push_back(0);
+    state_.push_back(PlayerState::STANDING);
+    jump_.push_back(0);
+    on_ground_.push_back(0);
+    health_.push_back(100);
+    sprite_.push_back(SpriteRegistry::kNone);
+    dirty_.push_back(true);
+    return handle;
+}
+
+/**************************************************************************************/
+bool EntityStore::Destroy(uint32_t handle)
+{
+    const int position = cold_.Position(handle);
+    if (position == -1) {
+        return false;
+    }
+
+    /* Move the last entity into the hole, as the cold data does */
+    auto remove = [position](auto& column) {
+        column[position] = column.back();
+        column.pop_back();
+    };
+    remove(pos_x_);
+    remove(pos_y_);
+    remove(vel_x_);
+    remove(vel_y_);
+    remove(state_);
+    remove(jump_);
+    remove(on_ground_);
+    remove(health_);
+    remove(sprite_);
+    remove(dirty_);
+    cold_.Erase(handle);
+    return true;
+}
+
+/**************************************************************************************/
+Player EntityStore::Get(size_t position)
+{
+    return Player{ *this, position };
+}
+
+/**************************************************************************************/
+void EntityStore::Update(const Map& map, const Rect* area)
+{
+    const size_t count = Size();
+
+    /* States: their behavior is looked up, so every state runs in the same loop */
+    const PlayerStateBehavior* behaviors = PlayerStateBehaviors();
+    const SpriteId* sprites = PlayerStateSprites();
+    for (size_t i = 0; i < count; ++i) {
+        const PlayerStateBehavior& behavior = behaviors[static_cast<size_t>(state_[i])];
+        vel_x_[i] = behavior.walk * kPlayerWalkSpeed;
+        jump_[i] |= behavior.jump;
+        state_[i] = behavior.next;
+        sprite_[i] = sprites[static_cast<size_t>(state_[i])];
+    }
+
+    /* Physics: jump off the ground or fall, then sweep the sprite box along X and Y */
+    const SpriteRegistry& registry = SpriteRegistry::Global();
+    for (size_t i = 0; i < count; ++i) {
+        const AsciiArt& art = registry.Get(sprite_[i]);
+        const int cell_x = ToCell(pos_x_[i]);
+        const int cell_y = ToCell(pos_y_[i]);
+        Rect box{ cell_x, cell_y, art.GetWidth(), art.GetHeight() };
+        if (area != nullptr && !area->Contains(box)) {
+            jump_[i] = 0;
+            continue;  // moves reach a cell past the box at most
+        }
+        if (jump_[i] && on_ground_[i]) {
+            vel_y_[i] = -kPlayerJumpSpeed;
+        }
+        else {
+            vel_y_[i] = std::min(vel_y_[i] + kGravity, kMaxFallSpeed);
+        }
+        jump_[i] = 0;
+
+        if (vel_x_[i] != 0 && MoveX(map, box, &pos_x_[i], vel_x_[i])) {
+            vel_x_[i] = 0;
+        }
+        box.x = ToCell(pos_x_[i]);
+        const bool falling = vel_y_[i] > 0;
+        const bool stopped = MoveY(map, box, &pos_y_[i], vel_y_[i]);
+        vel_y_[i] = stopped ? 0 : vel_y_[i];
+        on_ground_[i] = stopped && falling;
+
+        /* Only whole cells are shown and sent */
+        dirty_[i] |= ToCell(pos_x_[i]) != cell_x || ToCell(pos_y_[i]) != cell_y;
+    }
+}
+
+/**************************************************************************************/
+void EntityStore::BuildSpatialHash(SpatialHash& hash) const
+{
+    hash.Clear();
+    for (size_t i = 0; i < Size(); ++i) {
+        hash.Insert(i, GetBounds(i));
+    }
+    hash.Build();
+}
+
+/**************************************************************************************/
+void EntityStore::Draw(Canvas& canvas, const Camera& camera)
+{
+    for (size_t i = 0; i < Size(); ++i) {
+        Player{ *this, i }.Draw(canvas, camera);
+    }
+}
+
+/**************************************************************************************/
+bool EntityStore::TakeDirty()
+{
+    uint8_t dirty = 0;
+    for (uint8_t& flag : dirty_) {
+        dirty |= flag;
+        flag = 0;
+    }
+    return dirty != 0;
+}
+
+/**************************************************************************************/
+Rect EntityStore::GetBounds(size_t position) const
+{
+    const AsciiArt& art = SpriteRegistry::Global().Get(sprite_[position]);
+    return { ToCell(pos_x_[position]), ToCell(pos_y_[position]), art.GetWidth(),
+             art.GetHeight() };
+}
+
+} /* namespace fighttrack */
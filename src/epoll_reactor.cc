@@ -0,0 +1,371 @@
+/**
+ * \file epoll_reactor.cc
+ * \brief Server Socket event loop based on epoll.
+ */
+
+#include "fighttrack/epoll_reactor.h"
+
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <chrono>
+#include <gsl/gsl>
+
+using namespace std::chrono_literals;
+
+/**************************************************************************************/
+
+namespace fighttrack {
+
+/**************************************************************************************/
+EpollReactor::EpollReactor(const Options& options, int index, int count)
+    : ServerReactor(options, index, count),
+      epoll_fd_{ -1 },
+      sock_to_slot_{},
+      rx_buffer_{ nullptr }
+{
+}
+
+/**************************************************************************************/
+EpollReactor::~EpollReactor()
+{
+    Terminate();
+}
+
+/**************************************************************************************/
+int EpollReactor::Setup()
+{
+    int ret = 0;
+    int err = 0;
+
+    /* Create the event poll */
+    epoll_fd_ = epoll_create1(0);
+    if (epoll_fd_ == -1) {
+        perror("Failed to create epoll");
+        return ret = -1;
+    }
+    auto _close_epoll_fd = gsl::finally([&] {
+        if (ret != 0)
+            close(epoll_fd_);
+    });
+
+    { /* Add master socket to event poll */
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.fd = listen_sock_;
+        err = epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_sock_, &event);
+        if (err == -1) {
+            perror("Failed to add socket to epoll");
+            return ret = -1;
+        }
+    }
+
+    { /* Add Thread Event FD to event poll */
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.fd = event_fd_;
+        err = epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, event_fd_, &event);
+        if (err == -1) {
+            perror("Failed to add thread event fd to epoll");
+            return ret = -1;
+        }
+    }
+
+    sock_to_slot_.clear();
+    rx_buffer_ = nullptr;
+    return ret;
+}
+
+/**************************************************************************************/
+void EpollReactor::Teardown()
+{
+    close(epoll_fd_);
+    sock_to_slot_.clear();
+    rx_buffer_ = nullptr;  // freed with the pool
+}
+
+/**************************************************************************************/
+void EpollReactor::EventLoop()
+{
+    constexpr size_t kMaxEvents = 64;
+    struct epoll_event events[kMaxEvents];
+
+    printf("Server: reactor %d polling for events..\n", index_);
+    fflush(stdout);
+    /* Listen for events (new connections, incoming data, outgoing data) */
+    while (true) {
+        /* Wait for an event from master socket or client sockets */
+        constexpr int kTimeoutMs = std::chrono::milliseconds(30s).count();
+        int event_num = epoll_wait(epoll_fd_, events, kMaxEvents, kTimeoutMs);
+        if (event_num == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Failed polling events");
+            return;
+        }
+        else if (event_num == 0) {
+            printf("Server: reactor %d epoll timeout\n", index_);
+            continue;
+        }
+
+        for (int e = 0; e < event_num; ++e) {
+            /* Thread notifications */
+            if (events[e].data.fd == event_fd_) {
+                uint64_t notify;
+                int n = read(event_fd_, &notify, sizeof(notify));
+                if (n == -1 && errno != EWOULDBLOCK) {
+                    perror("Failed to read thread notification code");
+                    return;
+                }
+                /* Signal to terminate thread */
+                if (terminate_) {
+                    printf("Server: request to terminate reactor %d\n", index_);
+                    return;  // terminate
+                }
+                /* Otherwise there is new data to transmit */
+                HandleTxRequests();
+                continue;
+            }
+            /* New client event */
+            else if (events[e].data.fd == listen_sock_) {
+                if (AddNewClient() < 0) {
+                    fprintf(stderr, "Failed to add new client\n");
+                    return;
+                }
+            }
+            /* Clients IO events */
+            else {
+                const int client_sock = events[e].data.fd;
+                if (events[e].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                    if (HandleClientInput(client_sock) < 0) {
+                        fprintf(stderr, "Failed to handle client input\n");
+                        return;
+                    }
+                }
+                /* Socket may have been closed while handling input */
+                if ((events[e].events & EPOLLOUT) &&
+                    (size_t) client_sock < sock_to_slot_.size() &&
+                    sock_to_slot_[client_sock] != -1) {
+                    FlushClientOutput(sock_to_slot_[client_sock]);
+                }
+            }
+        }
+
+        /* Sockets left unread will wake us right away, let the API client drain */
+        if (rx_queue.Size() == rx_queue.Capacity()) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+/**************************************************************************************/
+int EpollReactor::AddNewClient()
+{
+    int ret = 0;
+    int err = 0;
+
+    if (num_clients_ >= clients_.size()) {
+        printf("Server: dismissing new client, maximum (%zu) reached on reactor %d.\n",
+               clients_.size(), index_);
+        // There's no way to refuse directly, so accept and close immediatly
+        int client_sock = accept(listen_sock_, nullptr, nullptr);
+        if (client_sock != -1) {
+            close(client_sock);
+        }
+        return ret = 1;
+    }
+
+    /* Leave the connection pending until there is room to announce it */
+    if (rx_queue.BeginPush() == nullptr) {
+        stat_rx_overflows++;
+        return ret = 1;
+    }
+
+    struct sockaddr_in client_addr;
+    socklen_t client_len = sizeof(client_addr);
+    int client_sock = accept4(listen_sock_, (struct sockaddr*) &client_addr, &client_len,
+                              SOCK_NONBLOCK);
+    if (client_sock == -1) {
+        perror("Failed to accept a new connection");
+        return ret = 2;
+    }
+
+    /* Cache new client */
+    const int slot = AcquireSlot();
+    ClientInfo& client = clients_[slot];
+    client.sock = client_sock;
+    client.addr = client_addr;
+    if (sock_to_slot_.size() <= (size_t) client.sock) {
+        sock_to_slot_.resize(client.sock + 1, -1);
+    }
+    sock_to_slot_[client.sock] = slot;
+
+    auto _discard_client = gsl::finally([&] {
+        if (ret < 0) {
+            close(client.sock);
+            sock_to_slot_[client.sock] = -1;
+            ReleaseSlot(slot);
+        }
+    });
+
+    /* Add client fd to event poll */
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = client.sock;
+    err = epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, client.sock, &event);
+    if (err == -1) {
+        perror("Failed to add client to epoll");
+        return ret = -1;
+    }
+
+    /* Notify API client that a new client connected */
+    PostRxMessage(slot, RxStatus::CONNECTED, nullptr, 0, false);
+
+    printf("Server: got connection from %s port %d\n", inet_ntoa(client.addr.sin_addr),
+           ntohs(client.addr.sin_port));
+
+    return 0;
+}
+
+/**************************************************************************************/
+void EpollReactor::RemoveClient(int slot)
+{
+    ClientInfo& client = clients_[slot];
+    if (client.sock == -1) {
+        return;
+    }
+
+    /* Forget client */
+    int err = epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, client.sock, nullptr);
+    if (err == -1) {
+        perror("Failed to remove closed client from epoll");
+    }
+    close(client.sock);
+    sock_to_slot_[client.sock] = -1;
+
+    /* Notify API client with a message, while the client ID is still valid */
+    const int client_id = ClientId(slot);
+    PostRxMessage(slot, RxStatus::DISCONNECTED, nullptr, 0, true);
+    ReleaseSlot(slot);
+
+    printf("Server: client %d closed connection.\n", client_id);
+}
+
+/**************************************************************************************/
+int EpollReactor::HandleClientInput(int client_sock)
+{
+    int ret = 0;
+
+    while (true) {
+        /* Leave data in the socket until there is room for it */
+        if (rx_queue.BeginPush() == nullptr) {
+            stat_rx_overflows++;
+            ret = 1;
+            break;
+        }
+
+        /* Read straight into a pool buffer, handed over to the API client as is */
+        if (rx_buffer_ == nullptr && (rx_buffer_ = rx_pool.Acquire()) == nullptr) {
+            stat_rx_overflows++;
+            ret = 1;
+            break;
+        }
+        int n = recv(client_sock, rx_buffer_, RxBufferPool::kBufferSize, MSG_DONTWAIT);
+
+        /* Check for error */
+        if (n == -1) {
+            /* No more data available */
+            if (errno == EWOULDBLOCK) {
+                break;
+            }
+            else if (errno == ECONNRESET) {
+                n = 0;  // proceed to connection close below
+            }
+            else {
+                perror("Failed to read data from client");
+                ret = -1;
+                break;
+            }
+        }
+
+        /* Look up the client slot by socket */
+        const int slot =
+            (size_t) client_sock < sock_to_slot_.size() ? sock_to_slot_[client_sock] : -1;
+        if (slot == -1) {
+            fprintf(stderr, "Fatal error, client sock %d not cached\n", client_sock);
+            ret = -1;
+            break;
+        }
+
+        /* Check for connection closed */
+        if (n == 0) {
+            RemoveClient(slot);
+            break;
+        }
+        /* That is a new message, saved it to received data queue */
+        PostRxBuffer(slot, rx_buffer_, n);
+        rx_buffer_ = nullptr;
+        printf("Server: received %d bytes from client %d\n", n, ClientId(slot));
+    }
+
+    return ret;
+}
+
+/**************************************************************************************/
+void EpollReactor::FlushClientOutput(int slot)
+{
+    ClientInfo& client = clients_[slot];
+    if (client.sock == -1) {
+        return;
+    }
+
+    constexpr size_t kMaxIov = 64;
+    bool would_block = false;
+
+    while (client.tx_head < client.tx_queue.size()) {
+        /* Gather as many queued messages as possible in one call */
+        struct iovec iov[kMaxIov];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = GatherClientOutput(client, iov, kMaxIov);
+        ssize_t n = sendmsg(client.sock, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+        stat_send_calls++;
+        if (n == -1) {
+            if (errno == EWOULDBLOCK) {
+                would_block = true;
+                break;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Failed to send data to client");
+            RemoveClient(slot);
+            return;
+        }
+
+        /* Advance past what was sent */
+        ConsumeClientOutput(client, n);
+    }
+
+    /* Poll for EPOLLOUT only while the socket is full */
+    if (would_block != client.tx_busy) {
+        struct epoll_event event;
+        event.events = would_block ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+        event.data.fd = client.sock;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, client.sock, &event) == -1) {
+            perror("Failed to modify client in epoll");
+        }
+        client.tx_busy = would_block;
+    }
+}
+
+} /* namespace fighttrack */
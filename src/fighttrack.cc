@@ -6,12 +6,14 @@
 #include "fighttrack/fighttrack.h"
 
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <string>
 
 #include <gsl/gsl>
 #include "fighttrack/game_client.h"
 #include "fighttrack/game_server.h"
+#include "fighttrack/map_file.h"
 
 /**************************************************************************************/
 
@@ -24,10 +26,12 @@ int FightTrack::Run(int argc, const char* argv[])
         fflush(stderr);
     });
 
-    if (argc < 3 || argc > 4) {
+    if (argc < 3 || argc > 6) {
         fprintf(stderr,
                 "Wrong number of arguments!\n"
-                "Arguments: <server|client> <port|address:port> [player name]\n");
+                "Arguments: server <port> [max clients] [threads] [epoll|io_uring]\n"
+                "           client <address:port> <player name> [tcp|udp]\n"
+                "           compile-map <input.txt> <output.ftmap> [chunk size]\n");
         return -1;
     }
 
@@ -37,7 +41,27 @@ int FightTrack::Run(int argc, const char* argv[])
             fprintf(stderr, "Invalid port number!\n");
             return -1;
         }
-        return GameServer().Run(port);
+        int max_clients = (argc >= 4) ? std::atoi(argv[3]) : 4;
+        if (max_clients <= 0) {
+            fprintf(stderr, "Invalid maximum number of clients!\n");
+            return -1;
+        }
+        int num_reactors = (argc >= 5) ? std::atoi(argv[4]) : 1;
+        if (num_reactors < 0) {
+            fprintf(stderr, "Invalid number of network threads!\n");
+            return -1;
+        }
+        auto backend = ServerSocket::Backend::EPOLL;
+        if (argc >= 6) {
+            if (strcmp(argv[5], "io_uring") == 0) {
+                backend = ServerSocket::Backend::IO_URING;
+            }
+            else if (strcmp(argv[5], "epoll") != 0) {
+                fprintf(stderr, "Invalid network backend!\n");
+                return -1;
+            }
+        }
+        return GameServer().Run(port, max_clients, num_reactors, backend);
     }
     else if (strcmp(argv[1], "client") == 0) {
         int port;
@@ -51,9 +75,26 @@ int FightTrack::Run(int argc, const char* argv[])
             fprintf(stderr, "Invalid port number!\n");
             return -1;
         }
-        return GameClient(argv[3]).Run(
+        if (argc < 4) {
+            fprintf(stderr, "Missing player name!\n");
+            return -1;
+        }
+        bool use_udp = (argc == 5 && strcmp(argv[4], "udp") == 0);
+        if (argc == 5 && !use_udp && strcmp(argv[4], "tcp") != 0) {
+            fprintf(stderr, "Invalid transport!\n");
+            return -1;
+        }
+        return GameClient(argv[3], use_udp).Run(
             { argv[2], std::string(argv[2]).find_first_of(':') }, (uint16_t) port);
     }
+    else if (strcmp(argv[1], "compile-map") == 0) {
+        if (argc < 4) {
+            fprintf(stderr, "Missing output file!\n");
+            return -1;
+        }
+        int chunk_size = (argc >= 5) ? std::atoi(argv[4]) : kMapDefaultChunkSize;
+        return CompileMapFile(argv[2], argv[3], chunk_size);
+    }
     else {
         fprintf(stderr, "Invalid game side!\n");
         return -1;
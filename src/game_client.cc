@@ -5,50 +5,45 @@
 
 #include "fighttrack/game_client.h"
 
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
 #include <iostream>
 #include <chrono>
 #include <unistd.h>
 #include <thread>
+#include <algorithm>
 
 #include <ncurses.h>
 #include <gsl/gsl>
 
-#include "fighttrack/ascii_art.h"
+#include "fighttrack/protocol.h"
 
 /**************************************************************************************/
 
 namespace fighttrack {
 
-static const AsciiArt kMapArt{ {
-    "                                                                            ",
-    "                                                                            ",
-    "                                                                            ",
-    "                                                                            ",
-    "                                                                            ",
-    "                                                                            ",
-    "                                                                            ",
-    "                                                                            ",
-    "                                                                            ",
-    "                                                                            ",
-    "                                                                            ",
-    "                                                                            ",
-    "                                                                            ",
-    "                                                                            ",
-    "                                                                            ",
-    "▓▓▓▓▓▓▓▓▓▓▓▓▓▓▓▓                 ▓▓▓▓▓▓▓▓▓▓                                 ",
-    "                                                                            ",
-    "                                         ▓▓▓▓▓▓▓   ▓▓▓▓▓▓▓▓▓▓               ",
-    "                                                                            ",
-    "         ▓▓▓▓▓▓▓                                                    ▓▓▓▓▓▓▓▓",
-} };
-
 /**************************************************************************************/
-GameClient::GameClient(std::string player_name)
+GameClient::GameClient(std::string player_name, bool use_udp)
     : running_{ false },
-      map_{ kMapArt },
-      player_{ player_name },
+      map_{},
+      map_hash_{ 0 },
+      map_cache_{},
+      map_download_{},
+      camera_{},
+      renderer_{},
+      players_{},
+      player_{ players_.Create(player_name) },
+      player_id_{ -1 },
       remote_players_{},
-      client_sock_{}
+      client_sock_{},
+      rx_stream_{},
+      snapshots_{},
+      use_udp_{ use_udp },
+      udp_ready_{ false },
+      udp_token_{ 0 },
+      udp_sock_{}
 {
 }
 
@@ -67,10 +62,19 @@ int GameClient::Run(std::string server_addr, uint16_t port)
         fflush(stdout);
     });
 
+    /* The map comes from the server, maps seen before from the cache */
+    if (map_cache_.Open(MapCache::DefaultDirectory()) != 0) {
+        fprintf(stderr, "Map cache disabled, maps are downloaded every time\n");
+    }
+
     if (client_sock_.Initialize(server_addr, port) != 0) {
         fprintf(stderr, "Failed to initialize client socket!\n");
         return -1;
     }
+    if (use_udp_ && udp_sock_.Initialize(server_addr, port) != 0) {
+        fprintf(stderr, "Failed to initialize UDP socket, snapshots go over TCP\n");
+        use_udp_ = false;
+    }
 
     /* Set default locale */
     setlocale(LC_ALL, "");
@@ -83,6 +87,16 @@ int GameClient::Run(std::string server_addr, uint16_t port)
     }
     auto _close_tty = gsl::finally([&] { fclose(tty); });
 
+    /* Canvas writing straight to the terminal, if asked; its stats are printed once
+     * ncurses has given the terminal back */
+    std::unique_ptr<AnsiCanvas> ansi_canvas;
+    auto _print_ansi_stats = gsl::finally([&] {
+        if (ansi_canvas) {
+            printf("Terminal: %" PRIu64 " frames, %" PRIu64 " bytes written\n",
+                   ansi_canvas->GetFramesWritten(), ansi_canvas->GetBytesWritten());
+        }
+    });
+
     /* Initialize terminal with ncurses */
     SCREEN* screen = newterm(nullptr, tty, tty);
     if (screen == nullptr) {
@@ -119,8 +133,20 @@ int GameClient::Run(std::string server_addr, uint16_t port)
     auto _del_game_window = gsl::finally([&] { delwin(game_window); });
     ConfigureTerminal(game_window);
 
+    /* Frames go out through ncurses, or straight to the terminal if asked */
+    WindowCanvas window_canvas{ game_window };
+    const char* output = getenv("FIGHTTRACK_OUTPUT");
+    if (output != nullptr && strcmp(output, "ansi") == 0) {
+        ansi_canvas = std::make_unique<AnsiCanvas>(
+            fileno(tty), Rect{ getbegx(game_window), getbegy(game_window),
+                               getmaxx(game_window), getmaxy(game_window) });
+        /* Let ncurses clear the screen now, not over the first frame */
+        refresh();
+    }
+    Canvas& canvas = ansi_canvas ? static_cast<Canvas&>(*ansi_canvas) : window_canvas;
+
     running_ = true;
-    return Loop(game_window);
+    return Loop(game_window, canvas);
 }
 
 /**************************************************************************************/
@@ -141,7 +167,7 @@ void GameClient::ConfigureTerminal(WINDOW* win)
 
 /**************************************************************************************/
 
-int GameClient::Loop(WINDOW* win)
+int GameClient::Loop(WINDOW* win, Canvas& canvas)
 {
     using namespace std::chrono_literals;
     auto now_ms = [] {
@@ -149,20 +175,22 @@ int GameClient::Loop(WINDOW* win)
             std::chrono::steady_clock::now());
     };
 
-    /* Get terminal size */
-    int max_x = getmaxx(win) - 1;
-    int max_y = getmaxy(win) - 1;
-    /* Set player initial position */
-    player_.SetPosX(1);
-    player_.SetPosY(max_y - 3);
+    /* The server places the player, show it standing meanwhile */
+    Player player = players_.Get(players_.Find(player_));
+    player.SetSprite(PlayerStateSprites()[static_cast<size_t>(PlayerState::STANDING)]);
 
     constexpr auto kFramePerSec = 20;
     constexpr auto kMsPerUpdate = std::chrono::milliseconds(1000 / kFramePerSec);
     auto previous = now_ms();
     std::chrono::milliseconds lag = 0ms;
 
-    if (client_sock_.Transmit("1:" + player_.GetName() + "\n") !=
-        ClientSocket::Status::SUCCESS) {
+    std::string message;
+    protocol::Encode(message, protocol::PlayerName{
+                                  player.GetName().data(),
+                                  (uint8_t) std::min(player.GetName().length(),
+                                                     protocol::kMaxNameLength),
+                              });
+    if (client_sock_.Transmit(std::move(message)) != ClientSocket::Status::SUCCESS) {
         fprintf(stderr, "Failed to send player name to server\n");
         return -1;
     }
@@ -195,7 +223,7 @@ int GameClient::Loop(WINDOW* win)
             lag -= kMsPerUpdate;
         }
 
-        Render(win);
+        Render(canvas);
 
         previous = current;
     }
@@ -220,8 +248,9 @@ void GameClient::ProcessInput(WINDOW* win)
         }
     }
 
-    printf("Game: sending key %d to server\n", key);
-    client_sock_.Transmit("2:" + std::to_string(key) + "\n");
+    std::string message;
+    protocol::Encode(message, protocol::KeyPress{ key });
+    client_sock_.Transmit(std::move(message));
 }
 
 /**************************************************************************************/
@@ -238,9 +267,17 @@ int GameClient::ProcessNetworkInput()
             return -1;
         case ClientSocket::Status::SUCCESS:
             while (!recv_data.queue.empty()) {
-                auto& msg = recv_data.queue.front();
-                printf("Server sent: '%s'\n", msg.c_str());
-                if (ProcessPacket(recv_data.queue.front()) != 0) {
+                const std::string& chunk = recv_data.queue.front();
+                int ret = 0;
+                auto on_frame = [&](const protocol::Frame& frame) {
+                    if (ret == 0)
+                        ret = ProcessPacket(frame);
+                };
+                if (rx_stream_.Feed(chunk.data(), chunk.size(), on_frame) != 0) {
+                    fprintf(stderr, "Game: malformed network stream from server\n");
+                    return -1;
+                }
+                if (ret != 0) {
                     fprintf(stderr, "Game: failed to process server message\n");
                     return -1;
                 }
@@ -249,99 +286,282 @@ int GameClient::ProcessNetworkInput()
             break;
     }
 
-    return 0;
+    return use_udp_ ? ProcessDatagrams() : 0;
 }
 
 /**************************************************************************************/
-int GameClient::ProcessPacket(const std::string& packet)
+int GameClient::ProcessDatagrams()
 {
-    constexpr char kPlayerPositionTag = '3';
-    constexpr char kDeleteOtherPlayer = '4';
-
-    size_t pos = 0;
-    while (pos < packet.length()) {
-        size_t len = packet.find_first_of('\n', pos);
-        len = (len == std::string::npos) ? packet.length() : len;
-        const std::string data{ &packet[pos], len };
-
-        if (data[1] != ':') {
-            fprintf(stderr, "Game: network message format not matched: (%s)\n",
-                    data.c_str());
+    /* Keep saying hello until the server starts sending datagrams */
+    if (!udp_ready_ && player_id_ != -1) {
+        std::string message;
+        protocol::Encode(message, protocol::UdpHello{ (uint32_t) player_id_, udp_token_ });
+        udp_sock_.Send(nullptr, message.data(), message.size());
+    }
+
+    char buffer[protocol::kMaxDatagramSize];
+    int n;
+    while ((n = udp_sock_.Receive(buffer, sizeof(buffer), nullptr)) > 0) {
+        protocol::Frame frame;
+        if (protocol::ParseFrame(buffer, n, &frame) <= 0 ||
+            frame.type != protocol::MessageType::SNAPSHOT) {
+            continue;
+        }
+        if (!udp_ready_) {
+            printf("Game: receiving snapshots over UDP\n");
         }
+        udp_ready_ = true;
+        if (ProcessPacket(frame) != 0) {
+            return -1;
+        }
+    }
 
-        switch (data[0]) {
-            case kPlayerPositionTag: {
-                size_t name_end = data.find_first_of(':', 2);
-                std::string name{ &data[2], name_end - 2 };
-                int x, y;
-                sscanf(&data[name_end + 1], "%d,%d", &x, &y);
-                if (name == player_.GetName()) {
-                    player_.SetPosX(x).SetPosY(y);
-                    printf("Game: local player update position %dx%d\n", x, y);
-                }
-                else {
-                    auto rplayer_it = remote_players_.begin();
-                    for (; rplayer_it != remote_players_.end(); ++rplayer_it) {
-                        if (rplayer_it->GetName() == name)
-                            break;
-                    }
+    return 0;
+}
+
+/**************************************************************************************/
+int GameClient::ProcessPacket(const protocol::Frame& frame)
+{
+#ifdef FIGHTTRACK_PROTOCOL_DEBUG
+    protocol::DumpFrame(stdout, "Server sent: ", frame);
+#endif
+
+    switch (frame.type) {
+        case protocol::MessageType::SNAPSHOT: {
+            uint32_t sequence = DecodeSnapshot(frame, snapshots_);
+            if (sequence == 0) {
+                fprintf(stderr, "Game: dropped snapshot, malformed or unknown baseline\n");
+                return 0;
+            }
+
+            /* Acknowledge it, so it can be used as baseline */
+            std::string message;
+            protocol::Encode(message, protocol::SnapshotAck{ sequence });
+            client_sock_.Transmit(std::move(message));
+
+            if (sequence < snapshots_.LatestSequence()) {
+                return 0;  // older than what is shown already
+            }
+            for (const auto& state : snapshots_.Find(sequence)->entities) {
+                uint32_t handle = player_;
+                if ((int) state.entity_id != player_id_) {
+                    auto rplayer_it = remote_players_.find(state.entity_id);
                     if (rplayer_it == remote_players_.end()) {
-                        remote_players_.push_back(Player(name).SetPosX(x).SetPosY(y));
-                        printf("Game: player '%s' entered the game on %dx%d\n",
-                               name.c_str(), x, y);
-                    }
-                    else {
-                        rplayer_it->SetPosX(x).SetPosY(y);
-                        printf("Game: player %s update position %dx%d\n", name.c_str(), x,
-                               y);
+                        printf("Game: player %u entered the game on %dx%d\n",
+                               state.entity_id, state.pos_x, state.pos_y);
+                        rplayer_it =
+                            remote_players_.emplace(state.entity_id, players_.Create(""))
+                                .first;
                     }
+                    handle = rplayer_it->second;
                 }
+                players_.Get(players_.Find(handle))
+                    .SetPosX(state.pos_x)
+                    .SetPosY(state.pos_y);
+            }
+            return 0;
+        }
+        case protocol::MessageType::PLAYER_LEAVE: {
+            protocol::PlayerLeave msg;
+            if (!protocol::Decode(frame, &msg)) {
                 break;
             }
-            case kDeleteOtherPlayer: {
-                std::string name{ &data[2], len - 2 };
-                for (auto rplayer_it = remote_players_.begin();
-                     rplayer_it != remote_players_.end(); ++rplayer_it) {
-                    if (rplayer_it->GetName() == name) {
-                        remote_players_.erase(rplayer_it);
-                        break;
-                    }
-                }
-                fprintf(stderr, "Game: failed to delete player %s: player not found\n",
-                        name.c_str());
+            auto rplayer_it = remote_players_.find(msg.entity_id);
+            if (rplayer_it == remote_players_.end()) {
+                fprintf(stderr, "Game: failed to delete player %u: player not found\n",
+                        msg.entity_id);
+                return 0;
+            }
+            players_.Destroy(rplayer_it->second);
+            remote_players_.erase(rplayer_it);
+            return 0;
+        }
+        case protocol::MessageType::WELCOME: {
+            protocol::Welcome msg;
+            if (!protocol::Decode(frame, &msg)) {
                 break;
             }
-            default:
-                fprintf(stderr, "Game: unknown message from server: (%s)\n",
-                        data.c_str());
+            player_id_ = msg.entity_id;
+            udp_token_ = msg.token;
+            printf("Game: joined the game as player %d\n", player_id_);
+            return 0;
         }
-
-        pos = len + 1;
+        case protocol::MessageType::MAP_INFO: {
+            protocol::MapInfo msg;
+            if (!protocol::Decode(frame, &msg)) {
+                break;
+            }
+            StartMap(msg);
+            return 0;
+        }
+        case protocol::MessageType::MAP_INDEX: {
+            protocol::MapIndex msg;
+            if (!protocol::Decode(frame, &msg)) {
+                break;
+            }
+            if (map_download_.AddIndex(msg, map_cache_) != 0) {
+                return 0;  // left over from a map replaced since
+            }
+            if (!map_download_.IndexComplete()) {
+                std::string message;
+                protocol::Encode(message,
+                                 protocol::MapIndexRequest{
+                                     msg.map_hash, map_download_.GetIndexReceived() });
+                client_sock_.Transmit(std::move(message));
+            }
+            ContinueMapDownload();
+            return 0;
+        }
+        case protocol::MessageType::MAP_CHUNK: {
+            protocol::MapChunk msg;
+            if (!protocol::Decode(frame, &msg)) {
+                break;
+            }
+            if (msg.map_hash != map_download_.GetInfo().map_hash) {
+                return 0;  // left over from a map replaced since
+            }
+            if (map_download_.AddChunk(msg, map_cache_) != 0) {
+                fprintf(stderr, "Game: map download failed\n");
+                map_download_.Stop();
+                return 0;
+            }
+            ContinueMapDownload();
+            return 0;
+        }
+        case protocol::MessageType::PLAYER_INFO: {
+            protocol::PlayerInfo msg;
+            if (!protocol::Decode(frame, &msg)) {
+                break;
+            }
+            if ((int) msg.entity_id != player_id_) {
+                auto rplayer_it = remote_players_.find(msg.entity_id);
+                if (rplayer_it == remote_players_.end()) {
+                    rplayer_it =
+                        remote_players_.emplace(msg.entity_id, players_.Create("")).first;
+                }
+                players_.Get(players_.Find(rplayer_it->second))
+                    .SetName({ msg.name, msg.length });
+                printf("Game: player %u is '%.*s'\n", msg.entity_id, msg.length,
+                       msg.name);
+            }
+            return 0;
+        }
+        default: break;
     }
 
+    fprintf(stderr, "Game: unknown message from server: type %d, %zu bytes\n",
+            static_cast<int>(frame.type), frame.size);
+
     return 0;
 }
 
 /**************************************************************************************/
-void GameClient::Update()
+void GameClient::StartMap(const protocol::MapInfo& info)
+{
+    if (info.map_hash == map_hash_ || info.map_hash == map_download_.GetInfo().map_hash) {
+        return;  // in play or on the way already
+    }
+
+    Map map;
+    if (map_cache_.HasMap(info.map_hash) && LoadCachedMap(info, &map) == 0) {
+        printf("Game: map %016" PRIx64 " loaded from cache\n", info.map_hash);
+        map_download_.Stop();
+        PlayMap(map, info.map_hash);
+        return;
+    }
+
+    printf("Game: downloading map %016" PRIx64 ", %ux%u\n", info.map_hash, info.width,
+           info.height);
+    if (map_download_.Start(info) != 0) {
+        return;
+    }
+    std::string message;
+    protocol::Encode(message, protocol::MapIndexRequest{ info.map_hash, 0 });
+    client_sock_.Transmit(std::move(message));
+}
+
+/**************************************************************************************/
+void GameClient::ContinueMapDownload()
 {
-    player_.Update();
-    for (auto& rplayer : remote_players_) {
-        rplayer.Update();
+    uint32_t indices[protocol::kMaxMapChunkRequest];
+    size_t count;
+    std::string message;
+    while ((count = map_download_.NextRequests(indices, protocol::kMaxMapChunkRequest))) {
+        protocol::EncodeMapChunkRequest(message, map_download_.GetInfo().map_hash,
+                                        indices, (uint16_t) count);
+    }
+    if (!message.empty()) {
+        client_sock_.Transmit(std::move(message));
+    }
+
+    if (!map_download_.Complete()) {
+        return;
     }
+    const uint64_t hash = map_download_.GetInfo().map_hash;
+    printf("Game: map %016" PRIx64 " downloaded, %zu chunks cached, %zu received\n", hash,
+           map_download_.GetCachedChunks(), map_download_.GetDownloadedChunks());
+    std::string image;
+    if (map_download_.BuildImage(&image) != 0) {
+        fprintf(stderr, "Game: failed to lay out the downloaded map\n");
+        map_download_.Stop();
+        return;
+    }
+    map_download_.Stop();
+
+    /* Play it from the cache, memory-mapped, or from memory if it can't be cached */
+    Map map;
+    if (map_cache_.StoreMap(hash, image) != 0 || map.Load(map_cache_.MapPath(hash)) != 0) {
+        if (map.LoadImage(std::move(image)) != 0) {
+            fprintf(stderr, "Game: failed to load the downloaded map\n");
+            return;
+        }
+    }
+    PlayMap(map, hash);
 }
 
 /**************************************************************************************/
-void GameClient::Render(WINDOW* win)
+int GameClient::LoadCachedMap(const protocol::MapInfo& info, Map* map)
 {
-    werase(win);
-    box(win, 0, 0);
-    map_.Draw(win);
-    player_.Draw(win);
-    for (auto& rplayer : remote_players_) {
-        rplayer.Draw(win);
+    if (map->Load(map_cache_.MapPath(info.map_hash)) != 0) {
+        return -1;
+    }
+    /* The file may be damaged, or changed since it was cached */
+    std::vector<uint64_t> chunk_hashes;
+    if (map->GetWidth() != (int) info.width || map->GetHeight() != (int) info.height ||
+        HashMap(map->GetFile(), &chunk_hashes) != info.map_hash) {
+        fprintf(stderr, "Game: cached map %016" PRIx64 " doesn't match, downloading it\n",
+                info.map_hash);
+        return -1;
     }
-    wrefresh(win);
+    return 0;
+}
+
+/**************************************************************************************/
+void GameClient::PlayMap(Map& map, uint64_t map_hash)
+{
+    map_.Swap(map);
+    map_hash_ = map_hash;
+    renderer_.Invalidate();
+}
+
+/**************************************************************************************/
+void GameClient::Update()
+{
+    /* Players far away move by snapshots only, their chunks of the map are not kept */
+    const Rect area = StreamArea();
+    players_.Update(map_, &area);
+}
+
+/**************************************************************************************/
+void GameClient::Render(Canvas& canvas)
+{
+    /* Follow this player, inside the canvas border */
+    const Player player = players_.Get(players_.Find(player_));
+    camera_.SetScreen({ 1, 1, canvas.GetWidth() - 2, canvas.GetHeight() - 2 });
+    camera_.Follow(player.GetPosX(), player.GetPosY(), map_.GetWidth(), map_.GetHeight());
+    map_.Stream(StreamArea());
+
+    renderer_.Render(canvas, camera_, map_, players_);
 }
 
 } /* namespace fighttrack */
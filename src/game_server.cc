@@ -5,44 +5,44 @@
 
 #include "fighttrack/game_server.h"
 
+#include <cinttypes>
+#include <csignal>
+#include <cstdlib>
 #include <iostream>
 #include <chrono>
+#include <algorithm>
+#include <thread>
 #include <unistd.h>
 
 #include <gsl/gsl>
 
-#include "fighttrack/ascii_art.h"
+#include "fighttrack/protocol.h"
+#include "fighttrack/map_sync.h"
+#include "fighttrack/physics.h"
 
 /**************************************************************************************/
 
 namespace fighttrack {
 
-static const AsciiArt kMapArt{ {
-    "                                                                            ",
-    "                                                                            ",
-    "                                                                            ",
-    "                                                                            ",
-    "                                                                            ",
-    "                                                                            ",
-    "                                                                            ",
-    "                                                                            ",
-    "                                                                            ",
-    "                                                                            ",
-    "                                                                            ",
-    "                                                                            ",
-    "                                                                            ",
-    "                                                                            ",
-    "                                                                            ",
-    "▓▓▓▓▓▓▓▓▓▓▓▓▓▓▓▓                 ▓▓▓▓▓▓▓▓▓▓                                 ",
-    "                                                                            ",
-    "                                         ▓▓▓▓▓▓▓   ▓▓▓▓▓▓▓▓▓▓               ",
-    "                                                                            ",
-    "         ▓▓▓▓▓▓▓                                                    ▓▓▓▓▓▓▓▓",
-} };
+//! Set by SIGHUP to load the map again
+static volatile sig_atomic_t g_reload_map = 0;
 
 /**************************************************************************************/
 
-GameServer::GameServer() : running_{ false }, players_{}, map_{ kMapArt }, server_sock_{}
+GameServer::GameServer()
+    : running_{ false },
+      players_{},
+      spatial_hash_{},
+      map_{},
+      map_hash_{ 0 },
+      chunk_hashes_{},
+      server_sock_{},
+      udp_sock_{},
+      token_rng_{ std::random_device{}() },
+      clients_{},
+      snapshots_{},
+      world_dirty_{ false },
+      deltas_{}
 {
 }
 
@@ -52,17 +52,103 @@ GameServer::~GameServer()
 }
 
 /**************************************************************************************/
-int GameServer::Run(uint16_t port)
+int GameServer::Run(uint16_t port, size_t max_clients, size_t num_reactors,
+                    ServerSocket::Backend backend)
 {
-    if (server_sock_.Initialize(port) != 0) {
+    if (LoadMap() != 0) {
+        fprintf(stderr, "Failed to load map!\n");
+        return -1;
+    }
+    signal(SIGHUP, [](int) { g_reload_map = 1; });
+
+    clients_.assign(max_clients, ClientState{});
+    players_.Reset(max_clients);
+    players_.Reserve(max_clients);
+
+    ServerSocket::Options options;
+    options.max_clients = max_clients;
+    options.num_reactors = num_reactors;
+    options.backend = backend;
+    if (server_sock_.Initialize(port, options) != 0) {
         fprintf(stderr, "Failed to initialize server socket!\n");
         return -1;
     }
+    if (udp_sock_.Initialize(port) != 0) {
+        fprintf(stderr, "Failed to initialize UDP socket, snapshots go over TCP\n");
+    }
 
     running_ = true;
     return Loop();
 }
 
+/**************************************************************************************/
+int GameServer::LoadMap()
+{
+    /* Check the file first, so a bad one leaves the map in play untouched */
+    const char* map_path = getenv("FIGHTTRACK_MAP");
+    MapFile probe;
+    if (map_path && probe.Open(map_path) != 0) {
+        return -1;
+    }
+    if (probe.GetChunkSize() > kMapSyncMaxChunkSize) {
+        fprintf(stderr, "Game: map chunks of %d cells can't be sent, the maximum is %d\n",
+                probe.GetChunkSize(), kMapSyncMaxChunkSize);
+        return -1;
+    }
+    probe.Close();
+
+    if ((map_path ? map_.Load(map_path) : map_.LoadDefault()) != 0) {
+        return -1;
+    }
+    map_hash_ = HashMap(map_.GetFile(), &chunk_hashes_);
+    printf("Game: map %dx%d, hash %016" PRIx64 "\n", map_.GetWidth(), map_.GetHeight(),
+           map_hash_);
+    return 0;
+}
+
+/**************************************************************************************/
+void GameServer::ReloadMap()
+{
+    if (!g_reload_map) {
+        return;
+    }
+    g_reload_map = 0;
+
+    const uint64_t previous_hash = map_hash_;
+    if (LoadMap() != 0) {
+        fprintf(stderr, "Game: failed to reload the map, keeping the one in play\n");
+        return;
+    }
+    if (map_hash_ == previous_hash) {
+        return;
+    }
+
+    /* Positions kept from the previous map may be in the ground or past its edges */
+    for (size_t i = 0; i < players_.Size(); ++i) {
+        if (IsSolid(map_, players_.Get(i).GetBounds())) {
+            Spawn(players_.HandleAt(i));
+        }
+    }
+
+    std::string message;
+    protocol::Encode(message, protocol::MapInfo{
+                                  map_hash_,
+                                  (uint32_t) map_.GetWidth(),
+                                  (uint32_t) map_.GetHeight(),
+                                  (uint16_t) map_.GetFile().GetChunkSize(),
+                              });
+    Broadcast(std::move(message));
+}
+
+/**************************************************************************************/
+void GameServer::Spawn(uint32_t entity)
+{
+    /* Drop in from the top of the map, and fall to the ground */
+    const int spawn_width = std::max(map_.GetWidth() - 3, 1);
+    const int x = (2 + SlotHandle::Index(entity) * 10) % spawn_width;
+    players_.Get(players_.Find(entity)).SetPosX(x).SetPosY(0);
+}
+
 /**************************************************************************************/
 int GameServer::Loop()
 {
@@ -86,6 +172,8 @@ int GameServer::Loop()
             continue;
         }
 
+        ReloadMap();
+
         if (ProcessNetworkInput() != 0) {
             fprintf(stderr, "Game: error processing network input\n");
             return -1;
@@ -117,56 +205,101 @@ int GameServer::Loop()
 /**************************************************************************************/
 void GameServer::Update()
 {
-    for (auto& player_it : players_) {
-        auto& player = player_it.second;
-        player.Update();
-    }
+    players_.Update(map_);
+    /* Contacts, e.g. hits, are queried with players_.QueryContacts() */
+    players_.BuildSpatialHash(spatial_hash_);
 }
 
 /**************************************************************************************/
 int GameServer::ProcessNetworkInput()
 {
-    std::queue<ServerSocket::RxMessage> rx_msgs = server_sock_.GetMessages();
-
-    while (!rx_msgs.empty()) {
-        auto& msg = rx_msgs.front();
+    auto on_message = [&](const ServerSocket::RxMessage& msg) {
         switch (msg.status) {
             case ServerSocket::RxStatus::CONNECTED: {
                 printf("Game: new client connected: %d\n", msg.client_id);
-                int x = 2 + msg.client_id * 10;
-                players_[msg.client_id].SetPosX(x).SetPosY(18);
+                auto& client = clients_[SlotHandle::Index(msg.client_id)];
+                client = ClientState{};
+                client.client_id = msg.client_id;
+                client.udp_token = token_rng_();
+                client.entity = players_.Create("", msg.client_id);
+                world_dirty_ = true;
+                Spawn(client.entity);
+
+                /* Tell the client its entity ID, the map, and who is online */
+                std::string message;
+                protocol::Encode(message,
+                                 protocol::Welcome{ client.entity, client.udp_token });
+                protocol::Encode(message, protocol::MapInfo{
+                                              map_hash_,
+                                              (uint32_t) map_.GetWidth(),
+                                              (uint32_t) map_.GetHeight(),
+                                              (uint16_t) map_.GetFile().GetChunkSize(),
+                                          });
+                for (size_t i = 0; i < players_.Size(); ++i) {
+                    const std::string& name = players_.Get(i).GetName();
+                    if (!name.empty()) {
+                        protocol::Encode(message, protocol::PlayerInfo{
+                                                      players_.HandleAt(i),
+                                                      name.data(),
+                                                      (uint8_t) name.length(),
+                                                  });
+                    }
+                }
+                server_sock_.Transmit(msg.client_id,
+                                      ServerSocket::MakeBuffer(std::move(message)));
                 break;
             }
             case ServerSocket::RxStatus::DISCONNECTED: {
-                auto player_it = players_.find(msg.client_id);
-                if (player_it == players_.end()) {
+                ClientState* client = FindClient(msg.client_id);
+                const int position = client ? players_.Find(client->entity) : -1;
+                if (position == -1) {
                     fprintf(
                         stderr,
                         "Game: something went wrong. Can't remove unknown client %d\n",
                         msg.client_id);
                     return -1;
                 }
-                std::vector<int> client_ids;
-                client_ids.resize(players_.size() - 1);
-                for (auto& player : players_) {
-                    if (player.first != msg.client_id)
-                        client_ids.push_back(player.first);
-                }
-                std::string name = player_it->second.GetName();
-                if (!client_ids.empty()) {
-                    server_sock_.Transmit(
-                        { .client_ids = client_ids, .buffer = "4:" + name + "\n" });
-                }
+                printf("Game: erasing player '%s'\n",
+                       players_.Get(position).GetName().c_str());
+                players_.Destroy(client->entity);
+                client->client_id = -1;
+                world_dirty_ = true;
 
-                printf("Game: erasing player '%s'\n", name.c_str());
-                players_.erase(player_it);
+                std::string message;
+                protocol::Encode(message, protocol::PlayerLeave{ client->entity });
+                Broadcast(std::move(message));
 
                 printf("Game: client %d disconnected\n", msg.client_id);
+                const auto stats = server_sock_.GetTxStats();
+                printf("Game: TX %lu queued, %lu dropped, %lu bytes in %lu sends\n",
+                       (unsigned long) stats.messages_queued,
+                       (unsigned long) stats.messages_dropped,
+                       (unsigned long) stats.bytes_sent,
+                       (unsigned long) stats.send_calls);
+                const auto rx_stats = server_sock_.GetRxStats();
+                printf("Game: RX %lu messages, queue %zu/%zu, %lu overflows, "
+                       "buffers %lu reused %lu allocated\n",
+                       (unsigned long) rx_stats.messages, rx_stats.queue_depth,
+                       rx_stats.queue_capacity, (unsigned long) rx_stats.overflows,
+                       (unsigned long) rx_stats.pool_hits,
+                       (unsigned long) rx_stats.pool_misses);
                 break;
             }
             case ServerSocket::RxStatus::NEW_DATA: {
-                printf("Game: client %d sent: '%s'\n", msg.client_id, msg.buffer.c_str());
-                if (ProcessPacket(msg.client_id, msg.buffer) != 0) {
+                int ret = 0;
+                auto on_frame = [&](const protocol::Frame& frame) {
+                    if (ret == 0)
+                        ret = ProcessPacket(msg.client_id, frame);
+                };
+                ClientState* client = FindClient(msg.client_id);
+                if (client == nullptr) {
+                    break;  // late data of a client already gone
+                }
+                if (client->rx_stream.Feed(msg.data, msg.size, on_frame) != 0) {
+                    fprintf(stderr, "Game: malformed network stream from client %d\n",
+                            msg.client_id);
+                }
+                if (ret != 0) {
                     fprintf(stderr, "Game: failed to process message from client %d\n",
                             msg.client_id);
                     return -1;
@@ -174,87 +307,269 @@ int GameServer::ProcessNetworkInput()
                 break;
             }
         }
-        rx_msgs.pop();
+        return 0;
+    };
+    if (server_sock_.GetMessages(on_message) != 0) {
+        return -1;
     }
 
+    ProcessDatagrams();
+
     return 0;
 }
 
 /**************************************************************************************/
-int GameServer::ProcessPacket(int client_id, const std::string& packet)
+void GameServer::ProcessDatagrams()
 {
-    constexpr char kPlayerNameTag = '1';
-    constexpr char kPlayerKeyPressTag = '2';
-
-    size_t pos = 0;
-    while (pos < packet.length()) {
-        size_t len = packet.find_first_of('\n', pos);
-        len = (len == std::string::npos) ? packet.length() : len;
-        const std::string data{ &packet[pos], len };
-
-        if (data[1] != ':') {
-            fprintf(stderr,
-                    "Game: network message format not matched from client %d: (%s)\n",
-                    client_id, data.c_str());
+    char buffer[protocol::kMaxDatagramSize];
+    sockaddr_in from;
+    int n;
+    while ((n = udp_sock_.Receive(buffer, sizeof(buffer), &from)) > 0) {
+        protocol::Frame frame;
+        if (protocol::ParseFrame(buffer, n, &frame) <= 0 ||
+            frame.type != protocol::MessageType::UDP_HELLO) {
+            continue;
         }
+        protocol::UdpHello msg;
+        if (!protocol::Decode(frame, &msg)) {
+            continue;
+        }
+        const int position = players_.Find(msg.entity_id);
+        ClientState* client =
+            (position != -1) ? FindClient(players_.Get(position).GetOwner()) : nullptr;
+        if (client == nullptr || client->udp_token != msg.token) {
+            continue;
+        }
+        if (!client->udp) {
+            printf("Game: client %d receives snapshots over UDP\n", client->client_id);
+        }
+        client->udp = true;
+        client->udp_addr = from;
+    }
+}
 
-        switch (data[0]) {
-            case kPlayerNameTag: {
-                auto& player = players_[client_id];
-                player.SetName(std::string{ &data[2], len - 2 });
-                printf("Game: player '%s' is online\n", player.GetName().c_str());
-                // player.SetPosX(1).SetPosY(18);
+/**************************************************************************************/
+int GameServer::ProcessPacket(int client_id, const protocol::Frame& frame)
+{
+#ifdef FIGHTTRACK_PROTOCOL_DEBUG
+    char prefix[32];
+    snprintf(prefix, sizeof(prefix), "Game: client %d sent: ", client_id);
+    protocol::DumpFrame(stdout, prefix, frame);
+#endif
+
+    ClientState* client = FindClient(client_id);
+    const int position = client ? players_.Find(client->entity) : -1;
+    if (position == -1) {
+        return 0;  // client gone
+    }
+    Player player = players_.Get(position);
+
+    switch (frame.type) {
+        case protocol::MessageType::PLAYER_NAME: {
+            protocol::PlayerName msg;
+            if (!protocol::Decode(frame, &msg)) {
                 break;
             }
-            case kPlayerKeyPressTag: {
-                auto& player = players_[client_id];
-                int key;
-                sscanf(&data[2], "%d", &key);
-                printf("Game: client %d press key %d\n", client_id, key);
-                player.HandleInput(key);
+            player.SetName(std::string{ msg.name, msg.length });
+            printf("Game: player '%s' is online\n", player.GetName().c_str());
+
+            /* Let everyone know the new name */
+            std::string message;
+            protocol::Encode(message, protocol::PlayerInfo{
+                                          client->entity,
+                                          msg.name,
+                                          msg.length,
+                                      });
+            Broadcast(std::move(message));
+            return 0;
+        }
+        case protocol::MessageType::KEY_PRESS: {
+            protocol::KeyPress msg;
+            if (!protocol::Decode(frame, &msg)) {
                 break;
             }
-            default:
-                fprintf(stderr, "Game: unknown message from client %d: (%s)\n", client_id,
-                        data.c_str());
+            player.HandleInput(msg.key);
+            return 0;
         }
-
-        pos = len + 1;
+        case protocol::MessageType::SNAPSHOT_ACK: {
+            protocol::SnapshotAck msg;
+            if (!protocol::Decode(frame, &msg)) {
+                break;
+            }
+            if (msg.sequence > client->last_acked && msg.sequence <= client->last_sent) {
+                client->last_acked = msg.sequence;
+            }
+            return 0;
+        }
+        case protocol::MessageType::MAP_INDEX_REQUEST: {
+            protocol::MapIndexRequest msg;
+            if (!protocol::Decode(frame, &msg)) {
+                break;
+            }
+            if (msg.map_hash != map_hash_ || msg.first >= chunk_hashes_.size()) {
+                return 0;  // the map changed since, the client is told with MAP_INFO
+            }
+            const size_t count =
+                std::min(protocol::kMaxMapIndexEntries, chunk_hashes_.size() - msg.first);
+            std::string message;
+            protocol::EncodeMapIndex(message, map_hash_, msg.first,
+                                     &chunk_hashes_[msg.first], (uint16_t) count);
+            server_sock_.Transmit(client_id, ServerSocket::MakeBuffer(std::move(message)));
+            return 0;
+        }
+        case protocol::MessageType::MAP_CHUNK_REQUEST: {
+            protocol::MapChunkRequest msg;
+            if (!protocol::Decode(frame, &msg)) {
+                break;
+            }
+            if (msg.map_hash != map_hash_) {
+                return 0;  // the map changed since
+            }
+            std::string message;
+            EncodeMapChunks(message, msg);
+            if (!message.empty()) {
+                server_sock_.Transmit(client_id,
+                                      ServerSocket::MakeBuffer(std::move(message)));
+            }
+            return 0;
+        }
+        default: break;
     }
 
+    fprintf(stderr, "Game: unknown message from client %d: type %d, %zu bytes\n",
+            client_id, static_cast<int>(frame.type), frame.size);
+
     return 0;
 }
 
-int GameServer::TransmitUpdates()
+/**************************************************************************************/
+void GameServer::TakeSnapshot()
 {
-    constexpr char kPlayerPositionTag = '3';
+    /* Check every player, TakeDirty() also clears the flags */
+    bool dirty = players_.TakeDirty() || world_dirty_;
+    if (!dirty && snapshots_.Latest() != nullptr) {
+        return;
+    }
+    world_dirty_ = false;
+
+    WorldSnapshot& snapshot = snapshots_.Insert(snapshots_.LatestSequence() + 1);
+    for (size_t i = 0; i < players_.Size(); ++i) {
+        Player player = players_.Get(i);
+        snapshot.entities.push_back({
+            players_.HandleAt(i),
+            (int16_t) player.GetPosX(),
+            (int16_t) player.GetPosY(),
+        });
+    }
+    /* Players are packed in no particular order, deltas need them by ID */
+    std::sort(snapshot.entities.begin(), snapshot.entities.end(),
+              [](const protocol::EntityState& a, const protocol::EntityState& b) {
+                  return a.entity_id < b.entity_id;
+              });
+}
 
-    std::vector<int> client_ids;
-    client_ids.resize(players_.size());
+/**************************************************************************************/
+GameServer::ClientState* GameServer::FindClient(int client_id)
+{
+    const uint32_t index = SlotHandle::Index(client_id);
+    if (client_id < 0 || index >= clients_.size() ||
+        clients_[index].client_id != client_id) {
+        return nullptr;
+    }
+    return &clients_[index];
+}
 
-    std::string message;
+/**************************************************************************************/
+int GameServer::TransmitUpdates()
+{
+    TakeSnapshot();
+    const WorldSnapshot& current = *snapshots_.Latest();
+
+    /* Clients acknowledging the same baseline get the same delta, encode it once.
+     * Delta slots are reused across ticks so their ID lists keep their memory */
+    size_t num_deltas = 0;
+
+    for (size_t i = 0; i < players_.Size(); ++i) {
+        const int client_id = players_.Get(i).GetOwner();
+        auto& client = clients_[SlotHandle::Index(client_id)];
+        /* Over TCP a sent snapshot will arrive. Over UDP keep sending until acked */
+        const uint32_t last = client.udp ? client.last_acked : client.last_sent;
+        if (last == current.sequence) {
+            continue;  // up to date
+        }
+        /* Fall back to a keyframe if the client is too far behind */
+        const WorldSnapshot* baseline = snapshots_.Find(client.last_acked);
+        const uint32_t baseline_seq = baseline ? baseline->sequence : 0;
 
-    for (auto& player_it : players_) {
-        client_ids.push_back(player_it.first);
-        auto& player = player_it.second;
-        // bool dirty = player.Dirty();
-        // if (dirty) {
-        char buffer[100];
-        snprintf(buffer, sizeof(buffer), "%c:%s:%d,%d\n", kPlayerPositionTag,
-                 player.GetName().c_str(), player.GetPosX(), player.GetPosY());
-        message += buffer;
-        // }
+        size_t d = 0;
+        for (; d < num_deltas; ++d) {
+            if (deltas_[d].baseline == baseline_seq)
+                break;
+        }
+        if (d == num_deltas) {
+            if (deltas_.size() == num_deltas)
+                deltas_.emplace_back();
+            Delta& delta = deltas_[num_deltas++];
+            delta.baseline = baseline_seq;
+            delta.tcp_client_ids.clear();
+            delta.udp_client_ids.clear();
+            std::string buffer;
+            EncodeSnapshot(buffer, current, baseline);
+            delta.buffer = ServerSocket::MakeBuffer(std::move(buffer));
+        }
+        Delta& delta = deltas_[d];
+        /* Snapshots too big for a datagram go over TCP */
+        if (client.udp && delta.buffer->size() <= protocol::kMaxDatagramSize)
+            delta.udp_client_ids.push_back(client_id);
+        else
+            delta.tcp_client_ids.push_back(client_id);
+        client.last_sent = current.sequence;
     }
 
-    if (!client_ids.empty() && !message.empty()) {
-        printf("Transmitting '%s' to clients\n", message.c_str());
-        server_sock_.Transmit({
-            .client_ids = std::move(client_ids),
-            .buffer = std::move(message),
-        });
+    for (size_t d = 0; d < num_deltas; ++d) {
+        Delta& delta = deltas_[d];
+        const std::string& buffer = *delta.buffer;
+        for (int client_id : delta.udp_client_ids) {
+            const auto& client = clients_[SlotHandle::Index(client_id)];
+            udp_sock_.Send(&client.udp_addr, buffer.data(), buffer.size());
+        }
+        if (!delta.tcp_client_ids.empty()) {
+            server_sock_.Transmit(delta.tcp_client_ids, delta.buffer);
+        }
+        delta.buffer.reset();
     }
 
     return 0;
 }
 
+/**************************************************************************************/
+void GameServer::EncodeMapChunks(std::string& out, const protocol::MapChunkRequest& msg)
+{
+    std::string data;
+    for (size_t i = 0; i < msg.count; ++i) {
+        const uint32_t index = msg.ChunkIndex(i);
+        if (index >= chunk_hashes_.size() ||
+            EncodeMapChunk(map_.GetFile(), index, &data) != 0) {
+            continue;  // empty chunk or out of the map
+        }
+        protocol::Encode(out, protocol::MapChunk{
+                                  map_hash_,
+                                  index,
+                                  chunk_hashes_[index],
+                                  data.data(),
+                                  (uint16_t) data.size(),
+                              });
+    }
+}
+
+/**************************************************************************************/
+void GameServer::Broadcast(std::string message)
+{
+    if (players_.Empty() || message.empty()) {
+        return;
+    }
+
+    server_sock_.Broadcast(ServerSocket::MakeBuffer(std::move(message)));
+}
+
 }  // namespace fighttrack
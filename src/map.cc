@@ -5,27 +5,215 @@
 
 #include "fighttrack/map.h"
 
+#include <cstring>
+#include <algorithm>
+
 /**************************************************************************************/
 
 namespace fighttrack {
 
-Map::Map(AsciiArt art) : art_{ art }
+/* Map used when no map file is given */
+static const std::vector<std::string> kDefaultMapRows{
+    "                                                                            ",
+    "                                                                            ",
+    "                                                                            ",
+    "                                                                            ",
+    "                                                                            ",
+    "                                                                            ",
+    "                                                                            ",
+    "                                                                            ",
+    "                                                                            ",
+    "                                                                            ",
+    "                                                                            ",
+    "                                                                            ",
+    "                                                                            ",
+    "                                                                            ",
+    "                                                                            ",
+    "▓▓▓▓▓▓▓▓▓▓▓▓▓▓▓▓                 ▓▓▓▓▓▓▓▓▓▓                                 ",
+    "                                                                            ",
+    "                                         ▓▓▓▓▓▓▓   ▓▓▓▓▓▓▓▓▓▓               ",
+    "                                                                            ",
+    "         ▓▓▓▓▓▓▓                                                    ▓▓▓▓▓▓▓▓",
+};
+
+/**************************************************************************************/
+
+Map::Map() : file_{}, chunks_{}, decoded_{}
+{
+}
+
+/**************************************************************************************/
+
+int Map::Load(const std::string& path)
+{
+    chunks_.clear();
+    decoded_.clear();
+    if (file_.Open(path) != 0) {
+        return -1;
+    }
+    chunks_.resize((size_t) file_.GetChunksX() * file_.GetChunksY());
+    return 0;
+}
+
+/**************************************************************************************/
+
+int Map::LoadImage(std::string image)
+{
+    chunks_.clear();
+    decoded_.clear();
+    if (file_.OpenImage(std::move(image)) != 0) {
+        return -1;
+    }
+    chunks_.resize((size_t) file_.GetChunksX() * file_.GetChunksY());
+    return 0;
+}
+
+/**************************************************************************************/
+
+int Map::LoadDefault()
+{
+    std::string image;
+    if (CompileMap(kDefaultMapRows, &image) != 0) {
+        return -1;
+    }
+    return LoadImage(std::move(image));
+}
+
+/**************************************************************************************/
+
+void Map::Swap(Map& other)
 {
+    file_.Swap(other.file_);
+    chunks_.swap(other.chunks_);
+    decoded_.swap(other.decoded_);
 }
 
 /**************************************************************************************/
 
-void Map::Draw(WINDOW* win)
+void Map::Draw(Canvas& canvas, const Camera& camera)
 {
-    art_.Draw(1, 1, win);
+    /* Only the chunks in view, clipped to the screen rectangle */
+    const int chunk_size = file_.GetChunkSize();
+    const Rect chunks = ChunksIn(camera.View());
+    for (int cy = chunks.y; cy < chunks.Bottom(); ++cy) {
+        for (int cx = chunks.x; cx < chunks.Right(); ++cx) {
+            const Chunk* chunk = GetChunk(cx, cy);
+            if (chunk != nullptr) {
+                chunk->art.Draw(camera.ToScreenX(cx * chunk_size),
+                                camera.ToScreenY(cy * chunk_size), canvas,
+                                camera.Screen());
+            }
+        }
+    }
 }
 
 /**************************************************************************************/
 
-bool Map::IsGround(int x, int y)
+void Map::Stream(const Rect& area)
 {
-    // return art_.GetChar(x, y) == '▓';
-    return art_.GetChar(x, y) == ' ';
+    const Rect chunks = ChunksIn(area);
+    for (int cy = chunks.y; cy < chunks.Bottom(); ++cy) {
+        for (int cx = chunks.x; cx < chunks.Right(); ++cx) {
+            GetChunk(cx, cy);
+        }
+    }
+
+    /* Free the chunks left behind, with a chunk of slack against thrashing */
+    const Rect keep = chunks.Grow(1);
+    for (size_t i = 0; i < decoded_.size();) {
+        const size_t index = decoded_[i];
+        if (keep.Contains(index % file_.GetChunksX(), index / file_.GetChunksX())) {
+            ++i;
+            continue;
+        }
+        chunks_[index].reset();
+        decoded_[i] = decoded_.back();
+        decoded_.pop_back();
+    }
+}
+
+/**************************************************************************************/
+
+bool Map::IsGround(int x, int y) const
+{
+    const int chunk_size = file_.GetChunkSize();
+    if (x < 0 || y < 0 || chunk_size == 0) {
+        return false;
+    }
+    const Chunk* chunk = GetChunk(x / chunk_size, y / chunk_size);
+    return chunk && chunk->grid.IsSolid(x % chunk_size, y % chunk_size);
+}
+
+/**************************************************************************************/
+
+bool Map::IsGround(int x, int y, int width, int height) const
+{
+    const int chunk_size = file_.GetChunkSize();
+    if (chunk_size == 0 || width <= 0 || height <= 0) {
+        return false;
+    }
+
+    /* Query every chunk the box overlaps, in its own coordinates */
+    const Rect chunks = ChunksIn({ x, y, width, height });
+    for (int cy = chunks.y; cy < chunks.Bottom(); ++cy) {
+        for (int cx = chunks.x; cx < chunks.Right(); ++cx) {
+            const Chunk* chunk = GetChunk(cx, cy);
+            const int x0 = cx * chunk_size;
+            const int y0 = cy * chunk_size;
+            if (chunk && chunk->grid.AnySolid(x - x0, y - y0, width, height)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**************************************************************************************/
+
+Rect Map::ChunksIn(const Rect& area) const
+{
+    const int chunk_size = file_.GetChunkSize();
+    const Rect clipped = area.Intersection({ 0, 0, GetWidth(), GetHeight() });
+    if (chunk_size == 0 || clipped.Empty()) {
+        return { 0, 0, 0, 0 };
+    }
+    const int cx = clipped.x / chunk_size;
+    const int cy = clipped.y / chunk_size;
+    return { cx, cy, (clipped.Right() - 1) / chunk_size - cx + 1,
+             (clipped.Bottom() - 1) / chunk_size - cy + 1 };
+}
+
+/**************************************************************************************/
+
+const Map::Chunk* Map::GetChunk(int cx, int cy) const
+{
+    if (cx < 0 || cy < 0 || cx >= file_.GetChunksX() || cy >= file_.GetChunksY()) {
+        return nullptr;
+    }
+    auto& chunk = chunks_[(size_t) cy * file_.GetChunksX() + cx];
+    if (chunk) {
+        return chunk.get();
+    }
+
+    /* Decode on first use */
+    const uint8_t* tiles = file_.GetChunk(cx, cy);
+    if (tiles == nullptr) {
+        return nullptr;  // empty
+    }
+    const int chunk_size = file_.GetChunkSize();
+    std::vector<std::string> rows(chunk_size);
+    CollisionGrid grid;
+    grid.Reset(chunk_size, chunk_size);
+    for (int y = 0; y < chunk_size; ++y) {
+        for (int x = 0; x < chunk_size; ++x) {
+            const MapFileTile& tile = file_.GetTile(tiles[y * chunk_size + x]);
+            rows[y].append(tile.glyph, strnlen(tile.glyph, sizeof(tile.glyph)));
+            grid.Set(x, y, tile.flags & kMapTileSolid);
+        }
+    }
+    chunk.reset(new Chunk{ AsciiArt{ std::move(rows) }, std::move(grid) });
+    decoded_.push_back((size_t) cy * file_.GetChunksX() + cx);
+    return chunk.get();
 }
 
 } /* namespace fighttrack */
@@ -0,0 +1,344 @@
+/**
+ * \file map_file.cc
+ * \brief Binary tiled map format, compiled from text and memory-mapped.
+ */
+
+#include "fighttrack/map_file.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <map>
+#include <utility>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <gsl/gsl>
+
+/**************************************************************************************/
+
+namespace fighttrack {
+
+/**************************************************************************************/
+MapFile::MapFile()
+    : data_{ nullptr }, size_{ 0 }, mapped_{ false }, image_{}, header_{ nullptr },
+      tiles_{ nullptr }, offsets_{ nullptr }, chunks_x_{ 0 }, chunks_y_{ 0 }
+{
+}
+
+/**************************************************************************************/
+MapFile::~MapFile()
+{
+    Close();
+}
+
+/**************************************************************************************/
+int MapFile::Open(const std::string& path)
+{
+    Close();
+
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        perror("MapFile: Failed to open map file");
+        return -1;
+    }
+    auto _close_fd = gsl::finally([&] { close(fd); });
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        perror("MapFile: Failed to stat map file");
+        return -1;
+    }
+    if (st.st_size == 0) {
+        fprintf(stderr, "MapFile: %s is empty\n", path.c_str());
+        return -1;
+    }
+
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        perror("MapFile: Failed to map map file");
+        return -1;
+    }
+    data_ = static_cast<const char*>(data);
+    size_ = st.st_size;
+    mapped_ = true;
+
+    if (Parse() != 0) {
+        fprintf(stderr, "MapFile: %s is not a valid map file\n", path.c_str());
+        Close();
+        return -1;
+    }
+    return 0;
+}
+
+/**************************************************************************************/
+int MapFile::OpenImage(std::string image)
+{
+    Close();
+
+    image_ = std::move(image);
+    data_ = image_.data();
+    size_ = image_.size();
+
+    if (Parse() != 0) {
+        fprintf(stderr, "MapFile: invalid map image\n");
+        Close();
+        return -1;
+    }
+    return 0;
+}
+
+/**************************************************************************************/
+void MapFile::Close()
+{
+    if (mapped_) {
+        munmap(const_cast<char*>(data_), size_);
+    }
+    image_.clear();
+    data_ = nullptr;
+    size_ = 0;
+    mapped_ = false;
+    header_ = nullptr;
+    tiles_ = nullptr;
+    offsets_ = nullptr;
+    chunks_x_ = 0;
+    chunks_y_ = 0;
+}
+
+/**************************************************************************************/
+const uint8_t* MapFile::GetChunk(int cx, int cy) const
+{
+    if (cx < 0 || cy < 0 || cx >= chunks_x_ || cy >= chunks_y_) {
+        return nullptr;
+    }
+    const uint64_t offset = offsets_[(size_t) cy * chunks_x_ + cx];
+    return offset ? reinterpret_cast<const uint8_t*>(data_ + offset) : nullptr;
+}
+
+/**************************************************************************************/
+void MapFile::Swap(MapFile& other)
+{
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+    std::swap(mapped_, other.mapped_);
+    image_.swap(other.image_);
+    std::swap(header_, other.header_);
+    std::swap(tiles_, other.tiles_);
+    std::swap(offsets_, other.offsets_);
+    std::swap(chunks_x_, other.chunks_x_);
+    std::swap(chunks_y_, other.chunks_y_);
+
+    /* Contents held in memory may have moved with their string, point into it again */
+    for (MapFile* file : { this, &other }) {
+        if (!file->mapped_ && file->header_ != nullptr) {
+            file->data_ = file->image_.data();
+            file->Parse();
+        }
+    }
+}
+
+/**************************************************************************************/
+int MapFile::Parse()
+{
+    if (size_ < sizeof(MapFileHeader)) {
+        return -1;
+    }
+    const auto* header = reinterpret_cast<const MapFileHeader*>(data_);
+    if (memcmp(header->magic, kMapFileMagic, sizeof(kMapFileMagic)) != 0 ||
+        header->version != kMapFileVersion || header->chunk_size == 0 ||
+        header->num_tiles == 0 || header->num_tiles > 256) {
+        return -1;
+    }
+
+    /* Sizes are read as int */
+    if (header->width > INT32_MAX || header->height > INT32_MAX) {
+        return -1;
+    }
+
+    const uint64_t chunk_size = header->chunk_size;
+    const uint64_t chunks_x = (header->width + chunk_size - 1) / chunk_size;
+    const uint64_t chunks_y = (header->height + chunk_size - 1) / chunk_size;
+    const uint64_t tiles_offset = sizeof(MapFileHeader);
+    const uint64_t offsets_offset =
+        tiles_offset + header->num_tiles * sizeof(MapFileTile);
+    if (offsets_offset > size_) {
+        return -1;
+    }
+    /* The offset table must fit in the file, checked before multiplying so it can't
+     * wrap around */
+    const uint64_t max_chunks = (size_ - offsets_offset) / sizeof(uint64_t);
+    if (chunks_y != 0 && chunks_x > max_chunks / chunks_y) {
+        return -1;
+    }
+    const uint64_t data_offset = offsets_offset + chunks_x * chunks_y * sizeof(uint64_t);
+
+    /* Check the chunks lie in the file, only the offset table is read for it */
+    const auto* offsets = reinterpret_cast<const uint64_t*>(data_ + offsets_offset);
+    const uint64_t chunk_bytes = chunk_size * chunk_size;
+    for (uint64_t i = 0; i < chunks_x * chunks_y; ++i) {
+        if (offsets[i] != 0 && (chunk_bytes > size_ || offsets[i] < data_offset ||
+                                offsets[i] > size_ - chunk_bytes)) {
+            return -1;
+        }
+    }
+
+    header_ = header;
+    tiles_ = reinterpret_cast<const MapFileTile*>(data_ + tiles_offset);
+    offsets_ = offsets;
+    chunks_x_ = (int) chunks_x;
+    chunks_y_ = (int) chunks_y;
+    return 0;
+}
+
+/**************************************************************************************/
+int CompileMap(const std::vector<std::string>& rows, std::string* image, int chunk_size)
+{
+    if (chunk_size < 1 || chunk_size > 4096) {
+        fprintf(stderr, "CompileMap: invalid chunk size %d\n", chunk_size);
+        return -1;
+    }
+
+    /* Split the rows into characters, collecting the palette */
+    std::vector<MapFileTile> tiles{ MapFileTile{ { ' ' }, 0, {} } };
+    std::map<std::string, uint8_t> tile_ids{ { " ", 0 } };
+    std::vector<std::vector<uint8_t>> cells(rows.size());
+    size_t width = 0;
+    for (size_t y = 0; y < rows.size(); ++y) {
+        const std::string& row = rows[y];
+        for (size_t x = 0; x < row.size();) {
+            /* Length of the UTF-8 sequence */
+            size_t length = 1;
+            while (x + length < row.size() && (row[x + length] & 0xC0) == 0x80) {
+                length++;
+            }
+            if (length > sizeof(MapFileTile::glyph)) {
+                fprintf(stderr, "CompileMap: invalid character at %zux%zu\n", x, y);
+                return -1;
+            }
+            std::string glyph = row.substr(x, length);
+            auto tile_it = tile_ids.find(glyph);
+            if (tile_it == tile_ids.end()) {
+                if (tiles.size() == 256) {
+                    fprintf(stderr, "CompileMap: more than 256 distinct tiles\n");
+                    return -1;
+                }
+                MapFileTile tile{};
+                memcpy(tile.glyph, glyph.data(), length);
+                tile.flags = kMapTileSolid;
+                tiles.push_back(tile);
+                tile_it = tile_ids.emplace(glyph, (uint8_t)(tiles.size() - 1)).first;
+            }
+            cells[y].push_back(tile_it->second);
+            x += length;
+        }
+        width = std::max(width, cells[y].size());
+    }
+
+    /* Chunks, leaving the empty ones out */
+    const size_t chunks_x = (width + chunk_size - 1) / chunk_size;
+    const size_t chunks_y = (rows.size() + chunk_size - 1) / chunk_size;
+    std::vector<std::string> chunks(chunks_x * chunks_y);
+    std::string chunk(chunk_size * chunk_size, '\0');
+    for (size_t cy = 0; cy < chunks_y; ++cy) {
+        for (size_t cx = 0; cx < chunks_x; ++cx) {
+            std::fill(chunk.begin(), chunk.end(), 0);
+            bool empty = true;
+            for (int y = 0; y < chunk_size && cy * chunk_size + y < rows.size(); ++y) {
+                const auto& row = cells[cy * chunk_size + y];
+                for (int x = 0; x < chunk_size && cx * chunk_size + x < row.size(); ++x) {
+                    chunk[y * chunk_size + x] = row[cx * chunk_size + x];
+                    empty &= (chunk[y * chunk_size + x] == 0);
+                }
+            }
+            if (!empty) {
+                chunks[cy * chunks_x + cx] = chunk;
+            }
+        }
+    }
+
+    WriteMapImage((int) width, (int) rows.size(), chunk_size, tiles, chunks, image);
+    return 0;
+}
+
+/**************************************************************************************/
+void WriteMapImage(int width, int height, int chunk_size,
+                   const std::vector<MapFileTile>& tiles,
+                   const std::vector<std::string>& chunks, std::string* image)
+{
+    MapFileHeader header{};
+    memcpy(header.magic, kMapFileMagic, sizeof(kMapFileMagic));
+    header.version = kMapFileVersion;
+    header.chunk_size = (uint16_t) chunk_size;
+    header.width = (uint32_t) width;
+    header.height = (uint32_t) height;
+    header.num_tiles = (uint32_t) tiles.size();
+
+    std::vector<uint64_t> offsets(chunks.size(), 0);
+    uint64_t offset = sizeof(header) + tiles.size() * sizeof(MapFileTile) +
+                      offsets.size() * sizeof(uint64_t);
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        if (!chunks[i].empty()) {
+            offsets[i] = offset;
+            offset += chunks[i].size();
+        }
+    }
+
+    image->clear();
+    image->reserve(offset);
+    image->append(reinterpret_cast<const char*>(&header), sizeof(header));
+    image->append(reinterpret_cast<const char*>(tiles.data()),
+                  tiles.size() * sizeof(MapFileTile));
+    image->append(reinterpret_cast<const char*>(offsets.data()),
+                  offsets.size() * sizeof(uint64_t));
+    for (const std::string& chunk : chunks) {
+        image->append(chunk);
+    }
+}
+
+/**************************************************************************************/
+int CompileMapFile(const std::string& input, const std::string& output, int chunk_size)
+{
+    FILE* in = fopen(input.c_str(), "r");
+    if (in == nullptr) {
+        perror("CompileMap: Failed to open text map");
+        return -1;
+    }
+    auto _close_in = gsl::finally([&] { fclose(in); });
+
+    std::vector<std::string> rows;
+    char* line = nullptr;
+    size_t capacity = 0;
+    ssize_t length;
+    while ((length = getline(&line, &capacity, in)) != -1) {
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+            length--;
+        }
+        rows.emplace_back(line, length);
+    }
+    free(line);
+
+    std::string image;
+    if (CompileMap(rows, &image, chunk_size) != 0) {
+        return -1;
+    }
+
+    FILE* out = fopen(output.c_str(), "wb");
+    if (out == nullptr) {
+        perror("CompileMap: Failed to create map file");
+        return -1;
+    }
+    const bool written = fwrite(image.data(), 1, image.size(), out) == image.size();
+    if (fclose(out) != 0 || !written) {
+        perror("CompileMap: Failed to write map file");
+        return -1;
+    }
+    printf("CompileMap: %s: %zu rows, %zu bytes\n", output.c_str(), rows.size(),
+           image.size());
+    return 0;
+}
+
+} /* namespace fighttrack */
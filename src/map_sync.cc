@@ -0,0 +1,457 @@
+/**
+ * \file map_sync.cc
+ * \brief Map transfer from the server, with content-hash caching on the client.
+ */
+
+#include "fighttrack/map_sync.h"
+
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <unordered_map>
+
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <gsl/gsl>
+
+/**************************************************************************************/
+
+namespace fighttrack {
+
+//! FNV-1a 64-bit parameters, used on 64-bit words
+constexpr uint64_t kHashOffset = 0xcbf29ce484222325ULL;
+constexpr uint64_t kHashPrime = 0x100000001b3ULL;
+//! Bytes the server may queue for a client in reply to chunk requests
+constexpr size_t kMapDownloadBytes = 128 * 1024;
+
+/**************************************************************************************/
+
+/* Fold a word into a hash; the shift carries the high bits back down */
+static inline uint64_t HashMix(uint64_t hash, uint64_t word)
+{
+    hash = (hash ^ word) * kHashPrime;
+    return hash ^ (hash >> 32);
+}
+
+/* A tile as a word, byte order independent */
+static uint64_t TileWord(const MapFileTile& tile)
+{
+    uint64_t word = tile.flags;
+    for (int i = sizeof(tile.glyph) - 1; i >= 0; --i) {
+        word = (word << 8) | static_cast<uint8_t>(tile.glyph[i]);
+    }
+    return word;
+}
+
+/* Size of an encoded chunk at worst: every tile, and a run per cell */
+static size_t MaxEncodedChunkSize(int chunk_size)
+{
+    return 2 + 256 * sizeof(MapFileTile) + 2 * (size_t) chunk_size * chunk_size;
+}
+
+/**************************************************************************************/
+uint64_t HashMapChunk(const MapChunkData& chunk)
+{
+    std::array<uint64_t, 256> words{};
+    for (size_t i = 0; i < chunk.tiles.size() && i < words.size(); ++i) {
+        words[i] = TileWord(chunk.tiles[i]);
+    }
+    uint64_t hash = kHashOffset;
+    for (char cell : chunk.cells) {
+        hash = HashMix(hash, words[static_cast<uint8_t>(cell)]);
+    }
+    return hash ? hash : 1;
+}
+
+/**************************************************************************************/
+uint64_t HashMap(const MapFile& file, std::vector<uint64_t>* chunk_hashes)
+{
+    const int chunk_size = file.GetChunkSize();
+    /* Every ID, those past the palette read as the empty tile like GetTile() does */
+    MapChunkData chunk;
+    for (int id = 0; id < 256; ++id) {
+        chunk.tiles.push_back(file.GetTile(id));
+    }
+
+    uint64_t hash = kHashOffset;
+    hash = HashMix(hash, (uint64_t) file.GetWidth());
+    hash = HashMix(hash, (uint64_t) file.GetHeight());
+    hash = HashMix(hash, (uint64_t) chunk_size);
+    chunk_hashes->assign((size_t) file.GetChunksX() * file.GetChunksY(), 0);
+    for (int cy = 0; cy < file.GetChunksY(); ++cy) {
+        for (int cx = 0; cx < file.GetChunksX(); ++cx) {
+            const uint8_t* ids = file.GetChunk(cx, cy);
+            const size_t index = (size_t) cy * file.GetChunksX() + cx;
+            if (ids != nullptr) {
+                chunk.cells.assign(reinterpret_cast<const char*>(ids),
+                                   (size_t) chunk_size * chunk_size);
+                (*chunk_hashes)[index] = HashMapChunk(chunk);
+            }
+            hash = HashMix(hash, (*chunk_hashes)[index]);
+        }
+    }
+    return hash ? hash : 1;
+}
+
+/**************************************************************************************/
+int EncodeMapChunk(const MapFile& file, uint32_t index, std::string* out)
+{
+    const int chunk_size = file.GetChunkSize();
+    if (chunk_size > kMapSyncMaxChunkSize || file.GetChunksX() == 0) {
+        return -1;
+    }
+    const int chunks_x = file.GetChunksX();
+    const uint8_t* ids = file.GetChunk(index % chunks_x, index / chunks_x);
+    if (ids == nullptr) {
+        return -1;
+    }
+    const size_t num_cells = (size_t) chunk_size * chunk_size;
+
+    /* Palette of the tiles used, the empty tile first */
+    std::array<int, 256> local_ids;
+    local_ids.fill(-1);
+    std::vector<MapFileTile> tiles{ file.GetTile(0) };
+    local_ids[0] = 0;
+    for (size_t i = 0; i < num_cells; ++i) {
+        if (local_ids[ids[i]] == -1) {
+            local_ids[ids[i]] = (int) tiles.size();
+            tiles.push_back(file.GetTile(ids[i]));
+        }
+    }
+
+    out->clear();
+    protocol::Writer writer(*out);
+    writer.U16((uint16_t) tiles.size());
+    writer.Bytes(reinterpret_cast<const char*>(tiles.data()),
+                 tiles.size() * sizeof(MapFileTile));
+    for (size_t i = 0; i < num_cells;) {
+        size_t length = 1;
+        while (i + length < num_cells && length < 256 && ids[i + length] == ids[i]) {
+            length++;
+        }
+        writer.U8((uint8_t)(length - 1)).U8((uint8_t) local_ids[ids[i]]);
+        i += length;
+    }
+    return 0;
+}
+
+/**************************************************************************************/
+int DecodeMapChunk(const char* data, size_t size, int chunk_size, MapChunkData* chunk)
+{
+    protocol::Reader reader(data, size);
+    const uint16_t num_tiles = reader.U16();
+    const char* tiles = reader.Bytes((size_t) num_tiles * sizeof(MapFileTile));
+    if (reader.Failed() || num_tiles == 0 || num_tiles > 256) {
+        return -1;
+    }
+    chunk->tiles.resize(num_tiles);
+    memcpy(&chunk->tiles[0], tiles, (size_t) num_tiles * sizeof(MapFileTile));
+
+    const size_t num_cells = (size_t) chunk_size * chunk_size;
+    chunk->cells.clear();
+    chunk->cells.reserve(num_cells);
+    while (chunk->cells.size() < num_cells) {
+        const size_t length = reader.U8() + 1;
+        const uint8_t id = reader.U8();
+        if (reader.Failed() || id >= num_tiles ||
+            chunk->cells.size() + length > num_cells) {
+            return -1;
+        }
+        chunk->cells.append(length, static_cast<char>(id));
+    }
+    return reader.Remaining() == 0 ? 0 : -1;
+}
+
+/**************************************************************************************/
+
+/* Create a directory and its parents */
+static int MakeDirectories(const std::string& path)
+{
+    for (size_t pos = path.find('/', 1);; pos = path.find('/', pos + 1)) {
+        const std::string dir = path.substr(0, pos);
+        if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+            return -1;
+        }
+        if (pos == std::string::npos) {
+            return 0;
+        }
+    }
+}
+
+/* Write a whole file, so readers never see it half written */
+static int WriteFileAtomic(const std::string& path, const std::string& data)
+{
+    const std::string temp_path = path + ".tmp" + std::to_string(getpid());
+    FILE* file = fopen(temp_path.c_str(), "wb");
+    if (file == nullptr) {
+        return -1;
+    }
+    const bool written = fwrite(data.data(), 1, data.size(), file) == data.size();
+    if (fclose(file) != 0 || !written || rename(temp_path.c_str(), path.c_str()) != 0) {
+        unlink(temp_path.c_str());
+        return -1;
+    }
+    return 0;
+}
+
+/* Hash as a file name */
+static std::string HashName(uint64_t hash)
+{
+    char name[17];
+    snprintf(name, sizeof(name), "%016" PRIx64, hash);
+    return name;
+}
+
+/**************************************************************************************/
+std::string MapCache::DefaultDirectory()
+{
+    if (const char* dir = getenv("FIGHTTRACK_CACHE")) {
+        return dir;
+    }
+    if (const char* dir = getenv("XDG_CACHE_HOME")) {
+        return std::string{ dir } + "/fighttrack";
+    }
+    if (const char* dir = getenv("HOME")) {
+        return std::string{ dir } + "/.cache/fighttrack";
+    }
+    return {};
+}
+
+/**************************************************************************************/
+int MapCache::Open(const std::string& directory)
+{
+    directory_.clear();
+    if (directory.empty() || MakeDirectories(directory + "/maps") != 0 ||
+        MakeDirectories(directory + "/chunks") != 0) {
+        fprintf(stderr, "MapCache: can't use '%s': %s\n", directory.c_str(),
+                strerror(errno));
+        return -1;
+    }
+    directory_ = directory;
+    return 0;
+}
+
+/**************************************************************************************/
+std::string MapCache::MapPath(uint64_t map_hash) const
+{
+    return directory_ + "/maps/" + HashName(map_hash) + ".ftmap";
+}
+
+/**************************************************************************************/
+bool MapCache::HasMap(uint64_t map_hash) const
+{
+    return IsOpen() && access(MapPath(map_hash).c_str(), R_OK) == 0;
+}
+
+/**************************************************************************************/
+int MapCache::StoreMap(uint64_t map_hash, const std::string& image)
+{
+    if (!IsOpen() || WriteFileAtomic(MapPath(map_hash), image) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/**************************************************************************************/
+int MapCache::LoadChunk(uint64_t chunk_hash, std::string* data) const
+{
+    if (!IsOpen()) {
+        return -1;
+    }
+    const std::string path = directory_ + "/chunks/" + HashName(chunk_hash);
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        return -1;
+    }
+    auto _close_file = gsl::finally([&] { fclose(file); });
+
+    char buffer[4096];
+    size_t n;
+    data->clear();
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        data->append(buffer, n);
+    }
+    return ferror(file) ? -1 : 0;
+}
+
+/**************************************************************************************/
+int MapCache::StoreChunk(uint64_t chunk_hash, const std::string& data)
+{
+    if (!IsOpen() ||
+        WriteFileAtomic(directory_ + "/chunks/" + HashName(chunk_hash), data) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/**************************************************************************************/
+MapDownload::MapDownload()
+    : info_{}, hashes_{}, chunks_{}, missing_{}, index_received_{ 0 }, next_request_{ 0 },
+      in_flight_{ 0 }, pending_{ 0 }, cached_{ 0 }, downloaded_{ 0 }, downloaded_bytes_{ 0 }
+{
+}
+
+/**************************************************************************************/
+int MapDownload::Start(const protocol::MapInfo& info)
+{
+    Stop();
+    if (info.map_hash == 0 || info.chunk_size == 0 ||
+        info.chunk_size > kMapSyncMaxChunkSize || info.width > INT16_MAX ||
+        info.height > INT16_MAX) {
+        fprintf(stderr, "MapDownload: can't download a %ux%u map of %u-cell chunks\n",
+                info.width, info.height, info.chunk_size);
+        return -1;
+    }
+    info_ = info;
+    const size_t chunks_x = (info.width + info.chunk_size - 1) / info.chunk_size;
+    const size_t chunks_y = (info.height + info.chunk_size - 1) / info.chunk_size;
+    hashes_.assign(chunks_x * chunks_y, 0);
+    chunks_.assign(chunks_x * chunks_y, std::string{});
+    return 0;
+}
+
+/**************************************************************************************/
+void MapDownload::Stop()
+{
+    info_ = protocol::MapInfo{};
+    hashes_.clear();
+    chunks_.clear();
+    missing_.clear();
+    index_received_ = 0;
+    next_request_ = 0;
+    in_flight_ = 0;
+    pending_ = 0;
+    cached_ = 0;
+    downloaded_ = 0;
+    downloaded_bytes_ = 0;
+}
+
+/**************************************************************************************/
+int MapDownload::AddIndex(const protocol::MapIndex& msg, const MapCache& cache)
+{
+    if (msg.map_hash != info_.map_hash || msg.first != index_received_ ||
+        msg.count > hashes_.size() - index_received_) {
+        return -1;
+    }
+
+    MapChunkData chunk;
+    for (size_t i = 0; i < msg.count; ++i) {
+        const uint32_t index = msg.first + i;
+        const uint64_t hash = msg.ChunkHash(i);
+        hashes_[index] = hash;
+        if (hash == 0) {
+            continue;  // empty chunk
+        }
+        /* Take it from the cache if it is there and sound */
+        std::string& data = chunks_[index];
+        if (cache.LoadChunk(hash, &data) == 0 &&
+            DecodeMapChunk(data.data(), data.size(), info_.chunk_size, &chunk) == 0 &&
+            HashMapChunk(chunk) == hash) {
+            cached_++;
+            continue;
+        }
+        data.clear();
+        missing_.push_back(index);
+        pending_++;
+    }
+    index_received_ += msg.count;
+    return 0;
+}
+
+/**************************************************************************************/
+int MapDownload::AddChunk(const protocol::MapChunk& msg, MapCache& cache)
+{
+    if (msg.map_hash != info_.map_hash || msg.index >= hashes_.size() ||
+        hashes_[msg.index] == 0 || !chunks_[msg.index].empty()) {
+        return -1;
+    }
+    in_flight_ = in_flight_ ? in_flight_ - 1 : 0;
+
+    MapChunkData chunk;
+    if (msg.chunk_hash != hashes_[msg.index] ||
+        DecodeMapChunk(msg.data, msg.size, info_.chunk_size, &chunk) != 0 ||
+        HashMapChunk(chunk) != msg.chunk_hash) {
+        fprintf(stderr, "MapDownload: chunk %u does not match its hash\n", msg.index);
+        return -1;
+    }
+    chunks_[msg.index].assign(msg.data, msg.size);
+    cache.StoreChunk(msg.chunk_hash, chunks_[msg.index]);
+    pending_--;
+    downloaded_++;
+    downloaded_bytes_ += msg.size;
+    return 0;
+}
+
+/**************************************************************************************/
+size_t MapDownload::NextRequests(uint32_t* indices, size_t max)
+{
+    /* Twice the average chunk size leaves room for bigger chunks ahead */
+    const size_t chunk_bytes = downloaded_ ? 2 * downloaded_bytes_ / downloaded_ + 1
+                                           : MaxEncodedChunkSize(info_.chunk_size);
+    const size_t window = std::max<size_t>(1, kMapDownloadBytes / chunk_bytes);
+
+    size_t count = 0;
+    while (count < max && in_flight_ < window && next_request_ < missing_.size()) {
+        indices[count++] = missing_[next_request_++];
+        in_flight_++;
+    }
+    return count;
+}
+
+/**************************************************************************************/
+bool MapDownload::Complete() const
+{
+    return IndexComplete() && pending_ == 0;
+}
+
+/**************************************************************************************/
+int MapDownload::BuildImage(std::string* image) const
+{
+    if (!Complete()) {
+        return -1;
+    }
+
+    /* Merge the chunk palettes, the empty tile first */
+    std::vector<MapFileTile> tiles{ MapFileTile{ { ' ' }, 0, {} } };
+    std::unordered_map<uint64_t, uint8_t> tile_ids{ { TileWord(tiles[0]), 0 } };
+    std::vector<std::string> chunks(chunks_.size());
+    MapChunkData chunk;
+    for (size_t i = 0; i < chunks_.size(); ++i) {
+        if (hashes_[i] == 0) {
+            continue;
+        }
+        if (DecodeMapChunk(chunks_[i].data(), chunks_[i].size(), info_.chunk_size,
+                           &chunk) != 0) {
+            return -1;
+        }
+        std::array<uint8_t, 256> global_ids{};
+        for (size_t t = 0; t < chunk.tiles.size(); ++t) {
+            auto tile_it = tile_ids.find(TileWord(chunk.tiles[t]));
+            if (tile_it == tile_ids.end()) {
+                if (tiles.size() == 256) {
+                    fprintf(stderr, "MapDownload: more than 256 distinct tiles\n");
+                    return -1;
+                }
+                tiles.push_back(chunk.tiles[t]);
+                tile_it = tile_ids.emplace(TileWord(chunk.tiles[t]),
+                                           (uint8_t)(tiles.size() - 1))
+                              .first;
+            }
+            global_ids[t] = tile_it->second;
+        }
+        chunks[i] = std::move(chunk.cells);
+        for (char& cell : chunks[i]) {
+            cell = static_cast<char>(global_ids[static_cast<uint8_t>(cell)]);
+        }
+    }
+
+    WriteMapImage(info_.width, info_.height, info_.chunk_size, tiles, chunks, image);
+    return 0;
+}
+
+} /* namespace fighttrack */
@@ -0,0 +1,62 @@
+/**
+ * \file physics.cc
+ * \brief Deterministic fixed-point physics of boxes against the map.
+ */
+
+#include "fighttrack/physics.h"
+
+/**************************************************************************************/
+
+namespace fighttrack {
+
+/**************************************************************************************/
+bool IsSolid(const Map& map, const Rect& box)
+{
+    if (box.x < 0 || box.Right() > map.GetWidth() || box.Bottom() > map.GetHeight()) {
+        return true;
+    }
+    return map.IsGround(box.x, box.y, box.width, box.height);
+}
+
+/**************************************************************************************/
+bool MoveX(const Map& map, Rect box, int32_t* pos_x, int32_t vel_x)
+{
+    const int32_t target = *pos_x + vel_x;
+    const int target_cell = ToCell(target);
+    const int dir = (vel_x > 0) ? 1 : -1;
+
+    /* Sweep a column at a time, checking the column entered */
+    while (box.x != target_cell) {
+        const int column = (dir > 0) ? box.Right() : box.x - 1;
+        if (IsSolid(map, { column, box.y, 1, box.height })) {
+            /* Stop against it, as close as the current column allows */
+            *pos_x = ToSubcells(box.x) + ((dir > 0) ? kSubcells - 1 : 0);
+            return true;
+        }
+        box.x += dir;
+    }
+    *pos_x = target;
+    return false;
+}
+
+/**************************************************************************************/
+bool MoveY(const Map& map, Rect box, int32_t* pos_y, int32_t vel_y)
+{
+    const int32_t target = *pos_y + vel_y;
+    const int target_cell = ToCell(target);
+    const int dir = (vel_y > 0) ? 1 : -1;
+
+    /* Sweep a row at a time, checking the row entered */
+    while (box.y != target_cell) {
+        const int row = (dir > 0) ? box.Bottom() : box.y - 1;
+        if (IsSolid(map, { box.x, row, box.width, 1 })) {
+            *pos_y = ToSubcells(box.y) + ((dir > 0) ? kSubcells - 1 : 0);
+            return true;
+        }
+        box.y += dir;
+    }
+    *pos_y = target;
+    return false;
+}
+
+} /* namespace fighttrack */
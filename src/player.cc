@@ -4,62 +4,55 @@
  */
 
 #include "fighttrack/player.h"
-#include "fighttrack/player_states.h"
+
+#include <algorithm>
 
 /**************************************************************************************/
 
 namespace fighttrack {
 
-Player::Player(std::string name)
-    : name_{ name },
-      state_{ &PlayerState::States::standing },
-      heart_{ 100 },
-      art_{ {} },
-      pos_x_{ 0 },
-      pos_y_{ 0 },
-      jump_ticks_{ 0 },
-      dirty_{ false }
-{
-}
-
-/**************************************************************************************/
-
-Player::~Player()
+void Player::HandleInput(int input)
 {
+    PlayerState& state = store_->state_[pos_];
+    const PlayerTransition transition =
+        PlayerStateTransition(state, PlayerInputFromKey(input));
+    state = transition.next;
+    if (transition.jump) {
+        StartJump();
+    }
 }
 
 /**************************************************************************************/
 
-void Player::HandleInput(int input)
+void Player::Draw(Canvas& canvas, const Camera& camera)
 {
-    state_ = state_->HandleInput(*this, input);
+    if (!GetDrawBounds().Intersects(camera.View())) {
+        return;
+    }
+    const int pos_x = camera.ToScreenX(GetPosX());
+    const int pos_y = camera.ToScreenY(GetPosY());
+    const std::string& name = GetName();
+    DrawClipped(canvas, pos_x - 2, pos_y - 1, name.c_str(), name.length(),
+                camera.Screen());
+    SpriteRegistry::Global().Get(GetSprite()).Draw(pos_x, pos_y, canvas, camera.Screen());
 }
 
 /**************************************************************************************/
 
-int Player::Update()
+Rect Player::GetBounds() const
 {
-    state_->Update(*this);
-
-    if (jump_ticks_ > 0) {
-        if (jump_ticks_ > 3) {
-            SetPosY(GetPosY() - 1);
-        }
-        else {
-            SetPosY(GetPosY() + 1);
-        }
-        jump_ticks_--;
-    }
-
-    return 0;
+    return store_->GetBounds(pos_);
 }
 
 /**************************************************************************************/
 
-void Player::Draw(WINDOW* win)
+Rect Player::GetDrawBounds() const
 {
-    mvwaddnstr(win, pos_y_ - 1, pos_x_ - 2, name_.c_str(), name_.length());
-    art_.Draw(pos_x_, pos_y_, win);
+    /* The name is drawn on the row above, from 2 columns before */
+    const Rect bounds = GetBounds();
+    const int name_width = (int) GetName().length();
+    return { bounds.x - 2, bounds.y - 1, std::max(bounds.width + 2, name_width),
+             bounds.height + 1 };
 }
 
 /**************************************************************************************/
@@ -71,8 +64,9 @@ Player& Player::Damage(int value)
         return *this;
     }
 
-    heart_ -= value;
-    heart_ = heart_ < 0 ? 0 : heart_;
+    int& health = store_->health_[pos_];
+    health -= value;
+    health = health < 0 ? 0 : health;
 
     return *this;
 }
@@ -81,10 +75,9 @@ Player& Player::Damage(int value)
 
 Player& Player::StartJump()
 {
-    if (!IsJumping())
-        jump_ticks_ = 6;
+    store_->jump_[pos_] = true;
 
-    dirty_ = true;
+    store_->dirty_[pos_] = true;
     return *this;
 }
 
@@ -92,7 +85,7 @@ Player& Player::StartJump()
 
 bool Player::IsJumping() const
 {
-    return jump_ticks_ > 0;
+    return !store_->on_ground_[pos_];
 }
 
 } /* namespace fighttrack */
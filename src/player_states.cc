@@ -3,125 +3,139 @@
  * \brief Player States definition.
  */
 
-#include "fighttrack/player.h"
 #include "fighttrack/player_states.h"
 
+#include <ncurses.h>
+
 /**************************************************************************************/
 
 namespace fighttrack {
 
-PlayerState::Standing PlayerState::States::standing{};
-PlayerState::Walking PlayerState::States::walking{
-    PlayerState::Walking::Direction::RIGHT
-};
-PlayerState::Jumping PlayerState::States::jumping{};
-PlayerState::Hit PlayerState::States::hit{};
-PlayerState::Dying PlayerState::States::dying{};
-PlayerState::Dead PlayerState::States::dead{};
+namespace {
 
-/**************************************************************************************/
+constexpr size_t kNumStates = static_cast<size_t>(PlayerState::COUNT);
+constexpr size_t kNumInputs = static_cast<size_t>(PlayerInput::COUNT);
+
+using S = PlayerState;
+
+/**
+ * Transitions of a state, for every input
+ */
+struct TransitionRow {
+    PlayerState state;                //!< State of the row, checked below
+    PlayerTransition on[kNumInputs];  //!< Index: input
+};
 
-PlayerState* PlayerState::Standing::HandleInput(Player& player, int input)
+/* Transition to a state, with or without starting a jump */
+constexpr PlayerTransition Go(PlayerState next)
 {
-    switch (input) {
-        case KEY_UP: {
-            player.StartJump();
-            return this;
-        }
-        case KEY_RIGHT: return &(States::walking = Walking(Walking::RIGHT));
-        case KEY_LEFT: return &(States::walking = Walking(Walking::LEFT));
-    }
-    return this;
+    return { next, false };
 }
-
-void PlayerState::Standing::Update(Player& player)
+constexpr PlayerTransition Jump(PlayerState next)
 {
-    static const AsciiArt kArtStanding{ {
-        " o ",
-        "/|\\",
-        "/ \\",
-    } };
-    player.SetGraphics(kArtStanding);
+    return { next, true };
 }
 
-/**************************************************************************************/
+/* clang-format off */
+constexpr TransitionRow kTransitions[] = {
+    /* state, then on input NONE, JUMP, LEFT, RIGHT */
+    { S::STANDING,
+      { Go(S::STANDING), Jump(S::STANDING), Go(S::WALKING_LEFT), Go(S::WALKING_RIGHT) } },
+    { S::WALKING_LEFT,
+      { Go(S::WALKING_LEFT), Jump(S::WALKING_LEFT), Go(S::WALKING_LEFT),
+        Go(S::STANDING) } },
+    { S::WALKING_RIGHT,
+      { Go(S::WALKING_RIGHT), Jump(S::WALKING_RIGHT), Go(S::STANDING),
+        Go(S::WALKING_RIGHT) } },
+    { S::JUMPING,
+      { Go(S::JUMPING), Jump(S::STANDING), Go(S::WALKING_LEFT), Go(S::WALKING_RIGHT) } },
+    { S::HIT, { Go(S::HIT), Go(S::HIT), Go(S::HIT), Go(S::HIT) } },
+    { S::DYING, { Go(S::DYING), Go(S::DYING), Go(S::DYING), Go(S::DYING) } },
+    { S::DEAD, { Go(S::DEAD), Go(S::DEAD), Go(S::DEAD), Go(S::DEAD) } },
+};
+
+constexpr PlayerStateBehavior kBehaviors[] = {
+    /* walk  jump   next */
+    {  0,    false, S::STANDING },       // STANDING
+    { -1,    false, S::WALKING_LEFT },   // WALKING_LEFT
+    {  1,    false, S::WALKING_RIGHT },  // WALKING_RIGHT
+    {  0,    true,  S::STANDING },       // JUMPING: jump once, then stand
+    {  0,    false, S::HIT },            // HIT
+    {  0,    false, S::DYING },          // DYING
+    {  0,    false, S::DEAD },           // DEAD
+};
+/* clang-format on */
 
-PlayerState* PlayerState::Walking::HandleInput(Player& player, int input)
+/* Every row in state order, and no transition out of range */
+constexpr bool IsValid(const TransitionRow (&rows)[kNumStates])
 {
-    switch (input) {
-        case KEY_UP: {
-            player.StartJump();
-            return this;
-        }
-        case KEY_RIGHT: {
-            if (direction_ == Direction::RIGHT)
-                return this;
-            return &(States::standing = Standing());
-        }
-        case KEY_LEFT: {
-            if (direction_ == Direction::LEFT)
-                return this;
-            return &(States::standing = Standing());
+    for (size_t s = 0; s < kNumStates; ++s) {
+        if (static_cast<size_t>(rows[s].state) != s)
+            return false;
+        for (size_t i = 0; i < kNumInputs; ++i) {
+            if (rows[s].on[i].next >= S::COUNT)
+                return false;
         }
     }
-    return this;
+    return true;
 }
 
-void PlayerState::Walking::Update(Player& player)
+constexpr bool IsValid(const PlayerStateBehavior (&behaviors)[kNumStates])
 {
-    threshold_++;
-    if (threshold_ >= 2) {
-        player.SetPosX(player.GetPosX() + static_cast<int>(direction_));
-        threshold_ = 0;
+    for (size_t s = 0; s < kNumStates; ++s) {
+        if (behaviors[s].next >= S::COUNT || behaviors[s].walk < -1 ||
+            behaviors[s].walk > 1)
+            return false;
     }
+    return true;
 }
 
-/**************************************************************************************/
+static_assert(IsValid(kTransitions), "Player transition table is inconsistent");
+static_assert(IsValid(kBehaviors), "Player behavior table is inconsistent");
 
-PlayerState* PlayerState::Jumping::HandleInput(Player& player, int input)
-{
-    return Standing().HandleInput(player, input);
-}
+}  // namespace
 
-void PlayerState::Jumping::Update(Player& player)
+/**************************************************************************************/
+PlayerInput PlayerInputFromKey(int key)
 {
-    if (!jumped_) {
-        player.StartJump();
-        jumped_ = true;
+    switch (key) {
+        case KEY_UP: return PlayerInput::JUMP;
+        case KEY_LEFT: return PlayerInput::LEFT;
+        case KEY_RIGHT: return PlayerInput::RIGHT;
     }
+    return PlayerInput::NONE;
 }
 
 /**************************************************************************************/
-
-PlayerState* PlayerState::Hit::HandleInput(Player& player, int input)
-{
-    return this;
-}
-
-void PlayerState::Hit::Update(Player& player)
+PlayerTransition PlayerStateTransition(PlayerState state, PlayerInput input)
 {
+    return kTransitions[static_cast<size_t>(state)].on[static_cast<size_t>(input)];
 }
 
 /**************************************************************************************/
-
-PlayerState* PlayerState::Dying::HandleInput(Player& player, int input)
-{
-    return this;
-}
-
-void PlayerState::Dying::Update(Player& player)
+const PlayerStateBehavior* PlayerStateBehaviors()
 {
+    return kBehaviors;
 }
 
 /**************************************************************************************/
-
-PlayerState* PlayerState::Dead::HandleInput(Player& player, int input)
-{
-    return this;
-}
-
-void PlayerState::Dead::Update(Player& player)
+const SpriteId* PlayerStateSprites()
 {
+    static const SpriteId kSpriteStanding = SpriteRegistry::Global().Register({ {
+        " o ",
+        "/|\\",
+        "/ \\",
+    } });
+    static const SpriteId kSprites[kNumStates] = {
+        kSpriteStanding,  // STANDING
+        kSpriteStanding,  // WALKING_LEFT
+        kSpriteStanding,  // WALKING_RIGHT
+        kSpriteStanding,  // JUMPING
+        kSpriteStanding,  // HIT
+        kSpriteStanding,  // DYING
+        kSpriteStanding,  // DEAD
+    };
+    return kSprites;
 }
 
 } /* namespace fighttrack */
@@ -0,0 +1,468 @@
+/**
+ * \file protocol.cc
+ * \brief Binary network protocol.
+ */
+
+#include "fighttrack/protocol.h"
+
+/**************************************************************************************/
+
+namespace fighttrack {
+namespace protocol {
+
+/**************************************************************************************/
+void Encode(std::string& out, const PlayerName& msg)
+{
+    Writer(out)
+        .BeginFrame(MessageType::PLAYER_NAME)
+        .U8(msg.length)
+        .Bytes(msg.name, msg.length)
+        .EndFrame();
+}
+
+/**************************************************************************************/
+void Encode(std::string& out, const KeyPress& msg)
+{
+    Writer(out).BeginFrame(MessageType::KEY_PRESS).I32(msg.key).EndFrame();
+}
+
+/**************************************************************************************/
+void Encode(std::string& out, const Welcome& msg)
+{
+    Writer(out)
+        .BeginFrame(MessageType::WELCOME)
+        .U32(msg.entity_id)
+        .U32(msg.token)
+        .EndFrame();
+}
+
+/**************************************************************************************/
+void Encode(std::string& out, const PlayerInfo& msg)
+{
+    Writer(out)
+        .BeginFrame(MessageType::PLAYER_INFO)
+        .U32(msg.entity_id)
+        .U8(msg.length)
+        .Bytes(msg.name, msg.length)
+        .EndFrame();
+}
+
+/**************************************************************************************/
+void Encode(std::string& out, const PlayerLeave& msg)
+{
+    Writer(out).BeginFrame(MessageType::PLAYER_LEAVE).U32(msg.entity_id).EndFrame();
+}
+
+/**************************************************************************************/
+void Encode(std::string& out, const SnapshotAck& msg)
+{
+    Writer(out).BeginFrame(MessageType::SNAPSHOT_ACK).U32(msg.sequence).EndFrame();
+}
+
+/**************************************************************************************/
+void Encode(std::string& out, const UdpHello& msg)
+{
+    Writer(out)
+        .BeginFrame(MessageType::UDP_HELLO)
+        .U32(msg.entity_id)
+        .U32(msg.token)
+        .EndFrame();
+}
+
+/**************************************************************************************/
+void Encode(std::string& out, const MapInfo& msg)
+{
+    Writer(out)
+        .BeginFrame(MessageType::MAP_INFO)
+        .U64(msg.map_hash)
+        .U32(msg.width)
+        .U32(msg.height)
+        .U16(msg.chunk_size)
+        .EndFrame();
+}
+
+/**************************************************************************************/
+void Encode(std::string& out, const MapIndexRequest& msg)
+{
+    Writer(out)
+        .BeginFrame(MessageType::MAP_INDEX_REQUEST)
+        .U64(msg.map_hash)
+        .U32(msg.first)
+        .EndFrame();
+}
+
+/**************************************************************************************/
+void Encode(std::string& out, const MapChunk& msg)
+{
+    Writer(out)
+        .BeginFrame(MessageType::MAP_CHUNK)
+        .U64(msg.map_hash)
+        .U32(msg.index)
+        .U64(msg.chunk_hash)
+        .U16(msg.size)
+        .Bytes(msg.data, msg.size)
+        .EndFrame();
+}
+
+/**************************************************************************************/
+void EncodeMapIndex(std::string& out, uint64_t map_hash, uint32_t first,
+                    const uint64_t* hashes, uint16_t count)
+{
+    Writer writer(out);
+    writer.BeginFrame(MessageType::MAP_INDEX).U64(map_hash).U32(first).U16(count);
+    for (size_t i = 0; i < count; ++i) {
+        writer.U64(hashes[i]);
+    }
+    writer.EndFrame();
+}
+
+/**************************************************************************************/
+void EncodeMapChunkRequest(std::string& out, uint64_t map_hash, const uint32_t* indices,
+                           uint16_t count)
+{
+    Writer writer(out);
+    writer.BeginFrame(MessageType::MAP_CHUNK_REQUEST).U64(map_hash).U16(count);
+    for (size_t i = 0; i < count; ++i) {
+        writer.U32(indices[i]);
+    }
+    writer.EndFrame();
+}
+
+/**************************************************************************************/
+SnapshotWriter::SnapshotWriter(std::string& out, const SnapshotHeader& header)
+    : writer_{ out }, count_offset_{ 0 }, count_{ 0 }
+{
+    writer_.BeginFrame(MessageType::SNAPSHOT).U32(header.sequence).U32(header.baseline);
+    count_offset_ = writer_.Offset();
+    writer_.U16(0);
+}
+
+/**************************************************************************************/
+void SnapshotWriter::Add(const EntityDelta& delta)
+{
+    writer_.U32(delta.entity_id).U8(delta.fields);
+    if (delta.fields & kFieldPosX)
+        writer_.I16(delta.pos_x);
+    if (delta.fields & kFieldPosY)
+        writer_.I16(delta.pos_y);
+    count_++;
+}
+
+/**************************************************************************************/
+bool SnapshotWriter::End()
+{
+    writer_.PatchU16(count_offset_, count_);
+    if (!writer_.EndFrame()) {
+        fprintf(stderr, "Protocol: snapshot of %u entities exceeds frame size\n", count_);
+        return false;
+    }
+    return true;
+}
+
+/**************************************************************************************/
+int ParseFrame(const char* data, size_t size, Frame* frame)
+{
+    if (size < kHeaderSize) {
+        return 0;
+    }
+
+    Reader reader(data, kHeaderSize);
+    const uint16_t frame_size = reader.U16();
+    const uint8_t version = reader.U8();
+    const uint8_t type = reader.U8();
+
+    if (version != kVersion || frame_size < kHeaderSize) {
+        return -1;
+    }
+    if (size < frame_size) {
+        return 0;
+    }
+
+    frame->type = static_cast<MessageType>(type);
+    frame->payload = data + kHeaderSize;
+    frame->size = frame_size - kHeaderSize;
+    return frame_size;
+}
+
+/**************************************************************************************/
+bool Decode(const Frame& frame, PlayerName* msg)
+{
+    Reader reader(frame.payload, frame.size);
+    msg->length = reader.U8();
+    msg->name = reader.Bytes(msg->length);
+    return !reader.Failed() && msg->length <= kMaxNameLength;
+}
+
+/**************************************************************************************/
+bool Decode(const Frame& frame, KeyPress* msg)
+{
+    Reader reader(frame.payload, frame.size);
+    msg->key = reader.I32();
+    return !reader.Failed();
+}
+
+/**************************************************************************************/
+bool Decode(const Frame& frame, Welcome* msg)
+{
+    Reader reader(frame.payload, frame.size);
+    msg->entity_id = reader.U32();
+    msg->token = reader.U32();
+    return !reader.Failed();
+}
+
+/**************************************************************************************/
+bool Decode(const Frame& frame, PlayerInfo* msg)
+{
+    Reader reader(frame.payload, frame.size);
+    msg->entity_id = reader.U32();
+    msg->length = reader.U8();
+    msg->name = reader.Bytes(msg->length);
+    return !reader.Failed() && msg->length <= kMaxNameLength;
+}
+
+/**************************************************************************************/
+bool Decode(const Frame& frame, PlayerLeave* msg)
+{
+    Reader reader(frame.payload, frame.size);
+    msg->entity_id = reader.U32();
+    return !reader.Failed();
+}
+
+/**************************************************************************************/
+bool Decode(const Frame& frame, SnapshotAck* msg)
+{
+    Reader reader(frame.payload, frame.size);
+    msg->sequence = reader.U32();
+    return !reader.Failed();
+}
+
+/**************************************************************************************/
+bool Decode(const Frame& frame, UdpHello* msg)
+{
+    Reader reader(frame.payload, frame.size);
+    msg->entity_id = reader.U32();
+    msg->token = reader.U32();
+    return !reader.Failed();
+}
+
+/**************************************************************************************/
+bool Decode(const Frame& frame, MapInfo* msg)
+{
+    Reader reader(frame.payload, frame.size);
+    msg->map_hash = reader.U64();
+    msg->width = reader.U32();
+    msg->height = reader.U32();
+    msg->chunk_size = reader.U16();
+    return !reader.Failed();
+}
+
+/**************************************************************************************/
+bool Decode(const Frame& frame, MapIndexRequest* msg)
+{
+    Reader reader(frame.payload, frame.size);
+    msg->map_hash = reader.U64();
+    msg->first = reader.U32();
+    return !reader.Failed();
+}
+
+/**************************************************************************************/
+bool Decode(const Frame& frame, MapIndex* msg)
+{
+    Reader reader(frame.payload, frame.size);
+    msg->map_hash = reader.U64();
+    msg->first = reader.U32();
+    msg->count = reader.U16();
+    msg->hashes = reader.Bytes((size_t) msg->count * sizeof(uint64_t));
+    return !reader.Failed();
+}
+
+/**************************************************************************************/
+uint64_t MapIndex::ChunkHash(size_t i) const
+{
+    return Reader(hashes + i * sizeof(uint64_t), sizeof(uint64_t)).U64();
+}
+
+/**************************************************************************************/
+bool Decode(const Frame& frame, MapChunkRequest* msg)
+{
+    Reader reader(frame.payload, frame.size);
+    msg->map_hash = reader.U64();
+    msg->count = reader.U16();
+    msg->indices = reader.Bytes((size_t) msg->count * sizeof(uint32_t));
+    return !reader.Failed() && msg->count <= kMaxMapChunkRequest;
+}
+
+/**************************************************************************************/
+uint32_t MapChunkRequest::ChunkIndex(size_t i) const
+{
+    return Reader(indices + i * sizeof(uint32_t), sizeof(uint32_t)).U32();
+}
+
+/**************************************************************************************/
+bool Decode(const Frame& frame, MapChunk* msg)
+{
+    Reader reader(frame.payload, frame.size);
+    msg->map_hash = reader.U64();
+    msg->index = reader.U32();
+    msg->chunk_hash = reader.U64();
+    msg->size = reader.U16();
+    msg->data = reader.Bytes(msg->size);
+    return !reader.Failed();
+}
+
+/**************************************************************************************/
+SnapshotReader::SnapshotReader(const Frame& frame)
+    : reader_{ frame.payload, frame.size }, header_{}, left_{ 0 }
+{
+    header_.sequence = reader_.U32();
+    header_.baseline = reader_.U32();
+    left_ = reader_.U16();
+}
+
+/**************************************************************************************/
+bool SnapshotReader::Next(EntityDelta* delta)
+{
+    if (left_ == 0 || reader_.Failed()) {
+        return false;
+    }
+    delta->entity_id = reader_.U32();
+    delta->fields = reader_.U8();
+    delta->pos_x = (delta->fields & kFieldPosX) ? reader_.I16() : 0;
+    delta->pos_y = (delta->fields & kFieldPosY) ? reader_.I16() : 0;
+    left_--;
+    return !reader_.Failed();
+}
+
+/**************************************************************************************/
+void DumpFrame(FILE* file, const char* prefix, const Frame& frame)
+{
+    switch (frame.type) {
+        case MessageType::PLAYER_NAME: {
+            PlayerName msg;
+            if (Decode(frame, &msg)) {
+                fprintf(file, "%sPLAYER_NAME '%.*s'\n", prefix, msg.length, msg.name);
+                return;
+            }
+            break;
+        }
+        case MessageType::KEY_PRESS: {
+            KeyPress msg;
+            if (Decode(frame, &msg)) {
+                fprintf(file, "%sKEY_PRESS %d\n", prefix, msg.key);
+                return;
+            }
+            break;
+        }
+        case MessageType::SNAPSHOT: {
+            SnapshotReader reader(frame);
+            EntityDelta delta;
+            fprintf(file, "%sSNAPSHOT #%u (baseline #%u)", prefix, reader.Header().sequence,
+                    reader.Header().baseline);
+            while (reader.Next(&delta)) {
+                fprintf(file, " %u:", delta.entity_id);
+                if (delta.fields & kFieldRemoved)
+                    fprintf(file, "removed");
+                if (delta.fields & kFieldPosX)
+                    fprintf(file, "x=%d", delta.pos_x);
+                if (delta.fields & kFieldPosY)
+                    fprintf(file, "%sy=%d", (delta.fields & kFieldPosX) ? "," : "",
+                            delta.pos_y);
+            }
+            fprintf(file, reader.Failed() ? " (malformed)\n" : "\n");
+            return;
+        }
+        case MessageType::SNAPSHOT_ACK: {
+            SnapshotAck msg;
+            if (Decode(frame, &msg)) {
+                fprintf(file, "%sSNAPSHOT_ACK #%u\n", prefix, msg.sequence);
+                return;
+            }
+            break;
+        }
+        case MessageType::PLAYER_LEAVE: {
+            PlayerLeave msg;
+            if (Decode(frame, &msg)) {
+                fprintf(file, "%sPLAYER_LEAVE %u\n", prefix, msg.entity_id);
+                return;
+            }
+            break;
+        }
+        case MessageType::WELCOME: {
+            Welcome msg;
+            if (Decode(frame, &msg)) {
+                fprintf(file, "%sWELCOME %u\n", prefix, msg.entity_id);
+                return;
+            }
+            break;
+        }
+        case MessageType::UDP_HELLO: {
+            UdpHello msg;
+            if (Decode(frame, &msg)) {
+                fprintf(file, "%sUDP_HELLO %u\n", prefix, msg.entity_id);
+                return;
+            }
+            break;
+        }
+        case MessageType::MAP_INFO: {
+            MapInfo msg;
+            if (Decode(frame, &msg)) {
+                fprintf(file, "%sMAP_INFO %016llx %ux%u\n", prefix,
+                        (unsigned long long) msg.map_hash, msg.width, msg.height);
+                return;
+            }
+            break;
+        }
+        case MessageType::MAP_INDEX_REQUEST: {
+            MapIndexRequest msg;
+            if (Decode(frame, &msg)) {
+                fprintf(file, "%sMAP_INDEX_REQUEST %016llx from %u\n", prefix,
+                        (unsigned long long) msg.map_hash, msg.first);
+                return;
+            }
+            break;
+        }
+        case MessageType::MAP_INDEX: {
+            MapIndex msg;
+            if (Decode(frame, &msg)) {
+                fprintf(file, "%sMAP_INDEX %016llx chunks %u~%u\n", prefix,
+                        (unsigned long long) msg.map_hash, msg.first,
+                        msg.first + msg.count);
+                return;
+            }
+            break;
+        }
+        case MessageType::MAP_CHUNK_REQUEST: {
+            MapChunkRequest msg;
+            if (Decode(frame, &msg)) {
+                fprintf(file, "%sMAP_CHUNK_REQUEST %016llx %u chunks\n", prefix,
+                        (unsigned long long) msg.map_hash, msg.count);
+                return;
+            }
+            break;
+        }
+        case MessageType::MAP_CHUNK: {
+            MapChunk msg;
+            if (Decode(frame, &msg)) {
+                fprintf(file, "%sMAP_CHUNK %016llx #%u %016llx, %u bytes\n", prefix,
+                        (unsigned long long) msg.map_hash, msg.index,
+                        (unsigned long long) msg.chunk_hash, msg.size);
+                return;
+            }
+            break;
+        }
+        case MessageType::PLAYER_INFO: {
+            PlayerInfo msg;
+            if (Decode(frame, &msg)) {
+                fprintf(file, "%sPLAYER_INFO %u '%.*s'\n", prefix, msg.entity_id,
+                        msg.length, msg.name);
+                return;
+            }
+            break;
+        }
+    }
+    fprintf(file, "%sframe type %d, %zu bytes\n", prefix, static_cast<int>(frame.type),
+            frame.size);
+}
+
+} /* namespace protocol */
+} /* namespace fighttrack */
@@ -0,0 +1,123 @@
+/**
+ * \file renderer.cc
+ * \brief Incremental renderer, redrawing only what changed on screen.
+ */
+
+#include "fighttrack/renderer.h"
+
+#include <algorithm>
+
+#include "fighttrack/player.h"
+
+/**************************************************************************************/
+
+namespace fighttrack {
+
+/**************************************************************************************/
+Renderer::Renderer()
+    : full_redraw_{ true }, screen_{ 0, 0, 0, 0 }, view_{ 0, 0, 0, 0 }, previous_{},
+      current_{}, damage_{}
+{
+}
+
+/**************************************************************************************/
+void Renderer::Render(Canvas& canvas, const Camera& camera, Map& map,
+                      EntityStore& entities)
+{
+    Collect(entities);
+    damage_.clear();
+
+    if (full_redraw_ || camera.Screen() != screen_ || camera.View() != view_) {
+        canvas.Clear({ 0, 0, canvas.GetWidth(), canvas.GetHeight() });
+        canvas.Border();
+        damage_.push_back(camera.Screen());
+        full_redraw_ = false;
+        screen_ = camera.Screen();
+        view_ = camera.View();
+    }
+    else {
+        /* Walk both frames by handle: an entity gone, new, or changed damages where it
+         * was and where it is */
+        size_t p = 0, c = 0;
+        while (p < previous_.size() || c < current_.size()) {
+            if (c == current_.size() ||
+                (p < previous_.size() && previous_[p].handle < current_[c].handle)) {
+                Damage(camera, previous_[p++].bounds);
+            }
+            else if (p == previous_.size() ||
+                     current_[c].handle < previous_[p].handle) {
+                Damage(camera, current_[c++].bounds);
+            }
+            else {
+                if (previous_[p] != current_[c]) {
+                    Damage(camera, previous_[p].bounds);
+                    Damage(camera, current_[c].bounds);
+                }
+                ++p, ++c;
+            }
+        }
+    }
+    std::swap(previous_, current_);
+
+    if (damage_.empty()) {
+        return;  // same as on the terminal
+    }
+    for (const Rect& screen : damage_) {
+        Redraw(canvas, camera, map, entities, screen);
+    }
+    canvas.Present();
+}
+
+/**************************************************************************************/
+void Renderer::Collect(EntityStore& entities)
+{
+    /* Assigned in place, so the names keep their buffers */
+    current_.resize(entities.Size());
+    for (size_t i = 0; i < entities.Size(); ++i) {
+        const Player player = entities.Get(i);
+        Drawn& drawn = current_[i];
+        drawn.handle = entities.HandleAt(i);
+        drawn.order = i;
+        drawn.bounds = player.GetDrawBounds();
+        drawn.sprite = player.GetSprite();
+        drawn.name = player.GetName();
+    }
+    std::sort(current_.begin(), current_.end(),
+              [](const Drawn& a, const Drawn& b) { return a.handle < b.handle; });
+}
+
+/**************************************************************************************/
+void Renderer::Damage(const Camera& camera, const Rect& bounds)
+{
+    Rect screen = Rect{ camera.ToScreenX(bounds.x), camera.ToScreenY(bounds.y),
+                        bounds.width, bounds.height }
+                      .Intersection(camera.Screen());
+    if (screen.Empty()) {
+        return;  // out of view
+    }
+    /* Fold overlapping rectangles, so no cell is drawn twice */
+    for (size_t i = 0; i < damage_.size();) {
+        if (damage_[i].Intersects(screen)) {
+            screen = screen.Union(damage_[i]);
+            damage_[i] = damage_.back();
+            damage_.pop_back();
+            i = 0;  // the union may reach the ones checked already
+        }
+        else {
+            ++i;
+        }
+    }
+    damage_.push_back(screen);
+}
+
+/**************************************************************************************/
+void Renderer::Redraw(Canvas& canvas, const Camera& camera, Map& map,
+                      EntityStore& entities, const Rect& screen)
+{
+    canvas.Clear(screen);
+    const Camera clip = camera.Crop(screen);
+    map.Draw(canvas, clip);
+    entities.Draw(canvas, clip);
+}
+
+} /* namespace fighttrack */
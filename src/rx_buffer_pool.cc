@@ -0,0 +1,84 @@
+/**
+ * \file rx_buffer_pool.cc
+ * \brief Pool of fixed-size receive buffers recycled between two threads.
+ */
+
+#include "fighttrack/rx_buffer_pool.h"
+
+#include <algorithm>
+
+/**************************************************************************************/
+
+namespace fighttrack {
+
+/**************************************************************************************/
+RxBufferPool::RxBufferPool()
+    : storage_{}, free_{}, released_{}, max_buffers_{ 0 }, stat_hits_{ 0 },
+      stat_misses_{ 0 }
+{
+}
+
+/**************************************************************************************/
+void RxBufferPool::Reset(size_t max_buffers, size_t preallocate)
+{
+    storage_.clear();
+    free_.clear();
+    max_buffers_ = max_buffers;
+    /* Room for every buffer, so releasing never fails */
+    released_.Reset(max_buffers);
+
+    preallocate = std::min(preallocate, max_buffers);
+    storage_.reserve(max_buffers);
+    free_.reserve(max_buffers);
+    for (size_t i = 0; i < preallocate; ++i) {
+        storage_.emplace_back(new char[kBufferSize]);
+        free_.push_back(storage_.back().get());
+    }
+    stat_hits_ = 0;
+    stat_misses_ = 0;
+}
+
+/**************************************************************************************/
+char* RxBufferPool::Acquire()
+{
+    /* Take back the buffers released by the consumer */
+    if (free_.empty()) {
+        while (char** released = released_.Front()) {
+            free_.push_back(*released);
+            released_.Pop();
+        }
+    }
+
+    if (!free_.empty()) {
+        char* buffer = free_.back();
+        free_.pop_back();
+        stat_hits_++;
+        return buffer;
+    }
+
+    if (storage_.size() == max_buffers_) {
+        return nullptr;
+    }
+    storage_.emplace_back(new char[kBufferSize]);
+    stat_misses_++;
+    return storage_.back().get();
+}
+
+/**************************************************************************************/
+void RxBufferPool::Release(const char* buffer)
+{
+    char** slot = released_.BeginPush();
+    if (slot == nullptr) {
+        return;  // can't happen, there is room for every buffer
+    }
+    *slot = const_cast<char*>(buffer);
+    released_.CommitPush();
+}
+
+/**************************************************************************************/
+RxBufferPool::Stats RxBufferPool::GetStats() const
+{
+    return { stat_hits_, stat_misses_ };
+}
+
+} /* namespace fighttrack */
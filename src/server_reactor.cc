@@ -0,0 +1,441 @@
+/**
+ * \file server_reactor.cc
+ * \brief Server Socket event loop, common to all I/O backends.
+ */
+
+#include "fighttrack/server_reactor.h"
+
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+
+#include <algorithm>
+#include <gsl/gsl>
+
+/**************************************************************************************/
+
+namespace fighttrack {
+
+/**************************************************************************************/
+ServerReactor::ServerReactor(const Options& options, int index, int count)
+    : rx_queue{},
+      stat_messages_queued{ 0 },
+      stat_messages_dropped{ 0 },
+      stat_bytes_sent{ 0 },
+      stat_send_calls{ 0 },
+      stat_rx_messages{ 0 },
+      stat_rx_overflows{ 0 },
+      options_{ options },
+      index_{ index },
+      count_{ count },
+      listen_sock_{ -1 },
+      event_fd_{ -1 },
+      terminate_{ false },
+      clients_{},
+      num_clients_{ 0 },
+      event_thread_{},
+      slots_{ 0 },
+      tx_pending_slots_{},
+      tx_requests_{},
+      tx_data_{}
+{
+}
+
+/**************************************************************************************/
+ServerReactor::~ServerReactor()
+{
+}
+
+/**************************************************************************************/
+int ServerReactor::Initialize(uint16_t port)
+{
+    int ret = 0;
+
+    if (OpenSockets(port) != 0) {
+        return ret = -1;
+    }
+    auto _close_sockets = gsl::finally([&] {
+        if (ret != 0) {
+            close(event_fd_);
+            close(listen_sock_);
+        }
+    });
+
+    { /* Reset the client table and the client slots */
+        const size_t num_slots = (options_.max_clients - index_ + count_ - 1) / count_;
+        slots_.Reset(num_slots);
+        clients_.clear();
+        clients_.resize(num_slots);
+        for (auto& client : clients_) {
+            client.sock = -1;
+        }
+        num_clients_ = 0;
+    }
+    stat_messages_queued = 0;
+    stat_messages_dropped = 0;
+    stat_bytes_sent = 0;
+    stat_send_calls = 0;
+    stat_rx_messages = 0;
+    stat_rx_overflows = 0;
+    rx_queue.Reset(options_.rx_queue_size);
+    /* A buffer per queue slot at most, since buffers are released before slots */
+    rx_pool.Reset(rx_queue.Capacity(), std::min<size_t>(rx_queue.Capacity(), 64));
+
+    if (Setup() != 0) {
+        return ret = -1;
+    }
+
+    /* Create event handling thread */
+    terminate_ = false;
+    event_thread_ = std::thread(&ServerReactor::EventLoop, this);
+
+    return ret;
+}
+
+/**************************************************************************************/
+int ServerReactor::OpenSockets(uint16_t port)
+{
+    int ret = 0;
+    int err = 0;
+
+    /* Create master socket */
+    listen_sock_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (listen_sock_ == -1) {
+        perror("Failed to create socket");
+        return ret = -1;
+    }
+    auto _close_listen_socket = gsl::finally([&] {
+        if (ret != 0)
+            close(listen_sock_);
+    });
+
+    { /* Set socket to reuse address */
+        int val = 1;
+        err = setsockopt(listen_sock_, SOL_SOCKET, SO_REUSEADDR, &val, sizeof(int));
+        if (err == -1) {
+            perror("Failed to set socket options");
+            return ret = -1;
+        }
+        /* Let every reactor listen on the same port, the kernel balances them */
+        if (count_ > 1) {
+            err = setsockopt(listen_sock_, SOL_SOCKET, SO_REUSEPORT, &val, sizeof(int));
+            if (err == -1) {
+                perror("Failed to set socket port reuse");
+                return ret = -1;
+            }
+        }
+    }
+
+    /* Configure server socket */
+    struct sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    server_addr.sin_port = htons(port);
+
+    err = bind(listen_sock_, (struct sockaddr*) &server_addr, sizeof(server_addr));
+    if (err == -1) {
+        perror("Failed to bind socket");
+        return ret = -1;
+    }
+
+    err = listen(listen_sock_, SOMAXCONN);
+    if (err == -1) {
+        perror("Failed to listen socket");
+        return ret = -1;
+    }
+
+    /* Create a event file descriptor for waking up the event thread */
+    event_fd_ = eventfd(0, EFD_NONBLOCK);
+    if (event_fd_ == -1) {
+        perror("Failed to create thread event FD");
+        return ret = -1;
+    }
+
+    return ret;
+}
+
+/**************************************************************************************/
+void ServerReactor::Terminate()
+{
+    if (!event_thread_.joinable())
+        return;
+
+    /* Trigger the event thread to terminate */
+    terminate_ = true;
+    NotifyEventThread();
+
+    /* Wait for the thread to terminate */
+    event_thread_.join();
+
+    /* Clean client resources */
+    {
+        // we can access directly since there is no other thread running at this point
+        Teardown();
+
+        /* Close sockets and file descriptors */
+        close(event_fd_);
+        for (auto& client : clients_) {
+            if (client.sock != -1)
+                close(client.sock);
+        }
+        close(listen_sock_);
+
+        /* Clear clients saved data */
+        clients_.clear();
+        slots_.Reset(0);
+        num_clients_ = 0;
+        tx_pending_slots_.clear();
+        tx_requests_.clear();
+    }
+
+    /* Clean RX resources */
+    {
+        // we can access directly since event thread is not running at this point
+        /* Release RX queue slots and their buffers */
+        rx_queue.Reset(0);
+        rx_pool.Reset(0, 0);
+    }
+
+    /* Clean TX resources */
+    {
+        // we can access directly since event thread is not running at this point
+        auto& access = tx_data_.unsafe();
+        /* Clear TX queue */
+        access.tx_requests.clear();
+    }
+}
+
+/**************************************************************************************/
+int ServerReactor::AcquireSlot()
+{
+    const int slot = slots_.Allocate();
+    if (slot == -1) {
+        return -1;
+    }
+    num_clients_++;
+
+    ClientInfo& client = clients_[slot];
+    client.tx_queue.clear();
+    client.tx_head = 0;
+    client.tx_offset = 0;
+    client.tx_backlog = 0;
+    client.tx_pending = false;
+    client.tx_busy = false;
+    return slot;
+}
+
+/**************************************************************************************/
+void ServerReactor::ReleaseSlot(int slot)
+{
+    ClientInfo& client = clients_[slot];
+    client.sock = -1;
+    decltype(client.tx_queue)().swap(client.tx_queue);
+    client.tx_head = 0;
+    client.tx_offset = 0;
+    client.tx_backlog = 0;
+    client.tx_busy = false;
+    num_clients_--;
+    /* Restore client slot, with a new generation */
+    slots_.Free(slot);
+}
+
+/**************************************************************************************/
+bool ServerReactor::PostRxMessage(int slot, RxStatus status, const char* data,
+                                  size_t size, bool wait)
+{
+    RxMessage* msg = rx_queue.BeginPush();
+    if (msg == nullptr) {
+        /* Queue is full, hold back until the API client catches up */
+        stat_rx_overflows++;
+        if (!wait) {
+            return false;
+        }
+        while ((msg = rx_queue.BeginPush()) == nullptr) {
+            if (terminate_) {
+                return false;
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    /* Data goes in a pool buffer, which has room as long as the queue has */
+    char* buffer = nullptr;
+    if (size > 0) {
+        buffer = rx_pool.Acquire();
+        if (buffer == nullptr) {
+            stat_rx_overflows++;
+            return false;
+        }
+        memcpy(buffer, data, size);
+    }
+
+    msg->client_id = ClientId(slot);
+    msg->status = status;
+    msg->data = buffer;
+    msg->size = size;
+    rx_queue.CommitPush();
+    stat_rx_messages++;
+    return true;
+}
+
+/**************************************************************************************/
+bool ServerReactor::PostRxBuffer(int slot, char* buffer, size_t size)
+{
+    RxMessage* msg = rx_queue.BeginPush();
+    if (msg == nullptr) {
+        stat_rx_overflows++;
+        return false;
+    }
+
+    msg->client_id = ClientId(slot);
+    msg->status = RxStatus::NEW_DATA;
+    msg->data = buffer;
+    msg->size = size;
+    rx_queue.CommitPush();
+    stat_rx_messages++;
+    return true;
+}
+
+/**************************************************************************************/
+size_t ServerReactor::GatherClientOutput(const ClientInfo& client, struct iovec* iov,
+                                         size_t max_count)
+{
+    size_t count = 0;
+    for (size_t i = client.tx_head; i < client.tx_queue.size() && count < max_count;
+         ++i) {
+        const std::string& data = *client.tx_queue[i];
+        const size_t offset = (i == client.tx_head) ? client.tx_offset : 0;
+        iov[count].iov_base = const_cast<char*>(data.data()) + offset;
+        iov[count].iov_len = data.size() - offset;
+        count++;
+    }
+    return count;
+}
+
+/**************************************************************************************/
+void ServerReactor::ConsumeClientOutput(ClientInfo& client, size_t sent)
+{
+    client.tx_backlog -= sent;
+    stat_bytes_sent += sent;
+    while (sent > 0) {
+        const std::string& data = *client.tx_queue[client.tx_head];
+        const size_t left = data.size() - client.tx_offset;
+        if (sent < left) {
+            client.tx_offset += sent;
+            break;
+        }
+        sent -= left;
+        client.tx_queue[client.tx_head++].reset();  // release the buffer early
+        client.tx_offset = 0;
+    }
+
+    /* Drop sent messages, keeping the queue memory for later */
+    if (client.tx_head == client.tx_queue.size()) {
+        client.tx_queue.clear();
+        client.tx_head = 0;
+    }
+}
+
+/**************************************************************************************/
+void ServerReactor::PushRequests(const int* client_ids, size_t count,
+                                 const Buffer& buffer)
+{
+    /* Enqueue requests and wake up the event thread if it has nothing to send yet */
+    bool notify = false;
+    {
+        auto access = WriteAccess(tx_data_);
+        const bool was_empty = access->tx_requests.empty();
+        for (size_t i = 0; i < count; ++i) {
+            const int client_id = client_ids[i];
+            if (client_id == kAllClients ||
+                (int) SlotHandle::Index(client_id) % count_ == index_) {
+                access->tx_requests.push_back({ client_id, buffer });
+                notify = was_empty;
+            }
+        }
+    }
+    if (notify) {
+        NotifyEventThread();
+    }
+}
+
+/**************************************************************************************/
+void ServerReactor::NotifyEventThread()
+{
+    uint64_t value = 1;
+    if (write(event_fd_, &value, sizeof(value)) <= 0) {
+        perror("Failed to notify event thread");
+    }
+}
+
+/**************************************************************************************/
+void ServerReactor::HandleTxRequests()
+{
+    /* Take all requests, leaving our empty (but allocated) vector in their place */
+    {
+        auto access = WriteAccess(tx_data_);
+        access->tx_requests.swap(tx_requests_);
+    }
+
+    /* Queue every message for its clients */
+    for (auto& request : tx_requests_) {
+        if (request.client_id == kAllClients) {
+            for (size_t slot = 0; slot < clients_.size(); ++slot) {
+                if (clients_[slot].sock != -1)
+                    QueueClientOutput(slot, request.buffer);
+            }
+            continue;
+        }
+        /* The client may have left, and its slot may even be in use again */
+        const size_t slot = SlotHandle::Index(request.client_id) / count_;
+        if (slot >= clients_.size() || clients_[slot].sock == -1 ||
+            ClientId(slot) != request.client_id) {
+            fprintf(stderr, "Failed to send data to client %d: client id not found\n",
+                    request.client_id);
+            stat_messages_dropped++;
+            continue;  // a failed client doesn't affect the others
+        }
+        QueueClientOutput(slot, request.buffer);
+    }
+    tx_requests_.clear();
+
+    /* Send everything queued per client at once */
+    for (int slot : tx_pending_slots_) {
+        clients_[slot].tx_pending = false;
+        FlushClientOutput(slot);
+    }
+    tx_pending_slots_.clear();
+}
+
+/**************************************************************************************/
+bool ServerReactor::QueueClientOutput(int slot, const Buffer& buffer)
+{
+    ClientInfo& client = clients_[slot];
+
+    if (client.tx_backlog + buffer->size() > options_.max_tx_backlog) {
+        stat_messages_dropped++;
+        if (options_.slow_client_policy == ServerSocket::SlowClientPolicy::DISCONNECT) {
+            fprintf(stderr, "Server: client %d can't keep up, disconnecting\n",
+                    ClientId(slot));
+            RemoveClient(slot);
+        }
+        return false;
+    }
+
+    /* Only the reference is queued, the data is shared with other recipients */
+    client.tx_queue.push_back(buffer);
+    client.tx_backlog += buffer->size();
+    stat_messages_queued++;
+    if (!client.tx_pending) {
+        client.tx_pending = true;
+        tx_pending_slots_.push_back(slot);
+    }
+    return true;
+}
+
+} /* namespace fighttrack */
@@ -0,0 +1,143 @@
+/**
+ * \file snapshot.cc
+ * \brief World snapshots and delta compression.
+ */
+
+#include "fighttrack/snapshot.h"
+
+/**************************************************************************************/
+
+namespace fighttrack {
+
+SnapshotHistory::SnapshotHistory(size_t capacity) : slots_(capacity), latest_{ 0 }
+{
+}
+
+/**************************************************************************************/
+WorldSnapshot& SnapshotHistory::Insert(uint32_t sequence)
+{
+    WorldSnapshot& slot = slots_[sequence % slots_.size()];
+    slot.sequence = sequence;
+    slot.entities.clear();
+    if (sequence > latest_) {
+        latest_ = sequence;
+    }
+    return slot;
+}
+
+/**************************************************************************************/
+void SnapshotHistory::Discard(uint32_t sequence)
+{
+    WorldSnapshot& slot = slots_[sequence % slots_.size()];
+    if (slot.sequence == sequence) {
+        slot.sequence = 0;
+    }
+}
+
+/**************************************************************************************/
+const WorldSnapshot* SnapshotHistory::Find(uint32_t sequence) const
+{
+    if (sequence == 0) {
+        return nullptr;
+    }
+    const WorldSnapshot& slot = slots_[sequence % slots_.size()];
+    return (slot.sequence == sequence) ? &slot : nullptr;
+}
+
+/**************************************************************************************/
+void EncodeSnapshot(std::string& out, const WorldSnapshot& current,
+                    const WorldSnapshot* baseline)
+{
+    protocol::SnapshotWriter writer(out, { current.sequence,
+                                           baseline ? baseline->sequence : 0 });
+
+    static const std::vector<protocol::EntityState> kNoEntities;
+    const auto& base = baseline ? baseline->entities : kNoEntities;
+    const auto& cur = current.entities;
+
+    /* Both lists are sorted by ID, walk them together */
+    size_t b = 0, c = 0;
+    while (b < base.size() || c < cur.size()) {
+        if (c == cur.size() ||
+            (b < base.size() && base[b].entity_id < cur[c].entity_id)) {
+            writer.Add({ base[b].entity_id, protocol::kFieldRemoved, 0, 0 });
+            b++;
+        }
+        else if (b == base.size() || cur[c].entity_id < base[b].entity_id) {
+            writer.Add({ cur[c].entity_id, protocol::kFieldPosX | protocol::kFieldPosY,
+                         cur[c].pos_x, cur[c].pos_y });
+            c++;
+        }
+        else {
+            uint8_t fields = 0;
+            if (cur[c].pos_x != base[b].pos_x)
+                fields |= protocol::kFieldPosX;
+            if (cur[c].pos_y != base[b].pos_y)
+                fields |= protocol::kFieldPosY;
+            if (fields != 0)
+                writer.Add({ cur[c].entity_id, fields, cur[c].pos_x, cur[c].pos_y });
+            b++;
+            c++;
+        }
+    }
+
+    writer.End();
+}
+
+/**************************************************************************************/
+uint32_t DecodeSnapshot(const protocol::Frame& frame, SnapshotHistory& history)
+{
+    protocol::SnapshotReader reader(frame);
+    const protocol::SnapshotHeader header = reader.Header();
+    if (header.sequence == 0 || header.sequence <= header.baseline) {
+        return 0;
+    }
+    /* Too old, its slot may hold a newer snapshot */
+    if (header.sequence + history.Capacity() <= history.LatestSequence()) {
+        return 0;
+    }
+
+    static const std::vector<protocol::EntityState> kNoEntities;
+    const WorldSnapshot* baseline = history.Find(header.baseline);
+    if (header.baseline != 0 && baseline == nullptr) {
+        return 0;
+    }
+    /* The slot of the new snapshot must not be the baseline slot */
+    if (baseline && header.sequence - header.baseline >= history.Capacity()) {
+        return 0;
+    }
+    const auto& base = baseline ? baseline->entities : kNoEntities;
+
+    WorldSnapshot& snapshot = history.Insert(header.sequence);
+    auto& cur = snapshot.entities;
+    cur.reserve(base.size());
+
+    /* Deltas are sorted by ID, walk them together with the baseline */
+    size_t b = 0;
+    protocol::EntityDelta delta;
+    while (reader.Next(&delta)) {
+        for (; b < base.size() && base[b].entity_id < delta.entity_id; ++b) {
+            cur.push_back(base[b]);
+        }
+        protocol::EntityState state = { delta.entity_id, 0, 0 };
+        if (b < base.size() && base[b].entity_id == delta.entity_id) {
+            state = base[b++];
+        }
+        if (delta.fields & protocol::kFieldRemoved)
+            continue;
+        if (delta.fields & protocol::kFieldPosX)
+            state.pos_x = delta.pos_x;
+        if (delta.fields & protocol::kFieldPosY)
+            state.pos_y = delta.pos_y;
+        cur.push_back(state);
+    }
+    if (reader.Failed()) {
+        history.Discard(header.sequence);
+        return 0;
+    }
+    cur.insert(cur.end(), base.begin() + b, base.end());
+
+    return header.sequence;
+}
+
+} /* namespace fighttrack */
@@ -0,0 +1,67 @@
+/**
+ * \file spatial_hash.cc
+ * \brief Uniform-grid spatial hash, the broadphase of entity collisions.
+ */
+
+#include "fighttrack/spatial_hash.h"
+
+#include <algorithm>
+
+/**************************************************************************************/
+
+namespace fighttrack {
+
+/**************************************************************************************/
+SpatialHash::SpatialHash(int cell_size)
+    : cell_size_{ std::max(cell_size, 1) }, max_width_{ 0 }, max_height_{ 0 }, staged_{},
+      entries_{}, starts_{}
+{
+}
+
+/**************************************************************************************/
+void SpatialHash::Clear()
+{
+    staged_.clear();
+    entries_.clear();
+    max_width_ = 0;
+    max_height_ = 0;
+}
+
+/**************************************************************************************/
+void SpatialHash::Insert(uint32_t id, const Rect& bounds)
+{
+    staged_.push_back({ id, CellOf(bounds.x), CellOf(bounds.y), bounds });
+    max_width_ = std::max(max_width_, bounds.width);
+    max_height_ = std::max(max_height_, bounds.height);
+}
+
+/**************************************************************************************/
+void SpatialHash::Build()
+{
+    /* Twice as many buckets as boxes, a power of two */
+    size_t buckets = 16;
+    while (buckets < 2 * staged_.size()) {
+        buckets *= 2;
+    }
+    starts_.assign(buckets + 1, 0);
+
+    /* Count the boxes of every bucket, then turn the counts into starts */
+    for (const Entry& entry : staged_) {
+        starts_[BucketOf(entry.cell_x, entry.cell_y) + 1]++;
+    }
+    for (size_t b = 1; b <= buckets; ++b) {
+        starts_[b] += starts_[b - 1];
+    }
+
+    /* Place every box, bumping the start of its bucket, then shift the starts back */
+    entries_.resize(staged_.size());
+    for (const Entry& entry : staged_) {
+        entries_[starts_[BucketOf(entry.cell_x, entry.cell_y)]++] = entry;
+    }
+    for (size_t b = buckets; b > 0; --b) {
+        starts_[b] = starts_[b - 1];
+    }
+    starts_[0] = 0;
+}
+
+} /* namespace fighttrack */
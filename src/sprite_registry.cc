@@ -0,0 +1,41 @@
+/**
+ * \file sprite_registry.cc
+ * \brief Registry of immutable sprites shared by all entities.
+ */
+
+#include "fighttrack/sprite_registry.h"
+
+#include <cstdio>
+#include <limits>
+
+/**************************************************************************************/
+
+namespace fighttrack {
+
+constexpr SpriteId SpriteRegistry::kNone;
+
+/**************************************************************************************/
+SpriteRegistry::SpriteRegistry() : sprites_{}
+{
+    sprites_.emplace_back(std::vector<std::string>{});
+}
+
+/**************************************************************************************/
+SpriteRegistry& SpriteRegistry::Global()
+{
+    static SpriteRegistry registry;
+    return registry;
+}
+
+/**************************************************************************************/
+SpriteId SpriteRegistry::Register(AsciiArt art)
+{
+    if (sprites_.size() > std::numeric_limits<SpriteId>::max()) {
+        fprintf(stderr, "SpriteRegistry: too many sprites\n");
+        return kNone;
+    }
+    sprites_.push_back(std::move(art));
+    return (SpriteId)(sprites_.size() - 1);
+}
+
+} /* namespace fighttrack */
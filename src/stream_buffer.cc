@@ -0,0 +1,41 @@
+/**
+ * \file stream_buffer.cc
+ * \brief Reassembly of protocol frames from a byte stream.
+ */
+
+#include "fighttrack/stream_buffer.h"
+
+#include <algorithm>
+
+/**************************************************************************************/
+
+namespace fighttrack {
+
+int StreamBuffer::FillPending(const char*& data, size_t& size, protocol::Frame* frame)
+{
+    /* Complete the header first, it holds the frame size */
+    if (pending_.size() < protocol::kHeaderSize) {
+        size_t n = std::min(protocol::kHeaderSize - pending_.size(), size);
+        pending_.insert(pending_.end(), data, data + n);
+        data += n;
+        size -= n;
+        if (pending_.size() < protocol::kHeaderSize) {
+            return 0;
+        }
+    }
+
+    /* Then copy only what is missing of this frame */
+    int ret = protocol::ParseFrame(pending_.data(), pending_.size(), frame);
+    if (ret != 0) {
+        return ret;
+    }
+    const size_t frame_size = protocol::Reader(pending_.data(), pending_.size()).U16();
+    size_t n = std::min(frame_size - pending_.size(), size);
+    pending_.insert(pending_.end(), data, data + n);
+    data += n;
+    size -= n;
+
+    return protocol::ParseFrame(pending_.data(), pending_.size(), frame);
+}
+
+} /* namespace fighttrack */
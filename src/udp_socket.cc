@@ -0,0 +1,178 @@
+/**
+ * \file udp_socket.cc
+ * \brief UDP Socket implementation.
+ */
+
+#include "fighttrack/udp_socket.h"
+
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+
+#include <gsl/gsl>
+
+/**************************************************************************************/
+
+namespace fighttrack {
+
+UdpSocket::UdpSocket()
+    : initialized_{ false },
+      socket_{ -1 },
+      loss_percent_{ 0 },
+      loss_rng_{ std::random_device{}() }
+{
+}
+
+/**************************************************************************************/
+UdpSocket::~UdpSocket()
+{
+    if (initialized_)
+        Terminate();
+}
+
+/**************************************************************************************/
+int UdpSocket::Open()
+{
+    socket_ = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    if (socket_ == -1) {
+        perror("UDP: failed to create socket");
+        return -1;
+    }
+
+    const char* loss = getenv("FIGHTTRACK_UDP_LOSS");
+    if (loss != nullptr) {
+        loss_percent_ = atoi(loss);
+        printf("UDP: dropping %d%% of outgoing datagrams\n", loss_percent_);
+    }
+
+    return 0;
+}
+
+/**************************************************************************************/
+int UdpSocket::Initialize(const uint16_t port)
+{
+    int ret = 0;
+
+    if (Open() != 0) {
+        return ret = -1;
+    }
+    auto _close_socket = gsl::finally([&] {
+        if (ret != 0)
+            close(socket_);
+    });
+
+    { /* Set socket to reuse address */
+        int val = 1;
+        if (setsockopt(socket_, SOL_SOCKET, SO_REUSEADDR, &val, sizeof(val)) == -1) {
+            perror("UDP: failed to set socket options");
+            return ret = -1;
+        }
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+
+    if (bind(socket_, (struct sockaddr*) &addr, sizeof(addr)) == -1) {
+        perror("UDP: failed to bind socket");
+        return ret = -1;
+    }
+
+    initialized_ = true;
+    return ret;
+}
+
+/**************************************************************************************/
+int UdpSocket::Initialize(const std::string& server_addr, const uint16_t port)
+{
+    int ret = 0;
+
+    if (Open() != 0) {
+        return ret = -1;
+    }
+    auto _close_socket = gsl::finally([&] {
+        if (ret != 0)
+            close(socket_);
+    });
+
+    struct hostent* server_ent = gethostbyname(server_addr.data());
+    if (server_ent == nullptr) {
+        fprintf(stderr, "UDP: failed to get host %s\n", server_addr.data());
+        return ret = -1;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    memcpy(&addr.sin_addr.s_addr, server_ent->h_addr, server_ent->h_length);
+
+    if (connect(socket_, (struct sockaddr*) &addr, sizeof(addr)) == -1) {
+        perror("UDP: failed to connect socket");
+        return ret = -1;
+    }
+
+    initialized_ = true;
+    return ret;
+}
+
+/**************************************************************************************/
+void UdpSocket::Terminate()
+{
+    if (!initialized_)
+        return;
+
+    close(socket_);
+    initialized_ = false;
+}
+
+/**************************************************************************************/
+int UdpSocket::Send(const struct sockaddr_in* to, const char* data, size_t size)
+{
+    /* Loss shim */
+    if (loss_percent_ > 0 &&
+        std::uniform_int_distribution<int>(0, 99)(loss_rng_) < loss_percent_) {
+        return 0;
+    }
+
+    ssize_t n = sendto(socket_, data, size, 0, (const struct sockaddr*) to,
+                       to ? sizeof(*to) : 0);
+    if (n == -1) {
+        /* Datagrams are unreliable anyway, a full buffer is just a loss */
+        if (errno == EWOULDBLOCK || errno == ECONNREFUSED) {
+            return 0;
+        }
+        perror("UDP: failed to send datagram");
+        return -1;
+    }
+
+    return 0;
+}
+
+/**************************************************************************************/
+int UdpSocket::Receive(char* buffer, size_t size, struct sockaddr_in* from)
+{
+    socklen_t from_len = sizeof(struct sockaddr_in);
+    ssize_t n = recvfrom(socket_, buffer, size, 0, (struct sockaddr*) from,
+                         from ? &from_len : nullptr);
+    if (n == -1) {
+        if (errno == EWOULDBLOCK || errno == ECONNREFUSED) {
+            return 0;
+        }
+        perror("UDP: failed to receive datagram");
+        return -1;
+    }
+
+    return n;
+}
+
+} /* namespace fighttrack */
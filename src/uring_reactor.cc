@@ -0,0 +1,745 @@
+/**
+ * \file uring_reactor.cc
+ * \brief Server Socket event loop based on io_uring.
+ */
+
+#include "fighttrack/uring_reactor.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <algorithm>
+#include <gsl/gsl>
+
+/**************************************************************************************/
+
+namespace fighttrack {
+
+namespace {
+
+/* There is no libc wrapper for the io_uring system calls */
+int io_uring_setup(unsigned entries, struct io_uring_params* params)
+{
+    return (int) syscall(__NR_io_uring_setup, entries, params);
+}
+
+int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr,
+                         0);
+}
+
+int io_uring_register(int fd, unsigned opcode, void* arg, unsigned nr_args)
+{
+    return (int) syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/* User data of a request: kind, client slot and client generation */
+uint64_t PackUserData(uint8_t op, int slot, uint32_t generation)
+{
+    return ((uint64_t) op << 56) | ((uint64_t) (slot & 0xFFFFFF) << 32) | generation;
+}
+
+}  // namespace
+
+/**************************************************************************************/
+UringReactor::UringReactor(const Options& options, int index, int count)
+    : ServerReactor(options, index, count),
+      ring_fd_{ -1 },
+      features_{ 0 },
+      sq_ring_{ MAP_FAILED },
+      sq_ring_size_{ 0 },
+      sqes_{ nullptr },
+      sqes_size_{ 0 },
+      sq_head_{ nullptr },
+      sq_tail_{ nullptr },
+      sq_array_{ nullptr },
+      sq_mask_{ 0 },
+      sq_entries_{ 0 },
+      sq_local_tail_{ 0 },
+      sq_to_submit_{ 0 },
+      cq_ring_{ MAP_FAILED },
+      cq_ring_size_{ 0 },
+      cq_head_{ nullptr },
+      cq_tail_{ nullptr },
+      cq_mask_{ 0 },
+      cqes_{ nullptr },
+      buf_ring_{ nullptr },
+      buf_ring_size_{ 0 },
+      buffers_{ nullptr },
+      buf_tail_{ 0 },
+      uring_clients_{},
+      deferred_{},
+      deferred_head_{ 0 },
+      rearm_slots_{},
+      inflight_{ 0 }
+{
+}
+
+/**************************************************************************************/
+UringReactor::~UringReactor()
+{
+    Terminate();
+}
+
+/**************************************************************************************/
+int UringReactor::Setup()
+{
+    int ret = 0;
+
+    /* Room for a recv and a send per client, plus a few more */
+    const unsigned sq_size = 256;
+    const unsigned cq_size =
+        std::max(4096u, (unsigned) std::min<size_t>(clients_.size() * 4, 65536));
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+    params.cq_entries = cq_size;
+    ring_fd_ = io_uring_setup(sq_size, &params);
+    if (ring_fd_ == -1) {
+        perror("Failed to create io_uring");
+        return ret = -1;
+    }
+    auto _teardown = gsl::finally([&] {
+        if (ret != 0)
+            Teardown();
+    });
+    features_ = params.features;
+    if (!(features_ & IORING_FEAT_NODROP)) {
+        fprintf(stderr, "Failed to create io_uring: kernel too old\n");
+        return ret = -1;
+    }
+
+    if (MapRings(params) != 0 || SetupBufferRing() != 0) {
+        return ret = -1;
+    }
+
+    /* Let io_uring wait on the listening socket instead of failing with EAGAIN */
+    const int flags = fcntl(listen_sock_, F_GETFL);
+    if (flags == -1 || fcntl(listen_sock_, F_SETFL, flags & ~O_NONBLOCK) == -1) {
+        perror("Failed to set listening socket blocking");
+        return ret = -1;
+    }
+
+    uring_clients_.clear();
+    uring_clients_.resize(clients_.size());
+    for (auto& uring_client : uring_clients_) {
+        uring_client.generation = 0;
+        uring_client.recv_armed = false;
+        uring_client.removed = false;
+        uring_client.disconnect_held = false;
+    }
+    deferred_.clear();
+    deferred_head_ = 0;
+    rearm_slots_.clear();
+    inflight_ = 0;
+    return ret;
+}
+
+/**************************************************************************************/
+int UringReactor::MapRings(const struct io_uring_params& params)
+{
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    const bool single_mmap = features_ & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+        sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+
+    sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED) {
+        perror("Failed to map io_uring submission ring");
+        return -1;
+    }
+    if (single_mmap) {
+        cq_ring_ = sq_ring_;
+    }
+    else {
+        cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+        if (cq_ring_ == MAP_FAILED) {
+            perror("Failed to map io_uring completion ring");
+            return -1;
+        }
+    }
+
+    sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        perror("Failed to map io_uring submission entries");
+        return -1;
+    }
+    sqes_ = static_cast<struct io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(sq_ring_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_entries_ = params.sq_entries;
+    sq_local_tail_ = *sq_tail_;
+    sq_to_submit_ = 0;
+
+    char* cq = static_cast<char*>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+    return 0;
+}
+
+/**************************************************************************************/
+int UringReactor::SetupBufferRing()
+{
+    buf_ring_size_ = kNumBuffers * sizeof(struct io_uring_buf);
+    void* ring = mmap(nullptr, buf_ring_size_, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED) {
+        perror("Failed to allocate io_uring buffer ring");
+        return -1;
+    }
+    buf_ring_ = static_cast<struct io_uring_buf_ring*>(ring);
+    buffers_ = new char[kNumBuffers * kBufferSize];
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t) (uintptr_t) buf_ring_;
+    reg.ring_entries = kNumBuffers;
+    reg.bgid = kBufferGroup;
+    if (io_uring_register(ring_fd_, IORING_REGISTER_PBUF_RING, &reg, 1) == -1) {
+        perror("Failed to register io_uring buffer ring");
+        return -1;
+    }
+
+    /* Hand all buffers to the kernel */
+    buf_tail_ = 0;
+    for (unsigned bid = 0; bid < kNumBuffers; ++bid) {
+        RecycleBuffer(bid);
+    }
+    return 0;
+}
+
+/**************************************************************************************/
+void UringReactor::Teardown()
+{
+    if (ring_fd_ == -1) {
+        return;
+    }
+
+    /* Cancel every request, the kernel may not write to our memory after this */
+    struct io_uring_sqe* sqe = (inflight_ > 0) ? GetSqe(Op::CANCEL, 0) : nullptr;
+    if (sqe != nullptr) {
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY;
+        for (int tries = 0; inflight_ > 0 && tries < 100; ++tries) {
+            if (Submit(1) != 0)
+                break;
+            ReapCompletions(false);
+        }
+    }
+
+    if (buffers_ != nullptr) {
+        struct io_uring_buf_reg reg;
+        memset(&reg, 0, sizeof(reg));
+        reg.bgid = kBufferGroup;
+        io_uring_register(ring_fd_, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+    }
+    close(ring_fd_);
+    ring_fd_ = -1;
+
+    if (sqes_ != nullptr)
+        munmap(sqes_, sqes_size_);
+    if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_)
+        munmap(cq_ring_, cq_ring_size_);
+    if (sq_ring_ != MAP_FAILED)
+        munmap(sq_ring_, sq_ring_size_);
+    if (buf_ring_ != nullptr)
+        munmap(buf_ring_, buf_ring_size_);
+    delete[] buffers_;
+    sqes_ = nullptr;
+    sq_ring_ = cq_ring_ = MAP_FAILED;
+    buf_ring_ = nullptr;
+    buffers_ = nullptr;
+
+    uring_clients_.clear();
+    deferred_.clear();
+    deferred_head_ = 0;
+    rearm_slots_.clear();
+    inflight_ = 0;
+}
+
+/**************************************************************************************/
+void UringReactor::EventLoop()
+{
+    printf("Server: reactor %d waiting for io_uring completions..\n", index_);
+    fflush(stdout);
+
+    ArmWake();
+    ArmAccept();
+
+    while (true) {
+        /* Submit everything requested by the last round and wait for more work,
+         * unless there is received data waiting for the API client to drain */
+        const bool holding = deferred_head_ < deferred_.size();
+        if (Submit(holding ? 0 : 1) != 0) {
+            return;
+        }
+        if (ReapCompletions(true) != 0) {
+            printf("Server: request to terminate reactor %d\n", index_);
+            return;  // terminate
+        }
+
+        /* Post what the RX queue had no room for, as the API client drains it */
+        if (deferred_head_ < deferred_.size()) {
+            DrainDeferred();
+            if (deferred_head_ < deferred_.size()) {
+                std::this_thread::yield();
+            }
+        }
+        else if (!rearm_slots_.empty()) {
+            DrainDeferred();
+        }
+    }
+}
+
+/**************************************************************************************/
+struct io_uring_sqe* UringReactor::GetSqe(Op op, int slot)
+{
+    if (sq_local_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) == sq_entries_) {
+        /* Queue full, submit now to make room */
+        Submit(0);
+        if (sq_local_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) == sq_entries_) {
+            fprintf(stderr, "Failed to get io_uring submission entry: queue full\n");
+            return nullptr;
+        }
+    }
+
+    const unsigned index = sq_local_tail_ & sq_mask_;
+    struct io_uring_sqe* sqe = &sqes_[index];
+    memset(sqe, 0, sizeof(*sqe));
+    const uint32_t generation =
+        (op == Op::RECV || op == Op::SEND) ? uring_clients_[slot].generation : 0;
+    sqe->user_data = PackUserData((uint8_t) op, slot, generation);
+    sq_array_[index] = index;
+    sq_local_tail_++;
+    sq_to_submit_++;
+    inflight_++;
+    return sqe;
+}
+
+/**************************************************************************************/
+int UringReactor::Submit(unsigned wait_nr)
+{
+    /* Publish the filled entries */
+    __atomic_store_n(sq_tail_, sq_local_tail_, __ATOMIC_RELEASE);
+
+    while (true) {
+        /* Don't block with completions still waiting to be handled */
+        const bool ready = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE) != *cq_head_;
+        const unsigned min_complete = ready ? 0 : wait_nr;
+        if (sq_to_submit_ == 0 && min_complete == 0) {
+            return 0;
+        }
+        int n = io_uring_enter(ring_fd_, sq_to_submit_, min_complete,
+                               min_complete ? IORING_ENTER_GETEVENTS : 0);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EBUSY || errno == EAGAIN) {
+                return 0;  // completions must be reaped first
+            }
+            perror("Failed to submit io_uring requests");
+            return -1;
+        }
+        sq_to_submit_ -= std::min<unsigned>(n, sq_to_submit_);
+        if (sq_to_submit_ == 0 || min_complete == 0) {
+            return 0;
+        }
+    }
+}
+
+/**************************************************************************************/
+int UringReactor::ReapCompletions(bool dispatch)
+{
+    int ret = 0;
+    unsigned head = *cq_head_;
+    while (head != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+        /* Copy the entry and release it right away */
+        const struct io_uring_cqe cqe = cqes_[head & cq_mask_];
+        __atomic_store_n(cq_head_, ++head, __ATOMIC_RELEASE);
+
+        if (!(cqe.flags & IORING_CQE_F_MORE)) {
+            inflight_--;
+        }
+        const Op op = static_cast<Op>(cqe.user_data >> 56);
+        const int slot = (int) ((cqe.user_data >> 32) & 0xFFFFFF);
+        const uint32_t generation = (uint32_t) cqe.user_data;
+
+        if (!dispatch) {
+            if (cqe.flags & IORING_CQE_F_BUFFER) {
+                RecycleBuffer(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+            }
+            continue;
+        }
+        switch (op) {
+            case Op::ACCEPT: OnAccept(cqe.res, cqe.flags); break;
+            case Op::WAKE: ret |= OnWake(cqe.flags); break;
+            case Op::RECV: OnRecv(slot, generation, cqe.res, cqe.flags); break;
+            case Op::SEND: OnSend(slot, cqe.res); break;
+            case Op::CANCEL: break;
+        }
+    }
+    return ret;
+}
+
+/**************************************************************************************/
+void UringReactor::ArmAccept()
+{
+    struct io_uring_sqe* sqe = GetSqe(Op::ACCEPT, 0);
+    if (sqe == nullptr)
+        return;
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listen_sock_;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+}
+
+/**************************************************************************************/
+void UringReactor::ArmWake()
+{
+    struct io_uring_sqe* sqe = GetSqe(Op::WAKE, 0);
+    if (sqe == nullptr)
+        return;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = event_fd_;
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+}
+
+/**************************************************************************************/
+void UringReactor::ArmRecv(int slot)
+{
+    struct io_uring_sqe* sqe = GetSqe(Op::RECV, slot);
+    if (sqe == nullptr)
+        return;
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = clients_[slot].sock;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = kBufferGroup;
+    uring_clients_[slot].recv_armed = true;
+}
+
+/**************************************************************************************/
+void UringReactor::OnAccept(int res, unsigned flags)
+{
+    if (res < 0) {
+        errno = -res;
+        perror("Failed to accept a new connection");
+    }
+    /* The multishot accept may stop, e.g. out of file descriptors */
+    if (!(flags & IORING_CQE_F_MORE) && res != -EINVAL) {
+        ArmAccept();
+    }
+    if (res < 0) {
+        return;
+    }
+    const int client_sock = res;
+
+    if (num_clients_ >= clients_.size()) {
+        printf("Server: dismissing new client, maximum (%zu) reached on reactor %d.\n",
+               clients_.size(), index_);
+        close(client_sock);
+        return;
+    }
+
+    /* Cache new client */
+    const int slot = AcquireSlot();
+    ClientInfo& client = clients_[slot];
+    client.sock = client_sock;
+    socklen_t client_len = sizeof(client.addr);
+    if (getpeername(client_sock, (struct sockaddr*) &client.addr, &client_len) == -1) {
+        memset(&client.addr, 0, sizeof(client.addr));
+    }
+    uring_clients_[slot].removed = false;
+    uring_clients_[slot].recv_armed = false;
+    uring_clients_[slot].disconnect_held = false;
+
+    /* Notify API client that a new client connected, before any of its data */
+    PostOrHold(RxStatus::CONNECTED, slot, -1, 0);
+    ArmRecv(slot);
+
+    printf("Server: got connection from %s port %d\n", inet_ntoa(client.addr.sin_addr),
+           ntohs(client.addr.sin_port));
+}
+
+/**************************************************************************************/
+int UringReactor::OnWake(unsigned flags)
+{
+    uint64_t notify;
+    int n = read(event_fd_, &notify, sizeof(notify));
+    if (n == -1 && errno != EWOULDBLOCK) {
+        perror("Failed to read thread notification code");
+    }
+    if (!(flags & IORING_CQE_F_MORE)) {
+        ArmWake();
+    }
+    /* Signal to terminate thread */
+    if (terminate_) {
+        return 1;
+    }
+    /* Otherwise there is new data to transmit */
+    HandleTxRequests();
+    return 0;
+}
+
+/**************************************************************************************/
+void UringReactor::OnRecv(int slot, uint32_t generation, int res, unsigned flags)
+{
+    const int buffer_id =
+        (flags & IORING_CQE_F_BUFFER) ? (int) (flags >> IORING_CQE_BUFFER_SHIFT) : -1;
+    UringClient& uring_client = uring_clients_[slot];
+
+    /* Completion of a client already removed */
+    if (generation != uring_client.generation) {
+        if (buffer_id != -1)
+            RecycleBuffer(buffer_id);
+        return;
+    }
+
+    const bool more = flags & IORING_CQE_F_MORE;
+    if (!more) {
+        uring_client.recv_armed = false;
+    }
+
+    if (res > 0 && buffer_id != -1) {
+        if (PostOrHold(RxStatus::NEW_DATA, slot, buffer_id, (uint32_t) res)) {
+            printf("Server: received %d bytes from client %d\n", res, ClientId(slot));
+            RecycleBuffer(buffer_id);
+        }
+        if (!more) {
+            rearm_slots_.push_back(slot);
+        }
+        return;
+    }
+
+    /* Out of provided buffers, they are all held; resume once the API client drains */
+    if (res == -ENOBUFS) {
+        stat_rx_overflows++;
+        if (!more) {
+            rearm_slots_.push_back(slot);
+        }
+        return;
+    }
+
+    /* Connection closed or failed */
+    if (res < 0 && res != -ECONNRESET) {
+        errno = -res;
+        perror("Failed to read data from client");
+    }
+    RemoveClient(slot);  // notified after the data held, if any
+}
+
+/**************************************************************************************/
+bool UringReactor::PostOrHold(RxStatus status, int slot, int buffer_id, uint32_t size)
+{
+    /* Keep ordering: once anything is held, hold everything after it too */
+    const char* data =
+        (buffer_id != -1) ? buffers_ + (size_t) buffer_id * kBufferSize : nullptr;
+    if (deferred_head_ == deferred_.size() &&
+        PostRxMessage(slot, status, data, size, false)) {
+        return true;
+    }
+    if (deferred_head_ < deferred_.size())
+        stat_rx_overflows++;  // otherwise counted by PostRxMessage()
+    deferred_.push_back({ status, slot, buffer_id, size });
+    return false;
+}
+
+/**************************************************************************************/
+void UringReactor::DrainDeferred()
+{
+    while (deferred_head_ < deferred_.size()) {
+        if (rx_queue.BeginPush() == nullptr) {
+            return;  // still no room, already counted as an overflow
+        }
+        const DeferredEvent event = deferred_[deferred_head_++];
+        if (event.buffer_id != -1) {
+            PostRxMessage(event.slot, event.status,
+                          buffers_ + (size_t) event.buffer_id * kBufferSize, event.size,
+                          false);
+            printf("Server: received %u bytes from client %d\n", event.size,
+                   ClientId(event.slot));
+            RecycleBuffer(event.buffer_id);
+        }
+        else {
+            PostRxMessage(event.slot, event.status, nullptr, 0, false);
+        }
+        if (event.status == RxStatus::DISCONNECTED) {
+            uring_clients_[event.slot].disconnect_held = false;
+            ReleaseRemoved(event.slot);
+        }
+    }
+    deferred_.clear();
+    deferred_head_ = 0;
+
+    /* Buffers are available again, resume reading */
+    for (int slot : rearm_slots_) {
+        if (clients_[slot].sock != -1 && !uring_clients_[slot].removed &&
+            !uring_clients_[slot].recv_armed) {
+            ArmRecv(slot);
+        }
+    }
+    rearm_slots_.clear();
+}
+
+/**************************************************************************************/
+void UringReactor::RecycleBuffer(int buffer_id)
+{
+    struct io_uring_buf* bufs = reinterpret_cast<struct io_uring_buf*>(buf_ring_);
+    struct io_uring_buf& buf = bufs[buf_tail_ & (kNumBuffers - 1)];
+    buf.addr = (uint64_t) (uintptr_t) (buffers_ + (size_t) buffer_id * kBufferSize);
+    buf.len = kBufferSize;
+    buf.bid = (uint16_t) buffer_id;
+    buf_tail_++;
+    __atomic_store_n(&buf_ring_->tail, buf_tail_, __ATOMIC_RELEASE);
+}
+
+/**************************************************************************************/
+void UringReactor::RemoveClient(int slot)
+{
+    ClientInfo& client = clients_[slot];
+    UringClient& uring_client = uring_clients_[slot];
+    if (client.sock == -1) {
+        return;
+    }
+
+    /* Forget client, its pending requests complete with an error */
+    CancelRequests(slot);
+    shutdown(client.sock, SHUT_RDWR);
+    close(client.sock);
+    client.sock = -1;
+    uring_client.generation++;
+    uring_client.recv_armed = false;
+    uring_client.removed = true;
+
+    /* Notify API client after the data held, while the client ID is still valid. A
+     * send in flight still reads the TX queue, so the slot waits for both */
+    const int client_id = ClientId(slot);
+    uring_client.disconnect_held = !PostOrHold(RxStatus::DISCONNECTED, slot, -1, 0);
+    ReleaseRemoved(slot);
+
+    printf("Server: client %d closed connection.\n", client_id);
+}
+
+/**************************************************************************************/
+void UringReactor::ReleaseRemoved(int slot)
+{
+    UringClient& uring_client = uring_clients_[slot];
+    const bool busy = clients_[slot].tx_busy || uring_client.disconnect_held;
+    if (uring_client.removed && !busy) {
+        uring_client.removed = false;
+        ReleaseSlot(slot);
+    }
+}
+
+/**************************************************************************************/
+void UringReactor::CancelRequests(int slot)
+{
+    /* The kernel looks a descriptor up when it takes the request, so requests still in
+     * the submission queue must go now, while the descriptor is this client's */
+    struct io_uring_sqe* sqe = GetSqe(Op::CANCEL, slot);
+    if (sqe != nullptr) {
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = clients_[slot].sock;
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+    }
+    Submit(0);
+
+    /* Whatever the kernel didn't take, being busy, must not go at all: turn it into a
+     * no-op, which still completes as the request it was */
+    for (unsigned tail = sq_local_tail_ - sq_to_submit_; tail != sq_local_tail_; ++tail) {
+        struct io_uring_sqe* pending = &sqes_[tail & sq_mask_];
+        const Op op = static_cast<Op>(pending->user_data >> 56);
+        const int pending_slot = (int) ((pending->user_data >> 32) & 0xFFFFFF);
+        const bool on_client = op == Op::RECV || op == Op::SEND || op == Op::CANCEL;
+        if (on_client && pending_slot == slot) {
+            const uint64_t user_data = pending->user_data;
+            memset(pending, 0, sizeof(*pending));
+            pending->opcode = IORING_OP_NOP;
+            pending->user_data = user_data;
+        }
+    }
+}
+
+/**************************************************************************************/
+void UringReactor::FlushClientOutput(int slot)
+{
+    ClientInfo& client = clients_[slot];
+    UringClient& uring_client = uring_clients_[slot];
+    if (client.sock == -1 || uring_client.removed || client.tx_busy ||
+        client.tx_head == client.tx_queue.size()) {
+        return;
+    }
+
+    /* Gather as many queued messages as possible in one request */
+    if (uring_client.iov.empty()) {
+        uring_client.iov.resize(kMaxSendIov);  // kept for later clients of the slot
+    }
+    memset(&uring_client.msg, 0, sizeof(uring_client.msg));
+    uring_client.msg.msg_iov = uring_client.iov.data();
+    uring_client.msg.msg_iovlen =
+        GatherClientOutput(client, uring_client.iov.data(), uring_client.iov.size());
+
+    struct io_uring_sqe* sqe = GetSqe(Op::SEND, slot);
+    if (sqe == nullptr)
+        return;
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = client.sock;
+    sqe->addr = (uint64_t) (uintptr_t) &uring_client.msg;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    client.tx_busy = true;
+    stat_send_calls++;
+}
+
+/**************************************************************************************/
+void UringReactor::OnSend(int slot, int res)
+{
+    ClientInfo& client = clients_[slot];
+    UringClient& uring_client = uring_clients_[slot];
+    client.tx_busy = false;
+
+    /* Client removed while sending, its buffers can go now */
+    if (uring_client.removed) {
+        ReleaseRemoved(slot);
+        return;
+    }
+
+    if (res < 0) {
+        errno = -res;
+        perror("Failed to send data to client");
+        RemoveClient(slot);
+        return;
+    }
+
+    /* Advance past what was sent, and send the rest */
+    ConsumeClientOutput(client, res);
+    FlushClientOutput(slot);
+}
+
+} /* namespace fighttrack */
@@ -0,0 +1,90 @@
+/**
+ * \file   entity_store_alloc_test.cc
+ * \brief  Check that simulation ticks do not allocate memory.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+#include <ncurses.h>
+
+#include "fighttrack/entity_store.h"
+#include "fighttrack/map.h"
+#include "fighttrack/player.h"
+
+/**************************************************************************************/
+
+/* Every allocation of the program is counted */
+static size_t g_allocations = 0;
+
+void* operator new(size_t size)
+{
+    g_allocations++;
+    void* ptr = std::malloc(size ? size : 1);
+    if (ptr == nullptr) {
+        throw std::bad_alloc{};
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+/**************************************************************************************/
+
+int main()
+{
+    using namespace fighttrack;
+
+    constexpr size_t kPlayers = 64;
+    constexpr int kWarmupTicks = 10;
+    constexpr int kTicks = 1000;
+    constexpr int kKeys[] = { KEY_LEFT, KEY_RIGHT, KEY_UP, 0 };
+
+    Map map;
+    if (map.LoadDefault() != 0) {
+        fprintf(stderr, "Failed to load the default map\n");
+        return 1;
+    }
+
+    EntityStore players;
+    players.Reserve(kPlayers);
+    for (size_t i = 0; i < kPlayers; ++i) {
+        const uint32_t handle = players.Create("player" + std::to_string(i));
+        players.Get(players.Find(handle)).SetPosX((int) (i % 70)).SetPosY(0);
+    }
+
+    /* Walk, jump and stand still, so every state and sprite change comes up; the
+     * chunks of the map are decoded in the first ticks */
+    auto tick = [&](int t) {
+        for (size_t i = 0; i < players.Size(); ++i) {
+            const int key = kKeys[(t / 7 + i) % (sizeof(kKeys) / sizeof(kKeys[0]))];
+            if (key != 0) {
+                players.Get(i).HandleInput(key);
+            }
+        }
+        players.Update(map);
+        players.TakeDirty();
+    };
+    for (int t = 0; t < kWarmupTicks; ++t) {
+        tick(t);
+    }
+
+    const size_t before = g_allocations;
+    for (int t = kWarmupTicks; t < kWarmupTicks + kTicks; ++t) {
+        tick(t);
+    }
+    const size_t allocations = g_allocations - before;
+
+    printf("%zu allocations in %d ticks of %zu players\n", allocations, kTicks, kPlayers);
+    return (allocations == 0) ? 0 : 1;
+}
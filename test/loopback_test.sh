@@ -0,0 +1,84 @@
+#!/bin/bash
+#
+# Loopback test: a server and two clients on 127.0.0.1, sending the snapshots over
+# UDP while dropping a share of the datagrams. The first client downloads the map,
+# the second one finds it in the map cache they share.
+#
+# Usage: loopback_test.sh <fight-track executable>
+
+set -u
+
+if [ $# -ne 1 ]; then
+    echo "Usage: $0 <fight-track executable>"
+    exit 1
+fi
+bin=$1
+
+# The client needs a terminal, script runs it on a pseudo-terminal
+if ! command -v script > /dev/null; then
+    echo "script not found, skipping"
+    exit 77
+fi
+
+dir=$(mktemp -d)
+server=
+cleanup() {
+    [ -n "$server" ] && kill "$server" 2> /dev/null
+    rm -rf "$dir"
+}
+trap cleanup EXIT
+
+fail() {
+    echo "FAIL: $*"
+    for log in "$dir"/*.log; do
+        echo "--- $(basename "$log")"
+        tr -d '\033' < "$log"
+    done
+    exit 1
+}
+
+export FIGHTTRACK_UDP_LOSS=20
+export FIGHTTRACK_CACHE="$dir/cache"
+export TERM=xterm
+export LANG=C.UTF-8
+
+# Below the ephemeral ports, so no client of another test holds it
+port=$((20000 + RANDOM % 10000))
+stdbuf -oL "$bin" server "$port" > "$dir/server.log" 2>&1 &
+server=$!
+sleep 1
+kill -0 "$server" 2> /dev/null || fail "server didn't start"
+
+# Play for some seconds, then press Escape to quit
+run_client() {
+    local name=$1 seconds=$2
+    (sleep "$seconds"; printf '\033'; sleep 1) |
+        timeout $((seconds + 5)) script -qec \
+            "stty cols 100 rows 30; '$bin' client 127.0.0.1:$port $name udp" \
+            "$dir/$name.log" > /dev/null
+}
+
+run_client alice 6 &
+alice=$!
+sleep 3
+run_client bob 3 || fail "bob didn't quit cleanly"
+wait "$alice" || fail "alice didn't quit cleanly"
+
+expect() {
+    grep -aq -- "$2" "$dir/$1.log" || fail "no '$2' in the output of $1"
+}
+
+# Map streamed once, then cached
+expect alice "map [0-9a-f]* downloaded"
+expect bob "map [0-9a-f]* loaded from cache"
+ls "$FIGHTTRACK_CACHE"/maps/*.ftmap > /dev/null 2>&1 || fail "no map in the cache"
+
+# Names go over TCP, snapshots over UDP both ways
+expect alice "player 1 is 'bob'"
+expect bob "player 0 is 'alice'"
+expect alice "receiving snapshots over UDP"
+expect bob "receiving snapshots over UDP"
+expect server "client 0 receives snapshots over UDP"
+expect server "client 1 receives snapshots over UDP"
+
+echo "PASS"
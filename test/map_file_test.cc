@@ -0,0 +1,82 @@
+/**
+ * \file   map_file_test.cc
+ * \brief  Check that map files with a truncated or corrupt header are rejected.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <string>
+
+#include "fighttrack/map_file.h"
+
+/**************************************************************************************/
+
+using namespace fighttrack;
+
+/* Map file image of a header alone, padded with zeros to a size */
+static std::string MakeImage(uint16_t chunk_size, uint32_t width, uint32_t height,
+                             size_t size)
+{
+    MapFileHeader header{};
+    memcpy(header.magic, kMapFileMagic, sizeof(header.magic));
+    header.version = kMapFileVersion;
+    header.chunk_size = chunk_size;
+    header.width = width;
+    header.height = height;
+    header.num_tiles = 1;
+    std::string image(std::max(size, sizeof(header)), '\0');
+    memcpy(&image[0], &header, sizeof(header));
+    return image;
+}
+
+/* Check if an image opens as a map file as expected */
+static int Expect(const char* name, std::string image, bool valid)
+{
+    MapFile file;
+    const bool opened = (file.OpenImage(std::move(image)) == 0);
+    if (opened != valid) {
+        fprintf(stderr, "FAIL: %s %s\n", name, opened ? "accepted" : "rejected");
+        return 1;
+    }
+    return 0;
+}
+
+/**************************************************************************************/
+
+int main()
+{
+    int failures = 0;
+
+    std::string image;
+    if (CompileMap({ "  ▓▓  ", "▓▓▓▓▓▓" }, &image, 4) != 0) {
+        fprintf(stderr, "Failed to compile map\n");
+        return 1;
+    }
+    failures += Expect("compiled map", image, true);
+    const size_t header_size = sizeof(MapFileHeader);
+    const size_t truncated_sizes[] = { 0, header_size - 1, header_size + 4,
+                                       image.size() - 1 };
+    for (size_t size : truncated_sizes) {
+        failures += Expect("truncated map", image.substr(0, size), false);
+    }
+
+    /* chunks_x * chunks_y * 8 wraps around to about 540 KB */
+    const uint32_t wrap_width = (1u << 30) + 23170;
+    const uint32_t wrap_height = (1u << 31) - 46339;
+    failures += Expect("wrapping offset table",
+                       MakeImage(1, wrap_width, wrap_height, 600000), false);
+    failures += Expect("width past INT32_MAX", MakeImage(1, 1u << 31, 1, 4096), false);
+    failures += Expect("height past INT32_MAX", MakeImage(1, 1, 1u << 31, 4096), false);
+
+    /* The offset table, one entry per chunk (4x2 here), must fit exactly */
+    const size_t table_offset = header_size + sizeof(MapFileTile);
+    const size_t table_end = table_offset + 8 * sizeof(uint64_t);
+    failures += Expect("offset table in the file", MakeImage(4, 16, 8, table_end), true);
+    failures +=
+        Expect("offset table past the end", MakeImage(4, 16, 8, table_end - 1), false);
+
+    printf("%d failures\n", failures);
+    return (failures == 0) ? 0 : 1;
+}